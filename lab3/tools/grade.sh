@@ -325,7 +325,7 @@ quick_run 'Check SWAP'
 
 pts=5
 quick_check 'check pmm'                                         \
-    'memory management: default_pmm_manager'                      \
+    'memory management: buddy_pmm_manager'                        \
     'check_alloc_page() succeeded!'                             \
     'check_pgdir() succeeded!'                                  \
     'check_boot_pgdir() succeeded!'
@@ -6,36 +6,21 @@
 #include <sync.h>
 #include <pmm.h>
 #include <stdio.h>
+#include <slub.h>
+#include <x86.h>
 
 /*
- * SLOB Allocator: Simple List Of Blocks
+ * kmalloc on top of the slub kmem caches (kern/mm/slub.c)
  *
- * Matt Mackall <mpm@selenic.com> 12/30/03
+ * Requests of up to SIZED_CACHE_MAX bytes are served by one of the sized
+ * caches (16, 32, ..., 2048 bytes), so kmalloc and kfree are O(1): kfree
+ * finds the cache of a block from the PG_slab mark of its page. Both of them
+ * are normally served by the per-CPU magazines of the cache without touching
+ * the slabs or disabling interrupts.
  *
- * How SLOB works:
- *
- * The core of SLOB is a traditional K&R style heap allocator, with
- * support for returning aligned objects. The granularity of this
- * allocator is 8 bytes on x86, though it's perhaps possible to reduce
- * this to 4 if it's deemed worth the effort. The slob heap is a
- * singly-linked list of pages from __get_free_page, grown on demand
- * and allocation from the heap is currently first-fit.
- *
- * Above this is an implementation of kmalloc/kfree. Blocks returned
- * from kmalloc are 8-byte aligned and prepended with a 8-byte header.
- * If kmalloc is asked for objects of PAGE_SIZE or larger, it calls
- * __get_free_pages directly so that it can return page-aligned blocks
- * and keeps a linked list of such pages and their orders. These
- * objects are detected in kfree() by their page alignment.
- *
- * SLAB is emulated on top of SLOB by simply calling constructors and
- * destructors for every SLAB allocation. Objects are returned with
- * the 8-byte alignment unless the SLAB_MUST_HWCACHE_ALIGN flag is
- * set, in which case the low-level allocator will fragment blocks to
- * create the proper alignment. Again, objects of page-size or greater
- * are allocated by calling __get_free_pages. As SLAB objects know
- * their size, no separate size bookkeeping is necessary and there is
- * essentially no allocation space overhead.
+ * Larger requests call alloc_pages directly so that they get page-aligned
+ * blocks, and a linked list of such blocks and their orders is kept. Those
+ * blocks are told apart in kfree() by their page not being PG_slab.
  */
 
 
@@ -47,24 +32,16 @@ typedef unsigned int gfp_t;
 #define PAGE_SIZE PGSIZE
 #endif
 
-#ifndef L1_CACHE_BYTES
-#define L1_CACHE_BYTES 64
-#endif
-
-#ifndef ALIGN
-#define ALIGN(addr,size)   (((addr)+(size)-1)&(~((size)-1))) 
-#endif
-
+// The number of sized cache : 16, 32, 64, 128, 256, 512, 1024, 2048
+#define SIZED_CACHE_NUM     8
+#define SIZED_CACHE_MIN     16
+#define SIZED_CACHE_MAX     2048
 
-struct slob_block {
-	int units;
-	struct slob_block *next;
+static struct kmem_cache_t *sized_caches[SIZED_CACHE_NUM];
+static const char *sized_cache_names[SIZED_CACHE_NUM] = {
+    "size-16", "size-32", "size-64", "size-128",
+    "size-256", "size-512", "size-1024", "size-2048",
 };
-typedef struct slob_block slob_t;
-
-#define SLOB_UNIT sizeof(slob_t)
-#define SLOB_UNITS(size) (((size) + SLOB_UNIT - 1)/SLOB_UNIT)
-#define SLOB_ALIGN L1_CACHE_BYTES
 
 struct bigblock {
 	int order;
@@ -73,12 +50,10 @@ struct bigblock {
 };
 typedef struct bigblock bigblock_t;
 
-static slob_t arena = { .next = &arena, .units = 1 };
-static slob_t *slobfree = &arena;
 static bigblock_t *bigblocks;
 
 
-static void* __slob_get_free_pages(gfp_t gfp, int order)
+static void* __kmalloc_get_free_pages(gfp_t gfp, int order)
 {
   struct Page * page = alloc_pages(1 << order);
   if(!page)
@@ -86,152 +61,143 @@ static void* __slob_get_free_pages(gfp_t gfp, int order)
   return page2kva(page);
 }
 
-#define __slob_get_free_page(gfp) __slob_get_free_pages(gfp, 0)
-
-static inline void __slob_free_pages(unsigned long kva, int order)
+static inline void __kmalloc_free_pages(unsigned long kva, int order)
 {
-  free_pages(kva2page(kva), 1 << order);
+  free_pages(kva2page((void *)kva), 1 << order);
 }
 
-static void slob_free(void *b, int size);
-
-static void *slob_alloc(size_t size, gfp_t gfp, int align)
-{
-  assert( (size + SLOB_UNIT) < PAGE_SIZE );
-
-	slob_t *prev, *cur, *aligned = 0;
-	int delta = 0, units = SLOB_UNITS(size);
-	unsigned long flags;
-
-	spin_lock_irqsave(&slob_lock, flags);
-	prev = slobfree;
-	for (cur = prev->next; ; prev = cur, cur = cur->next) {
-		if (align) {
-			aligned = (slob_t *)ALIGN((unsigned long)cur, align);
-			delta = aligned - cur;
-		}
-		if (cur->units >= units + delta) { /* room enough? */
-			if (delta) { /* need to fragment head to align? */
-				aligned->units = cur->units - delta;
-				aligned->next = cur->next;
-				cur->next = aligned;
-				cur->units = delta;
-				prev = cur;
-				cur = aligned;
-			}
-
-			if (cur->units == units) /* exact fit? */
-				prev->next = cur->next; /* unlink */
-			else { /* fragment */
-				prev->next = cur + units;
-				prev->next->units = cur->units - units;
-				prev->next->next = cur->next;
-				cur->units = units;
-			}
-
-			slobfree = prev;
-			spin_unlock_irqrestore(&slob_lock, flags);
-			return cur;
-		}
-		if (cur == slobfree) {
-			spin_unlock_irqrestore(&slob_lock, flags);
-
-			if (size == PAGE_SIZE) /* trying to shrink arena? */
-				return 0;
-
-			cur = (slob_t *)__slob_get_free_page(gfp);
-			if (!cur)
-				return 0;
-
-			slob_free(cur, PAGE_SIZE);
-			spin_lock_irqsave(&slob_lock, flags);
-			cur = slobfree;
-		}
-	}
+static int
+kmalloc_sized_index(size_t size) {
+    int index = 0;
+    while ((SIZED_CACHE_MIN << index) < size)
+        index ++;
+    return index;
 }
 
-static void slob_free(void *block, int size)
-{
-	slob_t *cur, *b = (slob_t *)block;
-	unsigned long flags;
-
-	if (!block)
-		return;
-
-	if (size)
-		b->units = SLOB_UNITS(size);
-
-	/* Find reinsertion point */
-	spin_lock_irqsave(&slob_lock, flags);
-	for (cur = slobfree; !(b > cur && b < cur->next); cur = cur->next)
-		if (cur >= cur->next && (b > cur || b < cur->next))
-			break;
-
-	if (b + b->units == cur->next) {
-		b->units += cur->next->units;
-		b->next = cur->next->next;
-	} else
-		b->next = cur->next;
-
-	if (cur + cur->units == b) {
-		cur->units += b->units;
-		cur->next = b->next;
-	} else
-		cur->next = b;
-
-	slobfree = cur;
-
-	spin_unlock_irqrestore(&slob_lock, flags);
+static void
+check_kmalloc(void) {
+    size_t fp = nr_free_pages();
+    void *p0, *p1, *p2;
+    int i;
+
+    // sized caches are picked by size and kfree finds them back
+    for (i = 0; i < SIZED_CACHE_NUM; i ++) {
+        size_t size = (SIZED_CACHE_MIN << i);
+        assert((p0 = kmalloc(size)) != NULL);
+        assert(kmem_cache_of(p0) == sized_caches[i]);
+        assert(ksize(p0) == size);
+        kfree(p0);
+    }
+    assert((p0 = kmalloc(1)) != NULL && ksize(p0) == SIZED_CACHE_MIN);
+    assert((p1 = kmalloc(SIZED_CACHE_MIN + 1)) != NULL && ksize(p1) == SIZED_CACHE_MIN * 2);
+    // big blocks are page aligned
+    assert((p2 = kmalloc(SIZED_CACHE_MAX + 1)) != NULL && ksize(p2) == PGSIZE);
+    assert(((uintptr_t)p2 & (PGSIZE - 1)) == 0 && !PageSlab(kva2page(p2)));
+    kfree(p2);
+    assert((p2 = kmalloc(PGSIZE * 3)) != NULL && ksize(p2) == PGSIZE * 4);
+    kfree(p2), kfree(p1), kfree(p0);
+
+    kmem_cache_reap();
+    assert(nr_free_pages() == fp);
+
+    cprintf("check_kmalloc() succeeded!\n");
 }
 
+#define BENCH_ROUNDS        4096
+#define BENCH_BURST         64
+#define BENCH_SIZE          32
+
+// bench_kmalloc_run - kmalloc(BENCH_SIZE)/kfree as back-to-back pairs and as
+//                   - bursts of BENCH_BURST, which cycle magazines through the depot
+static void
+bench_kmalloc_run(const char *layer) {
+    void *burst[BENCH_BURST];
+    uint64_t start, cycles;
+    int i, j;
+
+    start = rdtsc();
+    for (i = 0; i < BENCH_ROUNDS; i ++) {
+        void *p = kmalloc(BENCH_SIZE);
+        assert(p != NULL);
+        kfree(p);
+    }
+    cycles = rdtsc() - start;
+    do_div(cycles, BENCH_ROUNDS);
+    cprintf("bench_kmalloc: %s, kmalloc(%d)+kfree pair: %u cycles\n", layer, BENCH_SIZE, (unsigned int)cycles);
+
+    start = rdtsc();
+    for (i = 0; i < BENCH_ROUNDS / BENCH_BURST; i ++) {
+        for (j = 0; j < BENCH_BURST; j ++) {
+            assert((burst[j] = kmalloc(BENCH_SIZE)) != NULL);
+        }
+        for (j = 0; j < BENCH_BURST; j ++) {
+            kfree(burst[j]);
+        }
+    }
+    cycles = rdtsc() - start;
+    do_div(cycles, BENCH_ROUNDS);
+    cprintf("bench_kmalloc: %s, burst of %d: %u cycles per kmalloc+kfree\n", layer, BENCH_BURST, (unsigned int)cycles);
+}
 
-
-void
-slob_init(void) {
-  cprintf("use SLOB allocator\n");
+// bench_kmalloc - compare the magazine fast path with going to the slabs every time
+static void
+bench_kmalloc(void) {
+    struct kmem_cache_t *cachep = sized_caches[kmalloc_sized_index(BENCH_SIZE)];
+    bench_kmalloc_run("magazine");
+    kmem_cache_shrink(cachep);
+    cachep->flags |= KMEM_CACHE_NOMAG;
+    bench_kmalloc_run("slab");
+    cachep->flags &= ~KMEM_CACHE_NOMAG;
+    kmem_cache_reap();
 }
 
-inline void 
+void
 kmalloc_init(void) {
-    slob_init();
+    int i;
+    kmem_cache_init();
+    // 初始化8个固定大小的内置cache
+    for (i = 0; i < SIZED_CACHE_NUM; i ++) {
+        if ((sized_caches[i] = kmem_cache_create(sized_cache_names[i], SIZED_CACHE_MIN << i, NULL, NULL)) == NULL) {
+            panic("kmalloc_init: cannot create %s.\n", sized_cache_names[i]);
+        }
+    }
+    check_kmalloc();
+    bench_kmalloc();
     cprintf("kmalloc_init() succeeded!\n");
 }
 
-size_t
-slob_allocated(void) {
-  return 0;
-}
-
 size_t
 kallocated(void) {
-   return slob_allocated();
+   return 0;
 }
 
-static int find_order(int size)
+// find_order - the smallest order whose block holds size bytes, size is at most
+//            - PAGE_SIZE << KMALLOC_MAX_ORDER (see __kmalloc)
+static int find_order(size_t size)
 {
 	int order = 0;
-	for ( ; size > 4096 ; size >>=1)
+	for ( ; size > (PAGE_SIZE << order) ; )
 		order++;
 	return order;
 }
 
 static void *__kmalloc(size_t size, gfp_t gfp)
 {
-	slob_t *m;
 	bigblock_t *bb;
 	unsigned long flags;
 
-	if (size < PAGE_SIZE - SLOB_UNIT) {
-		m = slob_alloc(size + SLOB_UNIT, gfp, 0);
-		return m ? (void *)(m + 1) : 0;
+	if (size <= SIZED_CACHE_MAX) {
+		return kmem_cache_alloc(sized_caches[kmalloc_sized_index(size)]);
 	}
+	if (size > (PAGE_SIZE << KMALLOC_MAX_ORDER))
+		return 0;
 
-	bb = slob_alloc(sizeof(bigblock_t), gfp, 0);
+	bb = kmalloc(sizeof(bigblock_t));
 	if (!bb)
 		return 0;
 
 	bb->order = find_order(size);
-	bb->pages = (void *)__slob_get_free_pages(gfp, bb->order);
+	bb->pages = (void *)__kmalloc_get_free_pages(gfp, bb->order);
 
 	if (bb->pages) {
 		spin_lock_irqsave(&block_lock, flags);
@@ -241,7 +207,7 @@ static void *__kmalloc(size_t size, gfp_t gfp)
 		return bb->pages;
 	}
 
-	slob_free(bb, sizeof(bigblock_t));
+	kfree(bb);
 	return 0;
 }
 
@@ -260,23 +226,24 @@ void kfree(void *block)
 	if (!block)
 		return;
 
-	if (!((unsigned long)block & (PAGE_SIZE-1))) {
-		/* might be on the big block list */
-		spin_lock_irqsave(&block_lock, flags);
-		for (bb = bigblocks; bb; last = &bb->next, bb = bb->next) {
-			if (bb->pages == block) {
-				*last = bb->next;
-				spin_unlock_irqrestore(&block_lock, flags);
-				__slob_free_pages((unsigned long)block, bb->order);
-				slob_free(bb, sizeof(bigblock_t));
-				return;
-			}
+	if (PageSlab(kva2page(block))) {
+		kmem_cache_free(kmem_cache_of(block), block);
+		return;
+	}
+
+	spin_lock_irqsave(&block_lock, flags);
+	for (bb = bigblocks; bb; last = &bb->next, bb = bb->next) {
+		if (bb->pages == block) {
+			*last = bb->next;
+			spin_unlock_irqrestore(&block_lock, flags);
+			__kmalloc_free_pages((unsigned long)block, bb->order);
+			kfree(bb);
+			return;
 		}
-		spin_unlock_irqrestore(&block_lock, flags);
 	}
+	spin_unlock_irqrestore(&block_lock, flags);
 
-	slob_free((slob_t *)block - 1, 0);
-	return;
+	panic("kfree: %08x is not allocated by kmalloc.\n", block);
 }
 
 
@@ -288,18 +255,17 @@ unsigned int ksize(const void *block)
 	if (!block)
 		return 0;
 
-	if (!((unsigned long)block & (PAGE_SIZE-1))) {
-		spin_lock_irqsave(&block_lock, flags);
-		for (bb = bigblocks; bb; bb = bb->next)
-			if (bb->pages == block) {
-				spin_unlock_irqrestore(&slob_lock, flags);
-				return PAGE_SIZE << bb->order;
-			}
-		spin_unlock_irqrestore(&block_lock, flags);
-	}
-
-	return ((slob_t *)block - 1)->units * SLOB_UNIT;
-}
+	if (PageSlab(kva2page((void *)block)))
+		return kmem_cache_size(kmem_cache_of((void *)block));
 
+	spin_lock_irqsave(&block_lock, flags);
+	for (bb = bigblocks; bb; bb = bb->next)
+		if (bb->pages == block) {
+			spin_unlock_irqrestore(&block_lock, flags);
+			return PAGE_SIZE << bb->order;
+		}
+	spin_unlock_irqrestore(&block_lock, flags);
 
+	return 0;
+}
 
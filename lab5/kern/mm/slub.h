@@ -0,0 +1,64 @@
+#ifndef __KERN_MM_SLUB_H__
+#define __KERN_MM_SLUB_H__
+
+#include <pmm.h>
+#include <list.h>
+
+#define CACHE_NAMELEN 16
+
+// Magazine layer (Bonwick & Adams): a magazine is a stack of up to MAGAZINE_SIZE
+// constructed objects. Each CPU owns a loaded and a previous magazine per cache
+// and only trades whole magazines with the depot of the cache when both of them
+// run empty (alloc) or full (free).
+#define KMEM_NCPU       1
+#define MAGAZINE_SIZE   16
+
+// kmem_cache_t.flags
+#define KMEM_CACHE_NOMAG    0x1     // no magazine layer, every call goes to the slabs
+
+struct kmem_magazine;
+
+struct kmem_cpu_cache {
+    struct kmem_magazine *loaded;                       // 当前弹匣，对象从这里取/放
+    struct kmem_magazine *previous;                     // 上一个弹匣，满或空
+};
+
+// 每种对象由cache（可以理解为仓库）进行统一管理
+struct kmem_cache_t {
+    // Linux 的slab 可有三种状态：全满、部分空闲、全空
+    // slab分配器首先从部分空闲的slab进行分配，如没有，则从物理连续页上分配新的slab，并把它赋给一个cache，然后再从新slab分配空间
+    list_entry_t slabs_full;	                        // 全满Slab链表
+    list_entry_t slabs_partial;                         // 部分空闲Slab链表
+    list_entry_t slabs_free;                            // 全空闲Slab链表
+    uint16_t objsize;		                            // 对象大小
+    uint16_t num;                                   	// 每个Slab保存的对象数目
+    uint16_t order;                                     // 每个Slab占 2^order 页
+    uint16_t offset;                                    // 第一个对象在Slab中的偏移量
+    uint16_t flags;                                     // KMEM_CACHE_*
+    void (*ctor)(void*, struct kmem_cache_t *, size_t); // 构造函数
+    void (*dtor)(void*, struct kmem_cache_t *, size_t); // 析构函数
+    char name[CACHE_NAMELEN];                       	// cache名称
+    list_entry_t cache_link;	                        // cache链表，方便遍历
+    struct kmem_cpu_cache cpu_cache[KMEM_NCPU];         // 每个CPU的弹匣
+    list_entry_t depot_full;                            // depot中的满弹匣
+    list_entry_t depot_empty;                           // depot中的空弹匣
+};
+
+struct kmem_cache_t *
+kmem_cache_create(const char *name, size_t size,
+                       void (*ctor)(void*, struct kmem_cache_t *, size_t),
+                       void (*dtor)(void*, struct kmem_cache_t *, size_t));
+void kmem_cache_destroy(struct kmem_cache_t *cachep);
+void *kmem_cache_alloc(struct kmem_cache_t *cachep);
+void *kmem_cache_zalloc(struct kmem_cache_t *cachep);
+void kmem_cache_free(struct kmem_cache_t *cachep, void *objp);
+size_t kmem_cache_size(struct kmem_cache_t *cachep);
+const char *kmem_cache_name(struct kmem_cache_t *cachep);
+int kmem_cache_shrink(struct kmem_cache_t *cachep);
+int kmem_cache_reap(void);
+struct kmem_cache_t *kmem_cache_of(void *objp);
+
+void kmem_cache_init(void);
+
+#endif /* ! __KERN_MM_SLUB_H__ */
+
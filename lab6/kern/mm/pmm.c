@@ -6,6 +6,7 @@
 #include <memlayout.h>
 #include <pmm.h>
 #include <default_pmm.h>
+#include <buddy_pmm.h>
 #include <sync.h>
 #include <error.h>
 #include <swap.h>
@@ -137,10 +138,15 @@ gdt_init(void) {
     ltr(GD_TSS);
 }
 
+// PMM_MANAGER selects the pmm_manager at build time, see PMM in the Makefile
+#ifndef PMM_MANAGER
+#define PMM_MANAGER                 buddy_pmm_manager
+#endif
+
 //init_pmm_manager - initialize a pmm_manager instance
 static void
 init_pmm_manager(void) {
-    pmm_manager = &default_pmm_manager;
+    pmm_manager = &PMM_MANAGER;
     cprintf("memory management: %s\n", pmm_manager->name);
     pmm_manager->init();
 }
@@ -611,12 +617,66 @@ pgdir_alloc_page(pde_t *pgdir, uintptr_t la, uint32_t perm) {
     return page;
 }
 
+#define BENCH_ROUNDS                4096
+#define BENCH_BURST                 32
+#define BENCH_MAX_NPAGES            16
+
+// bench_alloc_page - hammer the alloc/free path of the pmm_manager: single pages
+//                  - as back-to-back pairs and as bursts of BENCH_BURST, then bursts
+//                  - of 1 ~ BENCH_MAX_NPAGES pages. Build with different PMM to compare.
+static void
+bench_alloc_page(void) {
+    struct Page *burst[BENCH_BURST];
+    uint64_t start, cycles;
+    int i, j;
+
+    start = rdtsc();
+    for (i = 0; i < BENCH_ROUNDS; i ++) {
+        struct Page *p = alloc_page();
+        assert(p != NULL);
+        free_page(p);
+    }
+    cycles = rdtsc() - start;
+    do_div(cycles, BENCH_ROUNDS);
+    cprintf("bench_alloc_page: %s, alloc+free pair: %u cycles\n", pmm_manager->name, (unsigned int)cycles);
+
+    start = rdtsc();
+    for (i = 0; i < BENCH_ROUNDS / BENCH_BURST; i ++) {
+        for (j = 0; j < BENCH_BURST; j ++) {
+            assert((burst[j] = alloc_page()) != NULL);
+        }
+        for (j = 0; j < BENCH_BURST; j ++) {
+            free_page(burst[j]);
+        }
+    }
+    cycles = rdtsc() - start;
+    do_div(cycles, BENCH_ROUNDS);
+    cprintf("bench_alloc_page: %s, burst of %d: %u cycles per page\n", pmm_manager->name, BENCH_BURST, (unsigned int)cycles);
+
+    start = rdtsc();
+    for (i = 0; i < BENCH_ROUNDS / BENCH_BURST; i ++) {
+        for (j = 0; j < BENCH_BURST; j ++) {
+            assert((burst[j] = alloc_pages(j % BENCH_MAX_NPAGES + 1)) != NULL);
+        }
+        for (j = 0; j < BENCH_BURST; j ++) {
+            free_pages(burst[j], j % BENCH_MAX_NPAGES + 1);
+        }
+    }
+    cycles = rdtsc() - start;
+    do_div(cycles, BENCH_ROUNDS);
+    cprintf("bench_alloc_page: %s, burst of 1~%d pages: %u cycles per call\n", pmm_manager->name, BENCH_MAX_NPAGES, (unsigned int)cycles);
+}
+
 static void
 check_alloc_page(void) {
+    size_t nr_free_store = nr_free_pages();
     pmm_manager->check();
+    bench_alloc_page();
+    assert(nr_free_store == nr_free_pages());
     cprintf("check_alloc_page() succeeded!\n");
 }
 
+
 static void
 check_pgdir(void) {
     assert(npage <= KMEMSIZE / PGSIZE);
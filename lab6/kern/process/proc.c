@@ -1,5 +1,6 @@
 #include <proc.h>
 #include <kmalloc.h>
+#include <slub.h>
 #include <string.h>
 #include <sync.h>
 #include <pmm.h>
@@ -79,6 +80,9 @@ struct proc_struct *current = NULL;
 
 static int nr_process = 0;
 
+// cache of proc_struct
+static struct kmem_cache_t *proc_cachep;
+
 void kernel_thread_entry(void);
 void forkrets(struct trapframe *tf);
 void switch_to(struct context *from, struct context *to);
@@ -86,7 +90,7 @@ void switch_to(struct context *from, struct context *to);
 // alloc_proc - alloc a proc_struct and init all fields of proc_struct
 static struct proc_struct *
 alloc_proc(void) {
-    struct proc_struct *proc = kmalloc(sizeof(struct proc_struct));
+    struct proc_struct *proc = kmem_cache_alloc(proc_cachep);
     if (proc != NULL) {
         proc->state = PROC_UNINIT;
         proc->pid = -1;
@@ -473,7 +477,7 @@ fork_out:
 bad_fork_cleanup_kstack:
     put_kstack(proc);
 bad_fork_cleanup_proc:
-    kfree(proc);
+    kmem_cache_free(proc_cachep, proc);
     goto fork_out;
 }
 
@@ -789,7 +793,7 @@ found:
     }
     local_intr_restore(intr_flag);
     put_kstack(proc);
-    kfree(proc);
+    kmem_cache_free(proc_cachep, proc);
     return 0;
 }
 
@@ -884,6 +888,10 @@ void
 proc_init(void) {
     int i;
 
+    if ((proc_cachep = kmem_cache_create("proc_struct", sizeof(struct proc_struct), NULL, NULL)) == NULL) {
+        panic("cannot create proc_struct cache.\n");
+    }
+
     list_init(&proc_list);
     for (i = 0; i < HASH_LIST_SIZE; i ++) {
         list_init(hash_list + i);
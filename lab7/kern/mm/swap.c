@@ -6,7 +6,6 @@
 #include <memlayout.h>
 #include <pmm.h>
 #include <mmu.h>
-#include <default_pmm.h>
 #include <kdebug.h>
 
 // the valid vaddr for check is between 0~CHECK_VALID_VADDR-1
@@ -171,24 +170,13 @@ struct Page * check_rp[CHECK_VALID_PHY_PAGE_NUM];
 pte_t * check_ptep[CHECK_VALID_PHY_PAGE_NUM];
 unsigned int check_swap_addr[CHECK_VALID_VIR_PAGE_NUM];
 
-extern free_area_t free_area;
-
-#define free_list (free_area.free_list)
-#define nr_free (free_area.nr_free)
-
 static void
 check_swap(void)
 {
     //backup mem env
-     int ret, count = 0, total = 0, i;
-     list_entry_t *le = &free_list;
-     while ((le = list_next(le)) != &free_list) {
-        struct Page *p = le2page(le, page_link);
-        assert(PageProperty(p));
-        count ++, total += p->property;
-     }
-     assert(total == nr_free_pages());
-     cprintf("BEGIN check_swap: count %d, total %d\n",count,total);
+     int ret, i;
+     size_t total = nr_free_pages();
+     cprintf("BEGIN check_swap: total %d\n",total);
      
      //now we set the phy pages env     
      struct mm_struct *mm = mm_create();
@@ -219,18 +207,24 @@ check_swap(void)
           assert(check_rp[i] != NULL );
           assert(!PageProperty(check_rp[i]));
      }
-     list_entry_t free_list_store = free_list;
-     list_init(&free_list);
-     assert(list_empty(&free_list));
+     // hold every other free page aside, whatever the pmm_manager is, so that
+     // only the CHECK_VALID_PHY_PAGE_NUM pages freed below can be handed out
+     list_entry_t hoard;
+     list_init(&hoard);
+     size_t nr_hoard = nr_free_pages();
+     for (i=0;i<nr_hoard;i++) {
+          struct Page *p = alloc_page();
+          assert(p != NULL);
+          list_add(&hoard, &(p->page_link));
+     }
+     assert(nr_free_pages()==0);
      
      //assert(alloc_page() == NULL);
      
-     unsigned int nr_free_store = nr_free;
-     nr_free = 0;
      for (i=0;i<CHECK_VALID_PHY_PAGE_NUM;i++) {
         free_pages(check_rp[i],1);
      }
-     assert(nr_free==CHECK_VALID_PHY_PAGE_NUM);
+     assert(nr_free_pages()==CHECK_VALID_PHY_PAGE_NUM);
      
      cprintf("set up init env for check_swap begin!\n");
      //setup initial vir_page<->phy_page environment for page relpacement algorithm 
@@ -239,7 +233,7 @@ check_swap(void)
      pgfault_num=0;
      
      check_content_set();
-     assert( nr_free == 0);         
+     assert(nr_free_pages() == 0);         
      for(i = 0; i<MAX_SEQ_NO ; i++) 
          swap_out_seq_no[i]=swap_in_seq_no[i]=-1;
      
@@ -268,17 +262,15 @@ check_swap(void)
      mm_destroy(mm);
      check_mm_struct = NULL;
      
-     nr_free = nr_free_store;
-     free_list = free_list_store;
-
-     
-     le = &free_list;
-     while ((le = list_next(le)) != &free_list) {
-         struct Page *p = le2page(le, page_link);
-         count --, total -= p->property;
+     list_entry_t *le;
+     while ((le = list_next(&hoard)) != &hoard) {
+         list_del(le);
+         free_page(le2page(le, page_link));
      }
-     cprintf("count is %d, total is %d\n",count,total);
-     //assert(count == 0);
+     
+     cprintf("total is %d, now %d\n",total,nr_free_pages());
+     // every page the check took, the frames, the page table and the hoard, is back
+     assert(total == nr_free_pages());
      
      cprintf("check_swap() succeeded!\n");
 }
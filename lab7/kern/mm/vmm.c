@@ -8,6 +8,7 @@
 #include <x86.h>
 #include <swap.h>
 #include <kmalloc.h>
+#include <slub.h>
 
 /* 
   vmm design include two parts: mm_struct (mm) & vma_struct (vma)
@@ -39,10 +40,13 @@ static void check_vmm(void);
 static void check_vma_struct(void);
 static void check_pgfault(void);
 
+static struct kmem_cache_t *mm_cachep;     // cache of mm_struct
+static struct kmem_cache_t *vma_cachep;    // cache of vma_struct
+
 // mm_create -  alloc a mm_struct & initialize it.
 struct mm_struct *
 mm_create(void) {
-    struct mm_struct *mm = kmalloc(sizeof(struct mm_struct));
+    struct mm_struct *mm = kmem_cache_alloc(mm_cachep);
 
     if (mm != NULL) {
         list_init(&(mm->mmap_list));
@@ -62,7 +66,7 @@ mm_create(void) {
 // vma_create - alloc a vma_struct & initialize it. (addr range: vm_start~vm_end)
 struct vma_struct *
 vma_create(uintptr_t vm_start, uintptr_t vm_end, uint32_t vm_flags) {
-    struct vma_struct *vma = kmalloc(sizeof(struct vma_struct));
+    struct vma_struct *vma = kmem_cache_alloc(vma_cachep);
 
     if (vma != NULL) {
         vma->vm_start = vm_start;
@@ -150,9 +154,9 @@ mm_destroy(struct mm_struct *mm) {
     list_entry_t *list = &(mm->mmap_list), *le;
     while ((le = list_next(list)) != list) {
         list_del(le);
-        kfree(le2vma(le, list_link));  //kfree vma        
+        kmem_cache_free(vma_cachep, le2vma(le, list_link));  //kfree vma        
     }
-    kfree(mm); //kfree mm
+    kmem_cache_free(mm_cachep, mm); //kfree mm
     mm=NULL;
 }
 
@@ -246,6 +250,10 @@ copy_to_user(struct mm_struct *mm, void *dst, const void *src, size_t len) {
 //          - now just call check_vmm to check correctness of vmm
 void
 vmm_init(void) {
+    if ((mm_cachep = kmem_cache_create("mm_struct", sizeof(struct mm_struct), NULL, NULL)) == NULL ||
+        (vma_cachep = kmem_cache_create("vma_struct", sizeof(struct vma_struct), NULL, NULL)) == NULL) {
+        panic("vmm_init: cannot create mm/vma caches.\n");
+    }
     check_vmm();
 }
 
@@ -335,7 +335,7 @@ default_check() {
 
     pts=3
     quick_check 'check output'                                  \
-    'memory management: default_pmm_manager'                      \
+    'memory management: buddy_pmm_manager'                        \
     'check_alloc_page() succeeded!'                             \
     'check_pgdir() succeeded!'                                  \
     'check_boot_pgdir() succeeded!'				\
@@ -4,6 +4,10 @@
 #include <trap.h>
 #include <kmonitor.h>
 #include <kdebug.h>
+#include <kmalloc.h>
+#include <pmm.h>
+#include <order_pmm.h>
+#include <compaction.h>
 
 /* *
  * Simple command-line kernel monitor useful for controlling the
@@ -21,6 +25,9 @@ static struct command commands[] = {
     {"help", "Display this list of commands.", mon_help},
     {"kerninfo", "Display information about the kernel.", mon_kerninfo},
     {"backtrace", "Print backtrace of stack frame.", mon_backtrace},
+    {"kmalloc", "Display kmalloc and kmem cache usage.", mon_kmalloc},
+    {"zoneinfo", "Display free blocks per order of every memory zone.", mon_zoneinfo},
+    {"compact", "Compact memory for a free block of 2^order pages, display compaction stats.", mon_compact},
 };
 
 /* return if kernel is panic, in kern/debug/panic.c */
@@ -130,3 +137,42 @@ mon_backtrace(int argc, char **argv, struct trapframe *tf) {
     return 0;
 }
 
+/* *
+ * mon_kmalloc - call kmalloc_dump in kern/mm/kmalloc.c to print the
+ * usage of the kernel heap by size class and by kmem cache.
+ * */
+int
+mon_kmalloc(int argc, char **argv, struct trapframe *tf) {
+    kmalloc_dump();
+    return 0;
+}
+
+/* *
+ * mon_zoneinfo - call print_zoneinfo in kern/mm/pmm.c to print the free
+ * blocks per order of every zone, to watch external fragmentation.
+ * */
+int
+mon_zoneinfo(int argc, char **argv, struct trapframe *tf) {
+    print_zoneinfo();
+    return 0;
+}
+
+/* *
+ * mon_compact - with an order, call compact_pages in kern/mm/compaction.c to
+ * build one more free block of 2^order pages, then print the compaction stats.
+ * */
+int
+mon_compact(int argc, char **argv, struct trapframe *tf) {
+    if (argc >= 1) {
+        int order = strtol(argv[0], NULL, 10);
+        if (order < 0 || order >= MAX_ORDER) {
+            cprintf("compact: bad order %s.\n", argv[0]);
+            return 0;
+        }
+        cprintf("compact order %d: %s.\n", order,
+                compact_pages(order, ZONE_MASK_ANY) == 0 ? "done" : "failed");
+    }
+    print_compaction();
+    return 0;
+}
+
@@ -42,7 +42,6 @@
 #define IO_CTRL1                0x374
 
 #define MAX_IDE                 4
-#define MAX_NSECS               128
 #define MAX_DISK_NSECS          0x10000000U
 #define VALID_IDE(ideno)        (((ideno) >= 0) && ((ideno) < MAX_IDE) && (ide_devices[ideno].valid))
 
@@ -154,8 +153,10 @@ ide_device_size(unsigned short ideno) {
     return 0;
 }
 
-int
-ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs) {
+// ide_command - start a transfer of nsecs sectors from secno, the data of the sectors
+//             - goes through the data port one after another when the disk is ready
+static void
+ide_command(unsigned short ideno, uint32_t secno, size_t nsecs, uint8_t cmd) {
     assert(nsecs <= MAX_NSECS && VALID_IDE(ideno));
     assert(secno < MAX_DISK_NSECS && secno + nsecs <= MAX_DISK_NSECS);
     unsigned short iobase = IO_BASE(ideno), ioctrl = IO_CTRL(ideno);
@@ -169,46 +170,62 @@ ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs) {
     outb(iobase + ISA_CYL_LO, (secno >> 8) & 0xFF);
     outb(iobase + ISA_CYL_HI, (secno >> 16) & 0xFF);
     outb(iobase + ISA_SDH, 0xE0 | ((ideno & 1) << 4) | ((secno >> 24) & 0xF));
-    outb(iobase + ISA_COMMAND, IDE_CMD_READ);
+    outb(iobase + ISA_COMMAND, cmd);
+}
+
+// ide_read_secsv - read nbuf * nsecs sectors from secno with one command, nsecs
+//                - sectors into each of the buffers dsts[0 .. nbuf - 1] in turn
+int
+ide_read_secsv(unsigned short ideno, uint32_t secno, void * const *dsts, size_t nbuf, size_t nsecs) {
+    unsigned short iobase = IO_BASE(ideno);
+    ide_command(ideno, secno, nbuf * nsecs, IDE_CMD_READ);
 
     int ret = 0;
-    for (; nsecs > 0; nsecs --, dst += SECTSIZE) {
-        if ((ret = ide_wait_ready(iobase, 1)) != 0) {
-            goto out;
+    size_t i, j;
+    for (i = 0; i < nbuf; i ++) {
+        void *dst = dsts[i];
+        for (j = 0; j < nsecs; j ++, dst += SECTSIZE) {
+            if ((ret = ide_wait_ready(iobase, 1)) != 0) {
+                goto out;
+            }
+            insl(iobase, dst, SECTSIZE / sizeof(uint32_t));
         }
-        insl(iobase, dst, SECTSIZE / sizeof(uint32_t));
     }
 
 out:
     return ret;
 }
 
+// ide_write_secsv - write nbuf * nsecs sectors from secno with one command, nsecs
+//                 - sectors from each of the buffers srcs[0 .. nbuf - 1] in turn
 int
-ide_write_secs(unsigned short ideno, uint32_t secno, const void *src, size_t nsecs) {
-    assert(nsecs <= MAX_NSECS && VALID_IDE(ideno));
-    assert(secno < MAX_DISK_NSECS && secno + nsecs <= MAX_DISK_NSECS);
-    unsigned short iobase = IO_BASE(ideno), ioctrl = IO_CTRL(ideno);
-
-    ide_wait_ready(iobase, 0);
-
-    // generate interrupt
-    outb(ioctrl + ISA_CTRL, 0);
-    outb(iobase + ISA_SECCNT, nsecs);
-    outb(iobase + ISA_SECTOR, secno & 0xFF);
-    outb(iobase + ISA_CYL_LO, (secno >> 8) & 0xFF);
-    outb(iobase + ISA_CYL_HI, (secno >> 16) & 0xFF);
-    outb(iobase + ISA_SDH, 0xE0 | ((ideno & 1) << 4) | ((secno >> 24) & 0xF));
-    outb(iobase + ISA_COMMAND, IDE_CMD_WRITE);
+ide_write_secsv(unsigned short ideno, uint32_t secno, const void * const *srcs, size_t nbuf, size_t nsecs) {
+    unsigned short iobase = IO_BASE(ideno);
+    ide_command(ideno, secno, nbuf * nsecs, IDE_CMD_WRITE);
 
     int ret = 0;
-    for (; nsecs > 0; nsecs --, src += SECTSIZE) {
-        if ((ret = ide_wait_ready(iobase, 1)) != 0) {
-            goto out;
+    size_t i, j;
+    for (i = 0; i < nbuf; i ++) {
+        const void *src = srcs[i];
+        for (j = 0; j < nsecs; j ++, src += SECTSIZE) {
+            if ((ret = ide_wait_ready(iobase, 1)) != 0) {
+                goto out;
+            }
+            outsl(iobase, src, SECTSIZE / sizeof(uint32_t));
         }
-        outsl(iobase, src, SECTSIZE / sizeof(uint32_t));
     }
 
 out:
     return ret;
 }
 
+int
+ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs) {
+    return ide_read_secsv(ideno, secno, &dst, 1, nsecs);
+}
+
+int
+ide_write_secs(unsigned short ideno, uint32_t secno, const void *src, size_t nsecs) {
+    return ide_write_secsv(ideno, secno, &src, 1, nsecs);
+}
+
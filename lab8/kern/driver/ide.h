@@ -3,12 +3,16 @@
 
 #include <defs.h>
 
+#define MAX_NSECS               128     // sectors one command transfers at most
+
 void ide_init(void);
 bool ide_device_valid(unsigned short ideno);
 size_t ide_device_size(unsigned short ideno);
 
 int ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs);
 int ide_write_secs(unsigned short ideno, uint32_t secno, const void *src, size_t nsecs);
+int ide_read_secsv(unsigned short ideno, uint32_t secno, void * const *dsts, size_t nbuf, size_t nsecs);
+int ide_write_secsv(unsigned short ideno, uint32_t secno, const void * const *srcs, size_t nbuf, size_t nsecs);
 
 #endif /* !__KERN_DRIVER_IDE_H__ */
 
@@ -208,6 +208,21 @@ file_close(int fd) {
     return 0;
 }
 
+// file_inode - the inode of a readable file, the caller takes its own reference to keep it
+int
+file_inode(int fd, struct inode **node_store) {
+    int ret;
+    struct file *file;
+    if ((ret = fd2file(fd, &file)) != 0) {
+        return ret;
+    }
+    if (!file->readable) {
+        return -E_INVAL;
+    }
+    *node_store = file->node;
+    return 0;
+}
+
 // read file
 int
 file_read(int fd, void *base, size_t len, size_t *copied_store) {
@@ -31,6 +31,7 @@ bool file_testfd(int fd, bool readable, bool writable);
 
 int file_open(char *path, uint32_t open_flags);
 int file_close(int fd);
+int file_inode(int fd, struct inode **node_store);
 int file_read(int fd, void *base, size_t len, size_t *copied_store);
 int file_write(int fd, void *base, size_t len, size_t *copied_store);
 int file_seek(int fd, off_t pos, int whence);
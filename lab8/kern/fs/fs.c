@@ -35,6 +35,8 @@ files_create(void) {
     //cprintf("[files_create]\n");
     static_assert((int)FILES_STRUCT_NENTRY > 128);
     struct files_struct *filesp;
+    // a files_struct with its fd_array is exactly one page, a kmalloc big block of
+    // order 0; a slab cache of them would need 8-page slabs
     if ((filesp = kmalloc(sizeof(struct files_struct) + FILES_STRUCT_BUFSIZE)) != NULL) {
         filesp->pwd = NULL;
         filesp->fd_array = (void *)(filesp + 1);
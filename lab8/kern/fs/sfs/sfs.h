@@ -108,6 +108,7 @@ struct fs;
 struct inode;
 
 void sfs_init(void);
+void sfs_inode_cache_init(void);
 int sfs_mount(const char *devname);
 
 void lock_sfs_fs(struct sfs_fs *sfs);
@@ -4,6 +4,7 @@
 #include <list.h>
 #include <stat.h>
 #include <kmalloc.h>
+#include <slub.h>
 #include <vfs.h>
 #include <dev.h>
 #include <sfs.h>
@@ -16,6 +17,19 @@
 static const struct inode_ops sfs_node_dirops;  // dir operations
 static const struct inode_ops sfs_node_fileops; // file operations
 
+static struct kmem_cache_t *sfs_din_cachep;     // cache of sfs_disk_inode
+
+/*
+ * sfs_inode_cache_init - create the sfs_disk_inode cache, the sfs_inode itself
+ *                        lives in the inode cache (see inode.c)
+ */
+void
+sfs_inode_cache_init(void) {
+    if ((sfs_din_cachep = kmem_cache_create("sfs_disk_inode", sizeof(struct sfs_disk_inode), NULL, NULL)) == NULL) {
+        panic("sfs_inode_cache_init: cannot create sfs_disk_inode cache.\n");
+    }
+}
+
 /*
  * lock_sin - lock the process of inode Rd/Wr
  */
@@ -161,7 +175,7 @@ sfs_load_inode(struct sfs_fs *sfs, struct inode **node_store, uint32_t ino) {
 
     int ret = -E_NO_MEM;
     struct sfs_disk_inode *din;
-    if ((din = kmalloc(sizeof(struct sfs_disk_inode))) == NULL) {
+    if ((din = kmem_cache_alloc(sfs_din_cachep)) == NULL) {
         goto failed_unlock;
     }
 
@@ -182,7 +196,7 @@ out_unlock:
     return 0;
 
 failed_cleanup_din:
-    kfree(din);
+    kmem_cache_free(sfs_din_cachep, din);
 failed_unlock:
     unlock_sfs_fs(sfs);
     return ret;
@@ -599,6 +613,41 @@ sfs_io_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, void *buf, off_t offset
      * (3) If end position isn't aligned with the last block, Rd/Wr some content from begin to the (endpos % SFS_BLKSIZE) of the last block
 	 *       NOTICE: useful function: sfs_bmap_load_nolock, sfs_buf_op	
 	*/
+    if ((blkoff = offset % SFS_BLKSIZE) != 0) {
+        size = (nblks != 0) ? (SFS_BLKSIZE - blkoff) : (endpos - offset);
+        if ((ret = sfs_bmap_load_nolock(sfs, sin, blkno, &ino)) != 0) {
+            goto out;
+        }
+        if ((ret = sfs_buf_op(sfs, buf, size, ino, blkoff)) != 0) {
+            goto out;
+        }
+        alen += size;
+        if (nblks == 0) {
+            goto out;
+        }
+        buf += size, blkno ++, nblks --;
+    }
+
+    size = SFS_BLKSIZE;
+    while (nblks != 0) {
+        if ((ret = sfs_bmap_load_nolock(sfs, sin, blkno, &ino)) != 0) {
+            goto out;
+        }
+        if ((ret = sfs_block_op(sfs, buf, ino, 1)) != 0) {
+            goto out;
+        }
+        alen += size, buf += size, blkno ++, nblks --;
+    }
+
+    if ((size = endpos % SFS_BLKSIZE) != 0) {
+        if ((ret = sfs_bmap_load_nolock(sfs, sin, blkno, &ino)) != 0) {
+            goto out;
+        }
+        if ((ret = sfs_buf_op(sfs, buf, size, ino, 0)) != 0) {
+            goto out;
+        }
+        alen += size;
+    }
 out:
     *alenp = alen;
     if (offset + alen > sin->din->size) {
@@ -837,7 +886,7 @@ sfs_reclaim(struct inode *node) {
             sfs_block_free(sfs, ent);
         }
     }
-    kfree(sin->din);
+    kmem_cache_free(sfs_din_cachep, sin->din);
     vop_kill(node);
     return 0;
 
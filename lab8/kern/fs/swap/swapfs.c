@@ -25,3 +25,27 @@ swapfs_write(swap_entry_t entry, struct Page *page) {
     return ide_write_secs(SWAP_DEV_NO, swap_offset(entry) * PAGE_NSECT, page2kva(page), PAGE_NSECT);
 }
 
+
+// swapfs_read_pages - read the n slots from the one of entry on into pages, one command
+int
+swapfs_read_pages(swap_entry_t entry, struct Page **pages, size_t n) {
+    void *dsts[SWAPFS_MAX_PAGES];
+    size_t i;
+    assert(n <= SWAPFS_MAX_PAGES && swap_offset(entry) + n <= max_swap_offset);
+    for (i = 0; i < n; i ++) {
+        dsts[i] = page2kva(pages[i]);
+    }
+    return ide_read_secsv(SWAP_DEV_NO, swap_offset(entry) * PAGE_NSECT, dsts, n, PAGE_NSECT);
+}
+
+// swapfs_write_pages - write pages to the n slots from the one of entry on, one command
+int
+swapfs_write_pages(swap_entry_t entry, struct Page **pages, size_t n) {
+    const void *srcs[SWAPFS_MAX_PAGES];
+    size_t i;
+    assert(n <= SWAPFS_MAX_PAGES && swap_offset(entry) + n <= max_swap_offset);
+    for (i = 0; i < n; i ++) {
+        srcs[i] = page2kva(pages[i]);
+    }
+    return ide_write_secsv(SWAP_DEV_NO, swap_offset(entry) * PAGE_NSECT, srcs, n, PAGE_NSECT);
+}
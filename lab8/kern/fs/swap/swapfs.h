@@ -3,10 +3,16 @@
 
 #include <memlayout.h>
 #include <swap.h>
+#include <fs.h>
+#include <ide.h>
+
+#define SWAPFS_MAX_PAGES        (MAX_NSECS / PAGE_NSECT)    // pages one disk command transfers at most
 
 void swapfs_init(void);
 int swapfs_read(swap_entry_t entry, struct Page *page);
 int swapfs_write(swap_entry_t entry, struct Page *page);
+int swapfs_read_pages(swap_entry_t entry, struct Page **pages, size_t n);
+int swapfs_write_pages(swap_entry_t entry, struct Page **pages, size_t n);
 
 #endif /* !__KERN_FS_SWAP_SWAPFS_H__ */
 
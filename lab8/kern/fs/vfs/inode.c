@@ -7,6 +7,21 @@
 #include <error.h>
 #include <assert.h>
 #include <kmalloc.h>
+#include <slub.h>
+
+// cache of inode, sfs_inode and device are kept inside of it
+static struct kmem_cache_t *inode_cachep;
+
+/* *
+ * inode_cache_init - create the inode cache
+ * invoked by vfs_init
+ * */
+void
+inode_cache_init(void) {
+    if ((inode_cachep = kmem_cache_create("inode", sizeof(struct inode), NULL, NULL)) == NULL) {
+        panic("inode_cache_init: cannot create inode cache.\n");
+    }
+}
 
 /* *
  * __alloc_inode - alloc a inode structure and initialize in_type
@@ -14,7 +29,7 @@
 struct inode *
 __alloc_inode(int type) {
     struct inode *node;
-    if ((node = kmalloc(sizeof(struct inode))) != NULL) {
+    if ((node = kmem_cache_alloc(inode_cachep)) != NULL) {
         node->in_type = type;
     }
     return node;
@@ -40,7 +55,7 @@ void
 inode_kill(struct inode *node) {
     assert(inode_ref_count(node) == 0);
     assert(inode_open_count(node) == 0);
-    kfree(node);
+    kmem_cache_free(inode_cachep, node);
 }
 
 /* *
@@ -0,0 +1,389 @@
+#include <pmm.h>
+#include <list.h>
+#include <string.h>
+#include <stdio.h>
+#include <buddy_pmm.h>
+
+/*  The buddy pmm manager keeps a zkw segment tree (the one from lab2) over the
+ * page frame numbers [0, buddy_size), where buddy_size is npage rounded up to
+ * a power of two. Node i covers an aligned block, its children are i<<1 and
+ * i<<1|1, its parent is i>>1, and leaf ppn is node buddy_size + ppn.
+ *
+ *  buddy_tree[i] holds the order of the largest free aligned block inside node
+ * i, plus one, so 0 means "nothing free". A node is fully free when its value
+ * is its own order + 1; the parent of two fully free children is fully free,
+ * otherwise it takes the max of its children:
+ *
+ *        4                 3
+ *    3       3  alloc  2       3
+ *  2   2   2   2  ->  0   2   2   2
+ * 1 1 1 1 1 1 1 1    0 0 1 1 1 1 1 1
+ *
+ * Leaves that are not free memory (reserved pages, the tree itself, the tail
+ * above npage) stay 0 forever, so any amount of memory can be managed.
+ *
+ *  The values of a fully free (order + 1) or fully allocated (0) node are
+ * tags: the nodes below it are not updated when it gets the value, they are
+ * stale and only set from it (buddy_push) when a walk from the root goes
+ * through it. Alloc and free thus touch the nodes on one root-to-node path and
+ * their siblings, O(log N), whatever the size of the block; the children of a
+ * node with any other value are always exact.
+ *
+ *  The Page fields keep the default_pmm meaning: the head page of a free block
+ * has PG_property set and `property` is its size, every other page has
+ * PG_property cleared; allocated pages have ref 0 and no PG_property.
+ * Requests that are not a power of two are served from the next order and the
+ * tail is freed at once, so free_pages(base, n) with the same n always matches.
+ */
+
+static uint8_t *buddy_tree;     // the segment tree, buddy_size * 2 nodes
+static size_t buddy_size;       // number of leaves, a power of two >= npage
+static int buddy_order;         // log2(buddy_size), the order of the root
+static size_t buddy_nr_free;    // number of free pages
+
+#define node_page(i, order)     (pages + (((i) << (order)) - buddy_size))
+#define node_full(i, order)     (buddy_tree[(i)] == (order) + 1)
+
+static void
+buddy_init(void) {
+    buddy_tree = NULL;
+    buddy_size = buddy_nr_free = 0;
+    buddy_order = 0;
+}
+
+// buddy_push - node i (of the given order) is on a walk from the root, give the
+//            - value of a fully free or fully allocated node to its children
+static void
+buddy_push(size_t i, int order) {
+    if (buddy_tree[i] == 0 || node_full(i, order)) {
+        buddy_tree[i << 1] = buddy_tree[i << 1 | 1] = (buddy_tree[i] == 0) ? 0 : order;
+    }
+}
+
+// buddy_walk - push the values down the path from the root to node i (of the given order)
+static void
+buddy_walk(size_t i, int order) {
+    int cur;
+    for (cur = buddy_order; cur > order; cur --) {
+        buddy_push(i >> (cur - order), cur);
+    }
+}
+
+// buddy_update - recompute the ancestors of node i (of the given order)
+static void
+buddy_update(size_t i, int order) {
+    for (; (i >>= 1) > 0; order ++) {
+        size_t l = i << 1, r = i << 1 | 1;
+        if (node_full(l, order) && node_full(r, order)) {
+            // the two buddies merge, only the left head is kept
+            struct Page *right = node_page(r, order);
+            ClearPageProperty(right);
+            right->property = 0;
+            node_page(l, order)->property = (1 << (order + 1));
+            buddy_tree[i] = order + 2;
+        }
+        else {
+            buddy_tree[i] = buddy_tree[l] > buddy_tree[r] ? buddy_tree[l] : buddy_tree[r];
+        }
+    }
+}
+
+// buddy_free_block - give an aligned, allocated block of 2^order pages back to the tree
+static void
+buddy_free_block(struct Page *page, int order) {
+    size_t i = (buddy_size + page2ppn(page)) >> order;
+    buddy_walk(i, order);
+    assert(buddy_tree[i] == 0);
+    buddy_tree[i] = order + 1;
+    page->property = (1 << order);
+    SetPageProperty(page);
+    buddy_nr_free += (1 << order);
+    buddy_update(i, order);
+}
+
+// buddy_free_range - free [base, base + n) as the largest naturally aligned blocks
+static void
+buddy_free_range(struct Page *base, size_t n) {
+    while (n > 0) {
+        ppn_t ppn = page2ppn(base);
+        int order = 0;
+        while (order < buddy_order && (ppn & (1 << order)) == 0 && (2 << order) <= n) {
+            order ++;
+        }
+        buddy_free_block(base, order);
+        base += (1 << order), n -= (1 << order);
+    }
+}
+
+// buddy_init_tree - carve the segment tree out of the first free region
+static void
+buddy_init_tree(struct Page *base, size_t n) {
+    buddy_size = 1, buddy_order = 0;
+    while (buddy_size < npage) {
+        buddy_size <<= 1, buddy_order ++;
+    }
+    size_t tree_pages = ROUNDUP(buddy_size * 2, PGSIZE) / PGSIZE;
+    if (tree_pages >= n) {
+        panic("buddy_init_tree: %d pages is too small for the tree.\n", n);
+    }
+    buddy_tree = page2kva(base);
+    memset(buddy_tree, 0, buddy_size * 2);
+    cprintf("buddy init: %d pages, tree %d pages\n", buddy_size, tree_pages);
+}
+
+static void
+buddy_init_memmap(struct Page *base, size_t n) {
+    assert(n > 0);
+    if (buddy_tree == NULL) {
+        // the pages of the tree stay PG_reserved
+        size_t tree_pages;
+        buddy_init_tree(base, n);
+        tree_pages = ROUNDUP(buddy_size * 2, PGSIZE) / PGSIZE;
+        base += tree_pages, n -= tree_pages;
+    }
+    struct Page *p = base;
+    for (; p != base + n; p ++) {
+        assert(PageReserved(p));
+        p->flags = p->property = 0;
+        set_page_ref(p, 0);
+    }
+    buddy_free_range(base, n);
+}
+
+static struct Page *
+buddy_alloc_pages(size_t n) {
+    assert(n > 0);
+    if (n > buddy_nr_free) {
+        return NULL;
+    }
+    int order = 0, cur = buddy_order;
+    while ((1 << order) < n) {
+        order ++;
+    }
+    if (buddy_tree[1] < order + 1) {
+        return NULL;
+    }
+    // walk down from the root, left child first; once inside a free block,
+    // the half that is not taken becomes a free block of its own
+    size_t i = 1;
+    for (; cur > order; cur --) {
+        if (node_full(i, cur)) {
+            buddy_push(i, cur);
+            ClearPageProperty(node_page(i, cur));
+            node_page(i, cur)->property = 0;
+            i = i << 1;
+            struct Page *right = node_page(i | 1, cur - 1);
+            right->property = (1 << (cur - 1));
+            SetPageProperty(right);
+        }
+        else {
+            i = (buddy_tree[i << 1] >= order + 1) ? i << 1 : i << 1 | 1;
+        }
+    }
+    assert(node_full(i, order));
+    struct Page *page = node_page(i, order);
+    ClearPageProperty(page);
+    page->property = 0;
+    buddy_tree[i] = 0;
+    buddy_nr_free -= (1 << order);
+    buddy_update(i, order);
+    if ((1 << order) > n) {
+        buddy_free_range(page + n, (1 << order) - n);
+    }
+    return page;
+}
+
+static void
+buddy_free_pages(struct Page *base, size_t n) {
+    assert(n > 0);
+    struct Page *p = base;
+    for (; p != base + n; p ++) {
+        assert(!PageReserved(p) && !PageProperty(p));
+        p->flags = 0;
+        set_page_ref(p, 0);
+    }
+    buddy_free_range(base, n);
+}
+
+static size_t
+buddy_nr_free_pages(void) {
+    return buddy_nr_free;
+}
+
+// buddy_count_node - check the subtree of node i (of the given order) against the
+//                  - Page heads, return the number of free pages in it
+static size_t
+buddy_count_node(size_t i, int order) {
+    if (buddy_tree[i] == 0) {
+        return 0;
+    }
+    if (node_full(i, order)) {
+        // a free block head is a fully free node whose parent is not, the walk
+        // stops at it
+        struct Page *p = node_page(i, order);
+        assert(PageProperty(p) && p->property == (1 << order));
+        size_t k;
+        for (k = 0; k < (1 << order); k ++) {
+            assert(page2ppn(p + k) < npage && !PageReserved(p + k));
+        }
+        return 1 << order;
+    }
+    assert(order > 0);
+    size_t l = i << 1, r = i << 1 | 1;
+    size_t total = buddy_count_node(l, order - 1) + buddy_count_node(r, order - 1);
+    assert(!(node_full(l, order - 1) && node_full(r, order - 1)));
+    assert(buddy_tree[i] == (buddy_tree[l] > buddy_tree[r] ? buddy_tree[l] : buddy_tree[r]));
+    return total;
+}
+
+// buddy_count - check every node which is not below a tag against its children and
+//             - the Page heads, return the number of free pages in the tree
+static size_t
+buddy_count(void) {
+    return buddy_count_node(1, buddy_order);
+}
+
+// buddy_hoard - allocate every free page, largest blocks first, and chain the blocks
+//             - on hoard, their size is kept in the unused property field
+static void
+buddy_hoard(list_entry_t *hoard) {
+    list_init(hoard);
+    int order;
+    for (order = buddy_order; order >= 0; order --) {
+        struct Page *p;
+        while ((p = buddy_alloc_pages(1 << order)) != NULL) {
+            p->property = (1 << order);
+            list_add(hoard, &(p->page_link));
+        }
+    }
+    assert(buddy_nr_free == 0);
+}
+
+// buddy_unhoard - free the blocks saved by buddy_hoard
+static void
+buddy_unhoard(list_entry_t *hoard) {
+    list_entry_t *le;
+    while ((le = list_next(hoard)) != hoard) {
+        list_del(le);
+        struct Page *p = le2page(le, page_link);
+        size_t n = p->property;
+        p->property = 0;
+        buddy_free_pages(p, n);
+    }
+}
+
+static void
+basic_check(void) {
+    struct Page *p0, *p1, *p2;
+    p0 = p1 = p2 = NULL;
+    assert((p0 = alloc_page()) != NULL);
+    assert((p1 = alloc_page()) != NULL);
+    assert((p2 = alloc_page()) != NULL);
+
+    assert(p0 != p1 && p0 != p2 && p1 != p2);
+    assert(page_ref(p0) == 0 && page_ref(p1) == 0 && page_ref(p2) == 0);
+
+    assert(page2pa(p0) < npage * PGSIZE);
+    assert(page2pa(p1) < npage * PGSIZE);
+    assert(page2pa(p2) < npage * PGSIZE);
+
+    list_entry_t hoard;
+    buddy_hoard(&hoard);
+
+    assert(alloc_page() == NULL);
+
+    free_page(p0);
+    free_page(p1);
+    free_page(p2);
+    assert(buddy_nr_free == 3);
+
+    assert((p0 = alloc_page()) != NULL);
+    assert((p1 = alloc_page()) != NULL);
+    assert((p2 = alloc_page()) != NULL);
+
+    assert(alloc_page() == NULL);
+
+    free_page(p0);
+    assert(PageProperty(p0) && p0->property == 1);
+
+    struct Page *p;
+    assert((p = alloc_page()) == p0);
+    assert(alloc_page() == NULL);
+
+    assert(buddy_nr_free == 0);
+    buddy_unhoard(&hoard);
+
+    free_page(p);
+    free_page(p1);
+    free_page(p2);
+}
+
+// LAB2: below code is used to check the segment tree buddy allocation algorithm,
+// it places blocks exactly as order_pmm does, so the checks are the same
+static void
+buddy_check(void) {
+    size_t total = buddy_count();
+    assert(total == nr_free_pages());
+
+    basic_check();
+
+    struct Page *p0 = alloc_pages(8), *p1, *p2;
+    assert(p0 != NULL);
+    assert(!PageProperty(p0));
+    assert(page2ppn(p0) % 8 == 0);
+
+    list_entry_t hoard;
+    buddy_hoard(&hoard);
+    assert(alloc_page() == NULL);
+
+    // [p0+2, p0+5) is split into an order-1 and an order-0 block
+    free_pages(p0 + 2, 3);
+    assert(buddy_nr_free == 3);
+    assert(PageProperty(p0 + 2) && p0[2].property == 2);
+    assert(PageProperty(p0 + 4) && p0[4].property == 1);
+    assert(alloc_pages(4) == NULL);
+    assert((p1 = alloc_pages(2)) == p0 + 2);
+    assert((p2 = alloc_page()) == p0 + 4);
+    assert(alloc_page() == NULL);
+
+    // p0 and p0+2 are buddies of order 1, p0+4 has no free buddy
+    free_pages(p1, 2);
+    free_page(p2);
+    free_pages(p0, 2);
+    assert(PageProperty(p0) && p0->property == 4);
+    assert(!PageProperty(p0 + 2));
+    assert(PageProperty(p0 + 4) && p0[4].property == 1);
+
+    // the rest completes the buddy chain back to one order-3 block
+    free_pages(p0 + 5, 3);
+    assert(PageProperty(p0) && p0->property == 8);
+    assert(!PageProperty(p0 + 4));
+    assert(buddy_nr_free == 8);
+
+    // odd sizes are trimmed to exactly n pages
+    assert((p1 = alloc_pages(3)) == p0);
+    assert(buddy_nr_free == 5);
+    assert(PageProperty(p0 + 3) && p0[3].property == 1);
+    assert(PageProperty(p0 + 4) && p0[4].property == 4);
+    free_pages(p1, 3);
+
+    assert((p0 = alloc_pages(8)) != NULL);
+    assert(alloc_page() == NULL);
+    assert(buddy_nr_free == 0);
+
+    buddy_unhoard(&hoard);
+    free_pages(p0, 8);
+
+    assert(buddy_count() == total);
+}
+
+const struct pmm_manager buddy_pmm_manager = {
+    .name = "buddy_pmm_manager",
+    .init = buddy_init,
+    .init_memmap = buddy_init_memmap,
+    .alloc_pages = buddy_alloc_pages,
+    .free_pages = buddy_free_pages,
+    .nr_free_pages = buddy_nr_free_pages,
+    .check = buddy_check,
+};
+
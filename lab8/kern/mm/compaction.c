@@ -0,0 +1,430 @@
+#include <defs.h>
+#include <list.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+#include <error.h>
+#include <sync.h>
+#include <wait.h>
+#include <memlayout.h>
+#include <mmu.h>
+#include <pmm.h>
+#include <order_pmm.h>
+#include <vmm.h>
+#include <swap.h>
+#include <proc.h>
+#include <sched.h>
+#include <compaction.h>
+
+/* *
+ * Memory compaction
+ *
+ * A request for 2^order continuous pages (a kernel stack, a big kmalloc block,
+ * a slab of order > 0) fails when the free memory is cut into small pieces, even
+ * if there is a lot of it. Compaction builds a free block of 2^order pages again
+ * by moving the user pages that are in the way to other frames:
+ *   (1) drain the pcp, so that every free page is in a block of the pmm_manager;
+ *   (2) look at every aligned block of 2^order pages in the wanted zones, skip the
+ *       blocks with a page that can not be moved and pick the one in which the
+ *       fewest pages have to be moved;
+ *   (3) migrate every movable page of the block: copy it into a frame outside the
+ *       block, let the new frame take its place in the list of the swap manager
+ *       (pra_page_link), and map the new frame with page_insert, which frees the old
+ *       frame and invalidates the TLB entry (tlb_invalidate);
+ *   (4) give the pages back, the pmm_manager merges the block again.
+ *
+ * A page is movable if it is mapped only once (ref is 1) at page->pra_vaddr in the
+ * user part of some mm which is not locked. There is no reverse map, so the mm is
+ * found by looking at the page tables of every process and of check_mm_struct;
+ * select_block bounds how many pages it looks up so (COMPACT_SCAN_MAX).
+ *
+ * A failed multi-page allocation compacts by itself once (direct compaction, see
+ * alloc_pages_zone), and wakes up kcompactd, a kernel thread which goes on until
+ * there are COMPACT_HIGH free blocks of that order, so that the next requests
+ * do not stall.
+ * */
+
+struct compact_stat compact_stat;
+
+static bool compact_ready = 0;              // proc_list can be walked, set by kcompactd_init
+
+static wait_queue_t kcompactd_wait;
+static int kcompactd_order = -1;            // the biggest order asked for since kcompactd last looked
+static uint32_t kcompactd_zone_mask = 0;
+static volatile bool kcompactd_exit = 0;
+
+// size_order - the smallest order with 2^order >= n
+static int
+size_order(size_t n) {
+    int order = 0;
+    while ((1 << order) < n) {
+        order ++;
+    }
+    return order;
+}
+
+// page_movable - the mm of an allocated page which can be migrated, or NULL
+static struct mm_struct *
+page_movable(struct Page *page, pte_t **ptep_store) {
+    if (page_ref(page) != 1 || PageReserved(page) || PageSlab(page) || PageKmalloc(page)) {
+        return NULL;
+    }
+    struct mm_struct *mm = page_mm(page, ptep_store);
+    if (mm != NULL && mm->mm_sem.value <= 0) {
+        // somebody is working on the mm (lock_mm), leave its pages alone
+        return NULL;
+    }
+    return mm;
+}
+
+// nr_free_blocks - the number of free blocks of 2^order pages in the zones in zone_mask
+static size_t
+nr_free_blocks(int order, uint32_t zone_mask) {
+    size_t i, nr = 0;
+    for (i = 0; i < npage; i ++) {
+        struct Page *p = pages + i;
+        if (PageProperty(p)) {
+            if (zone_mask & (1 << page_zone(p))) {
+                nr += p->property >> order;
+            }
+            i += p->property - 1;
+        }
+    }
+    return nr;
+}
+
+// select_block - find the aligned block of 2^order pages in zone_mask which has some
+//              - movable pages, all others free, and the fewest movable pages. Each
+//              - page_movable walks the page tables of every process, so one call makes
+//              - at most COMPACT_SCAN_MAX of them, and the next call goes on from the
+//              - block where this one stopped.
+static struct Page *
+select_block(int order, uint32_t zone_mask, int *cost_store) {
+    static size_t scan_next = 0;                // the page of the block to look at first
+    size_t nr = (1 << order), nr_block = npage >> order, first = scan_next >> order, k, j, free_end = 0;
+    struct Page *best = NULL;
+    int best_cost = 0, budget = COMPACT_SCAN_MAX;
+    if (nr_block == 0) {
+        return NULL;
+    }
+    for (k = 0; k < nr_block && budget > 0; k ++) {
+        size_t i = ((first + k) % nr_block) << order;
+        if (i == 0) {
+            free_end = 0;
+        }
+        bool movable = ((zone_mask & (1 << page_zone(pages + i))) != 0);
+        int cost = 0;
+        if (movable) {
+            compact_stat.nr_scanned ++;
+        }
+        for (j = i; j < i + nr; j ++) {
+            struct Page *p = pages + j;
+            // free blocks start with a PG_property page, see print_zoneinfo
+            if (PageProperty(p) && j + p->property > free_end) {
+                free_end = j + p->property;
+            }
+            if (j < free_end || !movable) {
+                continue;
+            }
+            pte_t *ptep;
+            if ((best != NULL && cost + 1 >= best_cost) || budget == 0) {
+                movable = 0;
+                continue;
+            }
+            budget --;
+            if (page_movable(p, &ptep) == NULL) {
+                movable = 0;
+                continue;
+            }
+            cost ++;
+        }
+        if (movable && cost > 0) {
+            best = pages + i, best_cost = cost;
+            if (cost == 1) {
+                k ++;
+                break;
+            }
+        }
+    }
+    scan_next = ((first + k) % nr_block) << order;
+    *cost_store = best_cost;
+    return best;
+}
+
+// migrate_page - move the content and the only mapping of page into npage
+static void
+migrate_page(struct mm_struct *mm, pte_t *ptep, struct Page *page, struct Page *npage) {
+    uintptr_t la = page->pra_vaddr;
+    // the swap managers which look at PTE_A and PTE_D must see the same page after the move
+    uint32_t perm = (*ptep & (PTE_USER | PTE_A | PTE_D));
+    memcpy(page2kva(npage), page2kva(page), PGSIZE);
+    if (PageSwappable(page)) {
+        // npage takes the place of page in the list of the swap manager
+        list_add(&(page->pra_page_link), &(npage->pra_page_link));
+        list_del(&(page->pra_page_link));
+        npage->pra_age = page->pra_age;
+        if (PageActive(page)) {
+            ClearPageActive(page);
+            SetPageActive(npage);
+        }
+        ClearPageSwappable(page);
+        SetPageSwappable(npage);
+    }
+    // page_insert drops the last reference to page and invalidates the TLB entry
+    page_insert(mm->pgdir, npage, la, perm);
+    assert(page_ref(page) == 0 && npage->pra_vaddr == la);
+}
+
+// compact_block - migrate the movable pages of [base, base + 2^order) out of it
+static int
+compact_block(struct Page *base, int order) {
+    size_t nr = (1 << order), i;
+    int ret = 0;
+    // the free pages of the block we got while asking for new frames
+    list_entry_t held, *le;
+    list_init(&held);
+    for (i = 0; i < nr; i ++) {
+        struct Page *page = base + i, *npage;
+        struct mm_struct *mm;
+        pte_t *ptep;
+        if ((mm = page_movable(page, &ptep)) == NULL) {
+            continue;
+        }
+        while ((npage = alloc_page()) != NULL && base <= npage && npage < base + nr) {
+            list_add(&held, &(npage->page_link));
+        }
+        if (npage == NULL) {
+            compact_stat.nr_migrate_fail ++;
+            ret = -E_NO_MEM;
+            break;
+        }
+        // alloc_page may have reclaimed: page may be swapped out and free, or even
+        // mapped by someone else now, so it is looked up again
+        if ((mm = page_movable(page, &ptep)) == NULL) {
+            free_page(npage);
+            continue;
+        }
+        migrate_page(mm, ptep, page, npage);
+        compact_stat.nr_migrated ++;
+    }
+    while ((le = list_next(&held)) != &held) {
+        list_del(le);
+        free_page(le2page(le, page_link));
+    }
+    drain_pcp();
+    return ret;
+}
+
+// compact_pages - build one more free block of 2^order pages in the zones in zone_mask
+int
+compact_pages(int order, uint32_t zone_mask) {
+    struct Page *base;
+    int cost;
+    drain_pcp();
+    // the frames for the moved pages come from outside the block, so there must be
+    // at least 2^order free pages in total
+    if (nr_free_pages() < (1 << order) || (base = select_block(order, zone_mask, &cost)) == NULL) {
+        compact_stat.nr_fail ++;
+        return -E_NO_MEM;
+    }
+    if (compact_block(base, order) != 0) {
+        compact_stat.nr_fail ++;
+        return -E_NO_MEM;
+    }
+    compact_stat.nr_success ++;
+    return 0;
+}
+
+// try_to_compact_pages - direct compaction, called by alloc_pages_zone when it can
+//                      - not find n continuous pages, returns 0 if it may try again
+int
+try_to_compact_pages(size_t n, uint32_t zone_mask) {
+    int order = size_order(n);
+    if (!compact_ready || order >= MAX_ORDER) {
+        return -E_NO_MEM;
+    }
+    compact_stat.nr_stall ++;
+    wakeup_kcompactd(order, zone_mask);
+    drain_pcp();
+    if (nr_free_blocks(order, zone_mask) > 0) {
+        return 0;
+    }
+    return compact_pages(order, zone_mask);
+}
+
+// wakeup_kcompactd - ask kcompactd for free blocks of 2^order pages in zone_mask
+void
+wakeup_kcompactd(int order, uint32_t zone_mask) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        if (kcompactd_order < order) {
+            kcompactd_order = order;
+        }
+        kcompactd_zone_mask |= zone_mask;
+        if (!wait_queue_empty(&kcompactd_wait)) {
+            compact_stat.nr_wakeup ++;
+            wakeup_queue(&kcompactd_wait, WT_KCOMPACTD, 1);
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
+// kcompactd - the kernel thread which compacts memory in the background
+static int
+kcompactd(void *arg) {
+    while (!kcompactd_exit) {
+        int order;
+        uint32_t zone_mask;
+        bool intr_flag;
+        local_intr_save(intr_flag);
+        if ((order = kcompactd_order) < 0) {
+            wait_t __wait, *wait = &__wait;
+            wait_current_set(&kcompactd_wait, wait, WT_KCOMPACTD);
+            local_intr_restore(intr_flag);
+
+            schedule();
+
+            local_intr_save(intr_flag);
+            wait_current_del(&kcompactd_wait, wait);
+            local_intr_restore(intr_flag);
+            continue;
+        }
+        zone_mask = kcompactd_zone_mask;
+        kcompactd_order = -1, kcompactd_zone_mask = 0;
+        local_intr_restore(intr_flag);
+
+        // the new frames of the moved pages may break up another free block,
+        // so give up after COMPACT_HIGH rounds
+        int round;
+        for (round = 0; round < COMPACT_HIGH && !kcompactd_exit; round ++) {
+            if (nr_free_blocks(order, zone_mask) >= COMPACT_HIGH || compact_pages(order, zone_mask) != 0) {
+                break;
+            }
+            if (current->need_resched) {
+                schedule();
+            }
+        }
+    }
+    return 0;
+}
+
+static void check_compaction(void);
+
+// kcompactd_init - check compaction and start kcompactd as a child of current
+void
+kcompactd_init(void) {
+    wait_queue_init(&kcompactd_wait);
+    check_compaction();
+
+    int pid = kernel_thread(kcompactd, NULL, 0);
+    if (pid <= 0) {
+        panic("create kcompactd failed.\n");
+    }
+    set_proc_name(find_proc(pid), "kcompactd");
+    compact_ready = 1;
+}
+
+// kcompactd_stop - let kcompactd quit, its parent has to wait for it
+void
+kcompactd_stop(void) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        kcompactd_exit = 1;
+        if (!wait_queue_empty(&kcompactd_wait)) {
+            wakeup_queue(&kcompactd_wait, WT_KCOMPACTD, 1);
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
+void
+print_compaction(void) {
+    cprintf("compaction: %u stalls, %u kcompactd wakeups, %u succeeded, %u failed\n",
+            compact_stat.nr_stall, compact_stat.nr_wakeup, compact_stat.nr_success, compact_stat.nr_fail);
+    cprintf("  %u blocks scanned, %u pages migrated, %u pages not migrated\n",
+            compact_stat.nr_scanned, compact_stat.nr_migrated, compact_stat.nr_migrate_fail);
+}
+
+// page_free - is page in a free block of the pmm_manager?
+static bool
+page_free(struct Page *page) {
+    size_t i;
+    for (i = 0; i < npage; i ++) {
+        struct Page *p = pages + i;
+        if (PageProperty(p)) {
+            if (p <= page && page < p + p->property) {
+                return 1;
+            }
+            i += p->property - 1;
+        }
+    }
+    return 0;
+}
+
+#define CHECK_COMPACT_LA            UTEXT
+
+static void
+check_compaction(void) {
+    size_t nr_free_pages_store = nr_free_pages();
+    struct compact_stat stat_store = compact_stat;
+
+    struct mm_struct *mm = mm_create();
+    assert(mm != NULL && check_mm_struct == NULL);
+    check_mm_struct = mm;
+
+    pde_t *pgdir = mm->pgdir = boot_pgdir;
+    assert(pgdir[PDX(CHECK_COMPACT_LA)] == 0);
+
+    // a block of 4 pages whose second page is a user page, the others are free
+    struct Page *p0 = alloc_pages(4), *p1 = p0 + 1, *np;
+    assert(p0 != NULL);
+    assert(page_insert(pgdir, p1, CHECK_COMPACT_LA, PTE_U | PTE_W) == 0);
+    assert(page_ref(p1) == 1 && p1->pra_vaddr == CHECK_COMPACT_LA);
+    memset(page2kva(p1), 0x5a, PGSIZE);
+    if (swap_init_ok) {
+        swap_map_swappable(mm, CHECK_COMPACT_LA, p1, 0);
+        assert(PageSwappable(p1));
+    }
+    free_page(p0);
+    free_pages(p0 + 2, 2);
+
+    pte_t *ptep;
+    assert(page_movable(p1, &ptep) == mm);
+    *ptep |= PTE_A | PTE_D;
+    assert(compact_block(p0, 2) == 0);
+    assert(compact_stat.nr_migrated == stat_store.nr_migrated + 1);
+
+    // the user page has moved, and is the same as before
+    ptep = get_pte(pgdir, CHECK_COMPACT_LA, 0);
+    assert(ptep != NULL && (*ptep & PTE_P) && (*ptep & PTE_USER) == (PTE_U | PTE_W | PTE_P));
+    assert((*ptep & (PTE_A | PTE_D)) == (PTE_A | PTE_D));
+    np = pte2page(*ptep);
+    assert(np < p0 || np >= p0 + 4);
+    assert(page_ref(np) == 1 && np->pra_vaddr == CHECK_COMPACT_LA);
+    assert(*(uint32_t *)page2kva(np) == 0x5a5a5a5a && ((char *)page2kva(np))[PGSIZE - 1] == 0x5a);
+    if (swap_init_ok) {
+        assert(!PageSwappable(p1) && PageSwappable(np));
+        list_entry_t *le = &(np->pra_page_link);
+        assert(list_next(list_prev(le)) == le && list_prev(list_next(le)) == le);
+    }
+
+    // and the whole block is free again
+    assert(page_ref(p1) == 0);
+    assert(page_free(p0) && page_free(p0 + 1) && page_free(p0 + 2) && page_free(p0 + 3));
+
+    page_remove(pgdir, CHECK_COMPACT_LA);
+    free_page(pde2page(pgdir[PDX(CHECK_COMPACT_LA)]));
+    pgdir[PDX(CHECK_COMPACT_LA)] = 0;
+
+    mm->pgdir = NULL;
+    mm_destroy(mm);
+    check_mm_struct = NULL;
+
+    assert(nr_free_pages_store == nr_free_pages());
+    compact_stat = stat_store;
+
+    cprintf("check_compaction() succeeded!\n");
+}
+
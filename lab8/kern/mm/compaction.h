@@ -0,0 +1,32 @@
+#ifndef __KERN_MM_COMPACTION_H__
+#define __KERN_MM_COMPACTION_H__
+
+#include <defs.h>
+
+#define COMPACT_HIGH            2       // kcompactd stops when there are so many free blocks of the order
+#define COMPACT_SCAN_MAX        256     // pages select_block looks up the mm of at most
+
+// counters of memory compaction, printed by print_compaction
+struct compact_stat {
+    size_t nr_stall;                    // failed multi-page allocations that compacted by themselves
+    size_t nr_wakeup;                   // times kcompactd was woken up
+    size_t nr_success;                  // compactions that freed a block
+    size_t nr_fail;                     // compactions that could not free a block
+    size_t nr_scanned;                  // blocks looked at
+    size_t nr_migrated;                 // user pages moved to another frame
+    size_t nr_migrate_fail;             // user pages that could not be moved
+};
+
+extern struct compact_stat compact_stat;
+
+int compact_pages(int order, uint32_t zone_mask);
+int try_to_compact_pages(size_t n, uint32_t zone_mask);
+
+void kcompactd_init(void);
+void kcompactd_stop(void);
+void wakeup_kcompactd(int order, uint32_t zone_mask);
+
+void print_compaction(void);
+
+#endif /* !__KERN_MM_COMPACTION_H__ */
+
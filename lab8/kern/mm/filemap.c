@@ -0,0 +1,193 @@
+#include <defs.h>
+#include <list.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <error.h>
+#include <stat.h>
+#include <mmu.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <kmalloc.h>
+#include <inode.h>
+#include <iobuf.h>
+#include <filemap.h>
+
+/* *
+ * Pages of shared file mappings (mmap with MMAP_SHARED)
+ *
+ * Every mm which maps page index of a file shared has to see the same frame, so
+ * the frames are kept in a hash table keyed by (inode, index) as long as some pte
+ * maps them. An entry holds a reference to its page and to the inode; the page is
+ * read from the file on the first fault and mapped by every later one.
+ *
+ * A write sets PTE_D in the pte of the writer; filemap_sync writes the dirty pages
+ * of a range back with vop_write (sfs_io_nolock for SFS) and clears PTE_D. It runs
+ * on msync, and on munmap and exit before the ptes go away. After that
+ * filemap_release drops the entries no pte maps any more (page ref is 1).
+ * */
+
+struct filemap_entry {
+    struct inode *node;
+    uint32_t index;                     // the page of the file, offset / PGSIZE
+    struct Page *page;
+    list_entry_t hash_link;
+};
+
+#define le2fe(le, member)                   \
+    to_struct((le), struct filemap_entry, member)
+
+#define FILEMAP_HASH_SIZE       (1 << FILEMAP_HASH_SHIFT)
+
+static list_entry_t filemap_hash[FILEMAP_HASH_SIZE];
+
+#define filemap_bucket(node, index)         \
+    (filemap_hash + hash32((uint32_t)(node) ^ (index), FILEMAP_HASH_SHIFT))
+
+void
+filemap_init(void) {
+    int i;
+    for (i = 0; i < FILEMAP_HASH_SIZE; i ++) {
+        list_init(filemap_hash + i);
+    }
+}
+
+static struct filemap_entry *
+filemap_lookup(struct inode *node, uint32_t index) {
+    list_entry_t *list = filemap_bucket(node, index), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct filemap_entry *fe = le2fe(le, hash_link);
+        if (fe->node == node && fe->index == index) {
+            return fe;
+        }
+    }
+    return NULL;
+}
+
+// vma_file_index - the page of the file vma maps at addr
+static inline uint32_t
+vma_file_index(struct vma_struct *vma, uintptr_t addr) {
+    return (vma->vm_file_off + (addr - vma->vm_file_start)) / PGSIZE;
+}
+
+// filemap_fault - map the shared page of the file at addr of vma, reading it from
+//               - the file if no one maps it yet
+int
+filemap_fault(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr, uint32_t perm) {
+    struct inode *node = vma->vm_file;
+    uint32_t index = vma_file_index(vma, addr);
+    struct filemap_entry *fe;
+    int ret;
+
+    assert(node != NULL && (vma->vm_flags & VM_SHARE) && addr % PGSIZE == 0);
+    if ((fe = filemap_lookup(node, index)) == NULL) {
+        struct Page *page;
+        if ((page = alloc_page()) == NULL) {
+            return -E_NO_MEM;
+        }
+        // the part beyond the end of the file reads as zero
+        memset(page2kva(page), 0, PGSIZE);
+        struct iobuf __iob, *iob = iobuf_init(&__iob, page2kva(page), PGSIZE, index * PGSIZE);
+        if ((ret = vop_read(node, iob)) != 0) {
+            free_page(page);
+            return ret;
+        }
+        // vop_read may have slept, and another thread of mm may have unmapped addr,
+        // and maybe released node: the access faults again, on whatever is there now
+        struct vma_struct *nvma = find_vma(mm, addr);
+        if (nvma != vma || vma->vm_start > addr) {
+            free_page(page);
+            return 0;
+        }
+        // someone else may have read the page meanwhile
+        if ((fe = filemap_lookup(node, index)) != NULL) {
+            free_page(page);
+        }
+        else {
+            if ((fe = kmalloc(sizeof(struct filemap_entry))) == NULL) {
+                free_page(page);
+                return -E_NO_MEM;
+            }
+            vop_ref_inc(node);
+            fe->node = node, fe->index = index, fe->page = page;
+            page_ref_inc(page);
+            list_add(filemap_bucket(node, index), &(fe->hash_link));
+        }
+    }
+    return page_insert(mm->pgdir, fe->page, addr, perm);
+}
+
+// filemap_map_resident - map the shared page of the file at addr of vma if someone
+//                      - has it already, never read the file; for fault-around
+bool
+filemap_map_resident(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr, uint32_t perm) {
+    struct filemap_entry *fe;
+    assert(vma->vm_file != NULL && (vma->vm_flags & VM_SHARE) && addr % PGSIZE == 0);
+    if ((fe = filemap_lookup(vma->vm_file, vma_file_index(vma, addr))) == NULL) {
+        return 0;
+    }
+    return page_insert(mm->pgdir, fe->page, addr, perm) == 0;
+}
+
+// filemap_sync - write the pages of [start, end) of a shared file vma which were
+//              - written through mm back to the file
+int
+filemap_sync(struct mm_struct *mm, struct vma_struct *vma, uintptr_t start, uintptr_t end) {
+    struct inode *node = vma->vm_file;
+    struct stat __stat, *stat = &__stat;
+    int ret;
+
+    assert(node != NULL && (vma->vm_flags & VM_SHARE));
+    if ((ret = vop_fstat(node, stat)) != 0) {
+        return ret;
+    }
+    struct tlb_gather tlb;
+    tlb_gather_init(&tlb, mm->pgdir);
+    for (; start < end; start += PGSIZE) {
+        pte_t *ptep = get_pte(mm->pgdir, start, 0);
+        if (ptep == NULL) {
+            start = ROUNDDOWN(start + PTSIZE, PTSIZE) - PGSIZE;
+            continue;
+        }
+        if ((*ptep & (PTE_P | PTE_D)) != (PTE_P | PTE_D)) {
+            continue;
+        }
+        // like write through the file the mapping may not make it longer
+        off_t offset = vma_file_index(vma, start) * PGSIZE;
+        if (offset < stat->st_size) {
+            size_t len = stat->st_size - offset;
+            if (len > PGSIZE) {
+                len = PGSIZE;
+            }
+            struct iobuf __iob, *iob = iobuf_init(&__iob, page2kva(pte2page(*ptep)), len, offset);
+            if ((ret = vop_write(node, iob)) != 0) {
+                break;
+            }
+        }
+        *ptep &= ~PTE_D;
+        tlb_gather_add(&tlb, start);
+    }
+    tlb_finish(&tlb);
+    return ret;
+}
+
+// filemap_release - free the shared pages of node which are not mapped any more
+void
+filemap_release(struct inode *node) {
+    int i;
+    for (i = 0; i < FILEMAP_HASH_SIZE; i ++) {
+        list_entry_t *list = filemap_hash + i, *le = list_next(list);
+        while (le != list) {
+            struct filemap_entry *fe = le2fe(le, hash_link);
+            le = list_next(le);
+            if (fe->node == node && page_ref(fe->page) == 1) {
+                list_del(&(fe->hash_link));
+                page_ref_dec(fe->page);
+                free_page(fe->page);
+                vop_ref_dec(node);
+                kfree(fe);
+            }
+        }
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef __KERN_MM_FILEMAP_H__
+#define __KERN_MM_FILEMAP_H__
+
+#include <defs.h>
+#include <vmm.h>
+
+#define FILEMAP_HASH_SHIFT      6
+
+void filemap_init(void);
+int filemap_fault(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr, uint32_t perm);
+bool filemap_map_resident(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr, uint32_t perm);
+int filemap_sync(struct mm_struct *mm, struct vma_struct *vma, uintptr_t start, uintptr_t end);
+void filemap_release(struct inode *node);
+
+#endif /* !__KERN_MM_FILEMAP_H__ */
@@ -6,300 +6,423 @@
 #include <sync.h>
 #include <pmm.h>
 #include <stdio.h>
+#include <slub.h>
+#include <x86.h>
+#include <kmstat.h>
+#include <kdebug.h>
+#include <string.h>
+#include <stdlib.h>
 
 /*
- * SLOB Allocator: Simple List Of Blocks
+ * kmalloc on top of the slub kmem caches (kern/mm/slub.c)
  *
- * Matt Mackall <mpm@selenic.com> 12/30/03
+ * Requests of up to SIZED_CACHE_MAX bytes are served by one of the sized
+ * caches (16, 32, ..., 2048 bytes), so kmalloc and kfree are O(1): kfree
+ * finds the cache of a block from the PG_slab mark of its page. Both of them
+ * are normally served by the per-CPU magazines of the cache without touching
+ * the slabs or disabling interrupts.
  *
- * How SLOB works:
+ * Larger requests call alloc_pages directly so that they get page-aligned
+ * blocks. The head page of such a big block is marked PG_kmalloc and keeps
+ * the order of the block in property, so kfree and ksize of big blocks are
+ * O(1) as well.
  *
- * The core of SLOB is a traditional K&R style heap allocator, with
- * support for returning aligned objects. The granularity of this
- * allocator is 8 bytes on x86, though it's perhaps possible to reduce
- * this to 4 if it's deemed worth the effort. The slob heap is a
- * singly-linked list of pages from __get_free_page, grown on demand
- * and allocation from the heap is currently first-fit.
- *
- * Above this is an implementation of kmalloc/kfree. Blocks returned
- * from kmalloc are 8-byte aligned and prepended with a 8-byte header.
- * If kmalloc is asked for objects of PAGE_SIZE or larger, it calls
- * __get_free_pages directly so that it can return page-aligned blocks
- * and keeps a linked list of such pages and their orders. These
- * objects are detected in kfree() by their page alignment.
- *
- * SLAB is emulated on top of SLOB by simply calling constructors and
- * destructors for every SLAB allocation. Objects are returned with
- * the 8-byte alignment unless the SLAB_MUST_HWCACHE_ALIGN flag is
- * set, in which case the low-level allocator will fragment blocks to
- * create the proper alignment. Again, objects of page-size or greater
- * are allocated by calling __get_free_pages. As SLAB objects know
- * their size, no separate size bookkeeping is necessary and there is
- * essentially no allocation space overhead.
+ * Every kmalloc/kfree is accounted by size class (see libs/kmstat.h), the
+ * sized classes reuse the counters of their cache. Building with
+ * KMALLOC_CALLSITES=1 also keeps a table of the blocks in use per caller.
  */
 
 
 //some helper
-#define spin_lock_irqsave(l, f) local_intr_save(f)
-#define spin_unlock_irqrestore(l, f) local_intr_restore(f)
 typedef unsigned int gfp_t;
 #ifndef PAGE_SIZE
 #define PAGE_SIZE PGSIZE
 #endif
 
-#ifndef L1_CACHE_BYTES
-#define L1_CACHE_BYTES 64
-#endif
-
-#ifndef ALIGN
-#define ALIGN(addr,size)   (((addr)+(size)-1)&(~((size)-1))) 
-#endif
-
+// The number of sized cache : 16, 32, 64, 128, 256, 512, 1024, 2048
+#define SIZED_CACHE_NUM     8
+#define SIZED_CACHE_MIN     16
+#define SIZED_CACHE_MAX     2048
 
-struct slob_block {
-	int units;
-	struct slob_block *next;
+static struct kmem_cache_t *sized_caches[SIZED_CACHE_NUM];
+static const char *sized_cache_names[SIZED_CACHE_NUM] = {
+    "size-16", "size-32", "size-64", "size-128",
+    "size-256", "size-512", "size-1024", "size-2048",
 };
-typedef struct slob_block slob_t;
 
-#define SLOB_UNIT sizeof(slob_t)
-#define SLOB_UNITS(size) (((size) + SLOB_UNIT - 1)/SLOB_UNIT)
-#define SLOB_ALIGN L1_CACHE_BYTES
-
-struct bigblock {
-	int order;
-	void *pages;
-	struct bigblock *next;
+// accounting of kmalloc as a whole and of big blocks, see kmalloc_stat
+static size_t kmalloc_bytes, kmalloc_peak_bytes, kmalloc_nr_alloc, kmalloc_nr_free;
+static size_t bigblock_objects, bigblock_bytes, bigblock_peak_bytes, bigblock_nr_alloc;
+
+#ifdef KMALLOC_CALLSITES
+// blocks in use per caller: every block is looked up by address in a hash of
+// track entries that point to the site of its caller. Blocks that find no free
+// track entry or site are only counted in untracked.
+#define KMALLOC_SITE_MAX        64
+#define KMALLOC_TRACK_MAX       2048
+#define KMALLOC_TRACK_SHIFT     8
+
+struct kmalloc_site {
+    uintptr_t caller;       // return address of the kmalloc call
+    size_t objects;         // blocks in use
+    size_t bytes;           // bytes in use
+    size_t nr_alloc;        // number of kmalloc calls
 };
-typedef struct bigblock bigblock_t;
-
-static slob_t arena = { .next = &arena, .units = 1 };
-static slob_t *slobfree = &arena;
-static bigblock_t *bigblocks;
 
+struct kmalloc_track {
+    void *block;
+    int16_t site;           // index in kmalloc_sites
+    int16_t next;           // index + 1 of the next entry in the hash chain or free list
+};
 
-static void* __slob_get_free_pages(gfp_t gfp, int order)
-{
-  struct Page * page = alloc_pages(1 << order);
-  if(!page)
-    return NULL;
-  return page2kva(page);
+static struct kmalloc_site kmalloc_sites[KMALLOC_SITE_MAX];
+static int kmalloc_nsites;
+static struct kmalloc_track kmalloc_tracks[KMALLOC_TRACK_MAX];
+static int kmalloc_ntracks;
+static int16_t kmalloc_track_free;
+static int16_t kmalloc_track_hash[1 << KMALLOC_TRACK_SHIFT];
+static size_t kmalloc_untracked;
+
+static void
+kmalloc_track_alloc(void *block, uintptr_t caller, size_t bytes) {
+    struct kmalloc_site *site;
+    int i, t;
+    for (i = 0; i < kmalloc_nsites; i ++) {
+        if (kmalloc_sites[i].caller == caller)
+            break;
+    }
+    if (i == kmalloc_nsites) {
+        if (i == KMALLOC_SITE_MAX)
+            goto untracked;
+        kmalloc_sites[kmalloc_nsites ++].caller = caller;
+    }
+    if ((t = kmalloc_track_free) != 0)
+        kmalloc_track_free = kmalloc_tracks[t - 1].next;
+    else if (kmalloc_ntracks < KMALLOC_TRACK_MAX)
+        t = ++ kmalloc_ntracks;
+    else
+        goto untracked;
+    site = kmalloc_sites + i;
+    site->objects ++, site->bytes += bytes, site->nr_alloc ++;
+    uint32_t h = hash32((uint32_t)block, KMALLOC_TRACK_SHIFT);
+    kmalloc_tracks[t - 1].block = block;
+    kmalloc_tracks[t - 1].site = i;
+    kmalloc_tracks[t - 1].next = kmalloc_track_hash[h];
+    kmalloc_track_hash[h] = t;
+    return;
+
+untracked:
+    kmalloc_untracked ++;
 }
 
-#define __slob_get_free_page(gfp) __slob_get_free_pages(gfp, 0)
-
-static inline void __slob_free_pages(unsigned long kva, int order)
-{
-  free_pages(kva2page(kva), 1 << order);
+static void
+kmalloc_track_free_block(void *block, size_t bytes) {
+    int16_t *link = &kmalloc_track_hash[hash32((uint32_t)block, KMALLOC_TRACK_SHIFT)];
+    int t;
+    while ((t = *link) != 0) {
+        struct kmalloc_track *track = kmalloc_tracks + t - 1;
+        if (track->block == block) {
+            kmalloc_sites[track->site].objects --;
+            kmalloc_sites[track->site].bytes -= bytes;
+            *link = track->next;
+            track->next = kmalloc_track_free;
+            kmalloc_track_free = t;
+            return;
+        }
+        link = &(track->next);
+    }
+    kmalloc_untracked --;
 }
 
-static void slob_free(void *b, int size);
-
-static void *slob_alloc(size_t size, gfp_t gfp, int align)
-{
-  assert( (size + SLOB_UNIT) < PAGE_SIZE );
-
-	slob_t *prev, *cur, *aligned = 0;
-	int delta = 0, units = SLOB_UNITS(size);
-	unsigned long flags;
-
-	spin_lock_irqsave(&slob_lock, flags);
-	prev = slobfree;
-	for (cur = prev->next; ; prev = cur, cur = cur->next) {
-		if (align) {
-			aligned = (slob_t *)ALIGN((unsigned long)cur, align);
-			delta = aligned - cur;
-		}
-		if (cur->units >= units + delta) { /* room enough? */
-			if (delta) { /* need to fragment head to align? */
-				aligned->units = cur->units - delta;
-				aligned->next = cur->next;
-				cur->next = aligned;
-				cur->units = delta;
-				prev = cur;
-				cur = aligned;
-			}
-
-			if (cur->units == units) /* exact fit? */
-				prev->next = cur->next; /* unlink */
-			else { /* fragment */
-				prev->next = cur + units;
-				prev->next->units = cur->units - units;
-				prev->next->next = cur->next;
-				cur->units = units;
-			}
-
-			slobfree = prev;
-			spin_unlock_irqrestore(&slob_lock, flags);
-			return cur;
-		}
-		if (cur == slobfree) {
-			spin_unlock_irqrestore(&slob_lock, flags);
-
-			if (size == PAGE_SIZE) /* trying to shrink arena? */
-				return 0;
-
-			cur = (slob_t *)__slob_get_free_page(gfp);
-			if (!cur)
-				return 0;
-
-			slob_free(cur, PAGE_SIZE);
-			spin_lock_irqsave(&slob_lock, flags);
-			cur = slobfree;
-		}
-	}
+static void
+kmalloc_dump_sites(void) {
+    int i;
+    cprintf("kmalloc call sites (%u blocks untracked):\n", kmalloc_untracked);
+    for (i = 0; i < kmalloc_nsites; i ++) {
+        struct kmalloc_site *site = kmalloc_sites + i;
+        if (site->objects != 0) {
+            cprintf("  %08x %8u objects %10u bytes %10u allocs\n", site->caller, site->objects, site->bytes, site->nr_alloc);
+            print_debuginfo(site->caller - 1);
+        }
+    }
+}
+#endif /* KMALLOC_CALLSITES */
+
+// kmalloc_account - account for a block of bytes handed out (bytes > 0) or given back
+static inline void
+kmalloc_account(int bytes) {
+    kmalloc_bytes += bytes;
+    if (bytes > 0) {
+        kmalloc_nr_alloc ++;
+        if (kmalloc_bytes > kmalloc_peak_bytes)
+            kmalloc_peak_bytes = kmalloc_bytes;
+    }
+    else {
+        kmalloc_nr_free ++;
+    }
 }
 
-static void slob_free(void *block, int size)
-{
-	slob_t *cur, *b = (slob_t *)block;
-	unsigned long flags;
-
-	if (!block)
-		return;
-
-	if (size)
-		b->units = SLOB_UNITS(size);
-
-	/* Find reinsertion point */
-	spin_lock_irqsave(&slob_lock, flags);
-	for (cur = slobfree; !(b > cur && b < cur->next); cur = cur->next)
-		if (cur >= cur->next && (b > cur || b < cur->next))
-			break;
-
-	if (b + b->units == cur->next) {
-		b->units += cur->next->units;
-		b->next = cur->next->next;
-	} else
-		b->next = cur->next;
-
-	if (cur + cur->units == b) {
-		cur->units += b->units;
-		cur->next = b->next;
-	} else
-		cur->next = b;
-
-	slobfree = cur;
 
-	spin_unlock_irqrestore(&slob_lock, flags);
+static int
+kmalloc_sized_index(size_t size) {
+    int index = 0;
+    while ((SIZED_CACHE_MIN << index) < size)
+        index ++;
+    return index;
 }
 
+static void
+check_kmalloc(void) {
+    size_t fp = nr_free_pages(), allocated = kallocated();
+    void *p0, *p1, *p2;
+    int i;
+
+    // sized caches are picked by size and kfree finds them back
+    for (i = 0; i < SIZED_CACHE_NUM; i ++) {
+        size_t size = (SIZED_CACHE_MIN << i);
+        assert((p0 = kmalloc(size)) != NULL);
+        assert(kmem_cache_of(p0) == sized_caches[i]);
+        assert(ksize(p0) == size);
+        kfree(p0);
+    }
+    assert(kallocated() == allocated);
+    assert((p0 = kmalloc(1)) != NULL && ksize(p0) == SIZED_CACHE_MIN);
+    assert((p1 = kmalloc(SIZED_CACHE_MIN + 1)) != NULL && ksize(p1) == SIZED_CACHE_MIN * 2);
+    assert(kallocated() == allocated + SIZED_CACHE_MIN * 3);
+    // big blocks are page aligned
+    assert((p2 = kmalloc(SIZED_CACHE_MAX + 1)) != NULL && ksize(p2) == PGSIZE);
+    assert(((uintptr_t)p2 & (PGSIZE - 1)) == 0 && !PageSlab(kva2page(p2)));
+    kfree(p2);
+    assert((p2 = kmalloc(PGSIZE * 3)) != NULL && ksize(p2) == PGSIZE * 4);
+    assert(kallocated() == allocated + SIZED_CACHE_MIN * 3 + PGSIZE * 4);
+    assert(PageKmalloc(kva2page(p2)) && ksize((char *)p2 + PGSIZE) == 0);
+    kfree(p2), kfree(p1), kfree(p0);
+    assert(kallocated() == allocated);
+
+    kmem_cache_reap();
+    assert(nr_free_pages() == fp);
+
+    cprintf("check_kmalloc() succeeded!\n");
+}
 
+#define BENCH_ROUNDS        4096
+#define BENCH_BURST         64
+#define BENCH_SIZE          32
+
+// bench_kmalloc_run - kmalloc(BENCH_SIZE)/kfree as back-to-back pairs and as
+//                   - bursts of BENCH_BURST, which cycle magazines through the depot
+static void
+bench_kmalloc_run(const char *layer) {
+    void *burst[BENCH_BURST];
+    uint64_t start, cycles;
+    int i, j;
+
+    start = rdtsc();
+    for (i = 0; i < BENCH_ROUNDS; i ++) {
+        void *p = kmalloc(BENCH_SIZE);
+        assert(p != NULL);
+        kfree(p);
+    }
+    cycles = rdtsc() - start;
+    do_div(cycles, BENCH_ROUNDS);
+    cprintf("bench_kmalloc: %s, kmalloc(%d)+kfree pair: %u cycles\n", layer, BENCH_SIZE, (unsigned int)cycles);
+
+    start = rdtsc();
+    for (i = 0; i < BENCH_ROUNDS / BENCH_BURST; i ++) {
+        for (j = 0; j < BENCH_BURST; j ++) {
+            assert((burst[j] = kmalloc(BENCH_SIZE)) != NULL);
+        }
+        for (j = 0; j < BENCH_BURST; j ++) {
+            kfree(burst[j]);
+        }
+    }
+    cycles = rdtsc() - start;
+    do_div(cycles, BENCH_ROUNDS);
+    cprintf("bench_kmalloc: %s, burst of %d: %u cycles per kmalloc+kfree\n", layer, BENCH_BURST, (unsigned int)cycles);
+}
 
-void
-slob_init(void) {
-  cprintf("use SLOB allocator\n");
+// bench_kmalloc - compare the magazine fast path with going to the slabs every time
+static void
+bench_kmalloc(void) {
+    struct kmem_cache_t *cachep = sized_caches[kmalloc_sized_index(BENCH_SIZE)];
+    bench_kmalloc_run("magazine");
+    kmem_cache_shrink(cachep);
+    cachep->flags |= KMEM_CACHE_NOMAG;
+    bench_kmalloc_run("slab");
+    cachep->flags &= ~KMEM_CACHE_NOMAG;
+    kmem_cache_reap();
 }
 
-inline void 
+void
 kmalloc_init(void) {
-    slob_init();
+    int i;
+    kmem_cache_init();
+    // 初始化8个固定大小的内置cache
+    for (i = 0; i < SIZED_CACHE_NUM; i ++) {
+        if ((sized_caches[i] = kmem_cache_create(sized_cache_names[i], SIZED_CACHE_MIN << i, NULL, NULL)) == NULL) {
+            panic("kmalloc_init: cannot create %s.\n", sized_cache_names[i]);
+        }
+    }
+    check_kmalloc();
+    bench_kmalloc();
     cprintf("kmalloc_init() succeeded!\n");
 }
 
 size_t
-slob_allocated(void) {
-  return 0;
+kallocated(void) {
+    return kmalloc_bytes;
 }
 
-size_t
-kallocated(void) {
-   return slob_allocated();
+// kmalloc_stat - fill st with the accounting of every size class
+void
+kmalloc_stat(struct kmstat *st) {
+    int i;
+    memset(st, 0, sizeof(struct kmstat));
+    st->bytes = kmalloc_bytes, st->peak_bytes = kmalloc_peak_bytes;
+    st->nr_alloc = kmalloc_nr_alloc, st->nr_free = kmalloc_nr_free;
+    for (i = 0; i < SIZED_CACHE_NUM; i ++) {
+        struct kmem_cache_t *cachep = sized_caches[i];
+        struct kmclass_stat *cs = st->classes + i;
+        cs->size = kmem_cache_size(cachep);
+        cs->objects = cachep->objects;
+        cs->bytes = cachep->objects * cs->size;
+        cs->peak_bytes = cachep->peak_objects * cs->size;
+        cs->nr_alloc = cachep->nr_alloc;
+    }
+    struct kmclass_stat *cs = st->classes + SIZED_CACHE_NUM;
+    cs->objects = bigblock_objects, cs->bytes = bigblock_bytes;
+    cs->peak_bytes = bigblock_peak_bytes, cs->nr_alloc = bigblock_nr_alloc;
+}
+
+// kmalloc_dump - print the accounting of kmalloc, its call sites and every kmem cache
+void
+kmalloc_dump(void) {
+    struct kmstat st;
+    int i;
+    kmalloc_stat(&st);
+    cprintf("kmalloc: %u bytes in use, peak %u bytes, %u kmalloc, %u kfree\n",
+            st.bytes, st.peak_bytes, st.nr_alloc, st.nr_free);
+    cprintf("  %6s %8s %10s %10s %10s\n", "class", "objects", "bytes", "peak", "allocs");
+    for (i = 0; i < KMSTAT_NCLASS; i ++) {
+        struct kmclass_stat *cs = st.classes + i;
+        if (cs->size != 0)
+            cprintf("  %6u ", cs->size);
+        else
+            cprintf("  %6s ", "big");
+        cprintf("%8u %10u %10u %10u\n", cs->objects, cs->bytes, cs->peak_bytes, cs->nr_alloc);
+    }
+#ifdef KMALLOC_CALLSITES
+    kmalloc_dump_sites();
+#endif
+    kmem_cache_dump();
 }
 
-static int find_order(int size)
+// find_order - the smallest order whose block holds size bytes, size is at most
+//            - PAGE_SIZE << KMALLOC_MAX_ORDER (see __kmalloc)
+static int find_order(size_t size)
 {
 	int order = 0;
-	for ( ; size > 4096 ; size >>=1)
+	for ( ; size > (PAGE_SIZE << order) ; )
 		order++;
 	return order;
 }
 
 static void *__kmalloc(size_t size, gfp_t gfp)
 {
-	slob_t *m;
-	bigblock_t *bb;
-	unsigned long flags;
+	struct Page *page;
+	int order;
 
-	if (size < PAGE_SIZE - SLOB_UNIT) {
-		m = slob_alloc(size + SLOB_UNIT, gfp, 0);
-		return m ? (void *)(m + 1) : 0;
+	if (size <= SIZED_CACHE_MAX) {
+		return kmem_cache_alloc(sized_caches[kmalloc_sized_index(size)]);
 	}
-
-	bb = slob_alloc(sizeof(bigblock_t), gfp, 0);
-	if (!bb)
+	if (size > (PAGE_SIZE << KMALLOC_MAX_ORDER))
 		return 0;
 
-	bb->order = find_order(size);
-	bb->pages = (void *)__slob_get_free_pages(gfp, bb->order);
-
-	if (bb->pages) {
-		spin_lock_irqsave(&block_lock, flags);
-		bb->next = bigblocks;
-		bigblocks = bb;
-		spin_unlock_irqrestore(&block_lock, flags);
-		return bb->pages;
-	}
+	order = find_order(size);
+	if ((page = alloc_pages(1 << order)) == NULL)
+		return 0;
 
-	slob_free(bb, sizeof(bigblock_t));
-	return 0;
+	SetPageKmalloc(page);
+	page->property = order;
+	bigblock_objects ++, bigblock_nr_alloc ++;
+	if ((bigblock_bytes += PAGE_SIZE << order) > bigblock_peak_bytes)
+		bigblock_peak_bytes = bigblock_bytes;
+	return page2kva(page);
 }
 
 void *
 kmalloc(size_t size)
 {
-  return __kmalloc(size, 0);
+  void *block = __kmalloc(size, 0);
+  if (block != NULL) {
+    size_t bytes = ksize(block);
+    kmalloc_account(bytes);
+#ifdef KMALLOC_CALLSITES
+    kmalloc_track_alloc(block, (uintptr_t)__builtin_return_address(0), bytes);
+#endif
+  }
+  return block;
 }
 
 
+static inline void
+kfree_account(void *block, size_t bytes) {
+    kmalloc_account(-(int)bytes);
+#ifdef KMALLOC_CALLSITES
+    kmalloc_track_free_block(block, bytes);
+#endif
+}
+
+// bigblock_page - the head page of the big block at block, or NULL if there is none
+static inline struct Page *
+bigblock_page(const void *block)
+{
+	struct Page *page = kva2page((void *)block);
+	if (PageKmalloc(page) && page2kva(page) == block)
+		return page;
+	return NULL;
+}
+
 void kfree(void *block)
 {
-	bigblock_t *bb, **last = &bigblocks;
-	unsigned long flags;
+	struct Page *page;
+	int order;
 
 	if (!block)
 		return;
 
-	if (!((unsigned long)block & (PAGE_SIZE-1))) {
-		/* might be on the big block list */
-		spin_lock_irqsave(&block_lock, flags);
-		for (bb = bigblocks; bb; last = &bb->next, bb = bb->next) {
-			if (bb->pages == block) {
-				*last = bb->next;
-				spin_unlock_irqrestore(&block_lock, flags);
-				__slob_free_pages((unsigned long)block, bb->order);
-				slob_free(bb, sizeof(bigblock_t));
-				return;
-			}
-		}
-		spin_unlock_irqrestore(&block_lock, flags);
+	if (PageSlab(kva2page(block))) {
+		struct kmem_cache_t *cachep = kmem_cache_of(block);
+		kfree_account(block, kmem_cache_size(cachep));
+		kmem_cache_free(cachep, block);
+		return;
 	}
 
-	slob_free((slob_t *)block - 1, 0);
-	return;
+	if ((page = bigblock_page(block)) == NULL)
+		panic("kfree: %08x is not allocated by kmalloc.\n", block);
+
+	order = page->property;
+	ClearPageKmalloc(page);
+	page->property = 0;
+	bigblock_objects --, bigblock_bytes -= PAGE_SIZE << order;
+	kfree_account(block, PAGE_SIZE << order);
+	free_pages(page, 1 << order);
 }
 
 
 unsigned int ksize(const void *block)
 {
-	bigblock_t *bb;
-	unsigned long flags;
+	struct Page *page;
 
 	if (!block)
 		return 0;
 
-	if (!((unsigned long)block & (PAGE_SIZE-1))) {
-		spin_lock_irqsave(&block_lock, flags);
-		for (bb = bigblocks; bb; bb = bb->next)
-			if (bb->pages == block) {
-				spin_unlock_irqrestore(&slob_lock, flags);
-				return PAGE_SIZE << bb->order;
-			}
-		spin_unlock_irqrestore(&block_lock, flags);
-	}
-
-	return ((slob_t *)block - 1)->units * SLOB_UNIT;
-}
+	if (PageSlab(kva2page((void *)block)))
+		return kmem_cache_size(kmem_cache_of((void *)block));
 
+	if ((page = bigblock_page(block)) != NULL)
+		return PAGE_SIZE << page->property;
 
+	return 0;
+}
 
@@ -9,8 +9,13 @@ void kmalloc_init(void);
 
 void *kmalloc(size_t n);
 void kfree(void *objp);
+unsigned int ksize(const void *objp);
 
 size_t kallocated(void);
 
+struct kmstat;
+void kmalloc_stat(struct kmstat *st);
+void kmalloc_dump(void);
+
 #endif /* !__KERN_MM_KMALLOC_H__ */
 
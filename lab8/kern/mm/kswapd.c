@@ -0,0 +1,155 @@
+#include <defs.h>
+#include <x86.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <sync.h>
+#include <wait.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <swap.h>
+#include <swap_cache.h>
+#include <proc.h>
+#include <sched.h>
+#include <kswapd.h>
+
+/* *
+ * Page reclaim
+ *
+ * An allocation of a single page which finds no free page has to swap a page out
+ * before it can go on (direct reclaim, see alloc_pages_zone): the process stalls
+ * for the disk write. kswapd is a kernel thread which swaps pages out ahead of
+ * time instead: it is woken up when an allocation leaves fewer than KSWAPD_LOW
+ * pages free, and swaps out until KSWAPD_HIGH pages are free again, so that the
+ * allocations in between find a free page at once. Direct reclaim stays as the
+ * last resort when kswapd can not keep up.
+ *
+ * The victims are picked by the swap manager among the pages of every mm, see
+ * swap_out. Build with KSWAPD=0 to compare the allocation stalls without kswapd.
+ * */
+
+struct reclaim_stat reclaim_stat;
+
+static bool kswapd_ready = 0;               // kswapd runs, set by kswapd_init
+
+static wait_queue_t kswapd_wait;
+static bool kswapd_wanted = 0;              // the free pages went below KSWAPD_LOW since kswapd last looked
+static volatile bool kswapd_exit = 0;
+
+// try_to_free_pages - direct reclaim, called by alloc_pages_zone when it can not find
+//                   - a free page, returns the number of pages freed
+int
+try_to_free_pages(size_t n) {
+    uint64_t start = rdtsc();
+    // the pages read ahead into the swap cache go first, they cost no write
+    int nr = swap_cache_shrink(n);
+    if (nr < n) {
+        nr += swap_out(check_mm_struct, n - nr, 0);
+    }
+    reclaim_stat.nr_stall ++;
+    reclaim_stat.nr_direct += nr;
+    reclaim_stat.stall_cycles += rdtsc() - start;
+    return nr;
+}
+
+// wakeup_kswapd - called after every allocation, wake kswapd up if the free pages run low
+void
+wakeup_kswapd(void) {
+    if (!kswapd_ready || kswapd_wanted || nr_free_pages() >= KSWAPD_LOW) {
+        return;
+    }
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        kswapd_wanted = 1;
+        if (!wait_queue_empty(&kswapd_wait)) {
+            reclaim_stat.nr_wakeup ++;
+            wakeup_queue(&kswapd_wait, WT_KSWAPD, 1);
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
+// kswapd - the kernel thread which swaps pages out in the background
+static int
+kswapd(void *arg) {
+    while (!kswapd_exit) {
+        bool intr_flag;
+        local_intr_save(intr_flag);
+        if (!kswapd_wanted) {
+            wait_t __wait, *wait = &__wait;
+            wait_current_set(&kswapd_wait, wait, WT_KSWAPD);
+            local_intr_restore(intr_flag);
+
+            schedule();
+
+            local_intr_save(intr_flag);
+            wait_current_del(&kswapd_wait, wait);
+            local_intr_restore(intr_flag);
+            continue;
+        }
+        kswapd_wanted = 0;
+        local_intr_restore(intr_flag);
+
+        while (!kswapd_exit && nr_free_pages() < KSWAPD_HIGH) {
+            int nr = swap_cache_shrink(KSWAPD_BATCH);
+            nr += swap_out(NULL, KSWAPD_BATCH - nr, 0);
+            if (nr == 0) {
+                // every page left is shared, locked or not in use by any mm
+                break;
+            }
+            reclaim_stat.nr_kswapd += nr;
+            if (current->need_resched) {
+                schedule();
+            }
+        }
+    }
+    return 0;
+}
+
+// kswapd_init - start kswapd as a child of current, the stalls of check_swap do not count
+void
+kswapd_init(void) {
+    memset(&reclaim_stat, 0, sizeof(struct reclaim_stat));
+#ifdef NO_KSWAPD
+    cprintf("kswapd: disabled, every page is reclaimed by direct reclaim.\n");
+    return;
+#endif
+    wait_queue_init(&kswapd_wait);
+
+    int pid = kernel_thread(kswapd, NULL, 0);
+    if (pid <= 0) {
+        panic("create kswapd failed.\n");
+    }
+    set_proc_name(find_proc(pid), "kswapd");
+    kswapd_ready = 1;
+}
+
+// kswapd_stop - let kswapd quit, its parent has to wait for it
+void
+kswapd_stop(void) {
+    if (!kswapd_ready) {
+        return;
+    }
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        kswapd_ready = 0, kswapd_exit = 1;
+        if (!wait_queue_empty(&kswapd_wait)) {
+            wakeup_queue(&kswapd_wait, WT_KSWAPD, 1);
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
+void
+print_kswapd(void) {
+    uint64_t cycles = reclaim_stat.stall_cycles;
+    if (reclaim_stat.nr_stall != 0) {
+        do_div(cycles, reclaim_stat.nr_stall);
+    }
+    cprintf("reclaim: %u kswapd wakeups, %u pages freed by kswapd, %u by direct reclaim\n",
+            reclaim_stat.nr_wakeup, reclaim_stat.nr_kswapd, reclaim_stat.nr_direct);
+    cprintf("  %u allocation stalls, %u cycles each on average\n",
+            reclaim_stat.nr_stall, (unsigned int)cycles);
+}
@@ -0,0 +1,30 @@
+#ifndef __KERN_MM_KSWAPD_H__
+#define __KERN_MM_KSWAPD_H__
+
+#include <defs.h>
+
+#define KSWAPD_LOW              256     // kswapd is woken up when fewer pages are free
+#define KSWAPD_HIGH             512     // kswapd swaps out until so many pages are free
+#define KSWAPD_BATCH            32      // pages kswapd swaps out before it looks at need_resched
+
+// counters of page reclaim, printed by print_kswapd
+struct reclaim_stat {
+    size_t nr_wakeup;                   // times kswapd was woken up
+    size_t nr_kswapd;                   // pages freed by kswapd, swapped out or dropped from the swap cache
+    size_t nr_direct;                   // pages freed by a failed allocation itself
+    size_t nr_stall;                    // failed single-page allocations which reclaimed by themselves
+    uint64_t stall_cycles;              // time they spent in direct reclaim
+};
+
+extern struct reclaim_stat reclaim_stat;
+
+int try_to_free_pages(size_t n);
+
+void kswapd_init(void);
+void kswapd_stop(void);
+void wakeup_kswapd(void);
+
+void print_kswapd(void);
+
+#endif /* !__KERN_MM_KSWAPD_H__ */
+
@@ -71,6 +71,16 @@
 #define KMEMSIZE            0x38000000                  // the maximum amount of physical memory
 #define KERNTOP             (KERNBASE + KMEMSIZE)
 
+/* *
+ * Physical memory zones, each with its own free pool in the pmm_manager:
+ * ZONE_DMA is the memory below 16MB that an ISA/IDE bus master can reach,
+ * ZONE_NORMAL is the rest of the memory up to KMEMSIZE.
+ * */
+#define ZONE_DMA            0
+#define ZONE_NORMAL         1
+#define MAX_NR_ZONES        2
+#define DMA_ZONE_END        0x01000000
+
 /* *
  * Virtual page table. Entry PDX[VPT] in the PD (Page Directory) contains
  * a pointer to the page directory itself, thereby turning the PD into a page
@@ -129,15 +139,21 @@ struct e820map {
 struct Page {
     int ref;                        // page frame's reference counter
     uint32_t flags;                 // array of flags that describe the status of the page frame
-    unsigned int property;          // the num of free block, used in first fit pm manager
+    unsigned int property;          // the num of free block, used in first fit pm manager; for a page table, its non-zero ptes
     list_entry_t page_link;         // free list link
     list_entry_t pra_page_link;     // used for pra (page replace algorithm)
     uintptr_t pra_vaddr;            // used for pra (page replace algorithm)
+    unsigned int pra_age;           // used for pra, the access history kept by the aging swap manager
 };
 
 /* Flags describing the status of a page frame */
 #define PG_reserved                 0       // if this bit=1: the Page is reserved for kernel, cannot be used in alloc/free_pages; otherwise, this bit=0 
 #define PG_property                 1       // if this bit=1: the Page is the head page of a free memory block(contains some continuous_addrress pages), and can be used in alloc_pages; if this bit=0: if the Page is the the head page of a free memory block, then this Page and the memory block is alloced. Or this Page isn't the head page.
+#define PG_slab                     2       // if this bit=1: the Page belongs to a slab of a kmem cache (see slub.c), and property is its index in the slab
+#define PG_kmalloc                  3       // if this bit=1: the Page is the head page of a big kmalloc block (see kmalloc.c), and property is its order
+#define PG_swappable                4       // if this bit=1: the Page is linked in the list of the swap manager through pra_page_link
+#define PG_active                   5       // if this bit=1: the swappable Page is in the active list of the lru swap manager
+#define PG_swapcache                6       // if this bit=1: the Page holds the data of a swap slot in the swap cache (see swap_cache.c), and property is its swap entry
 
 #define SetPageReserved(page)       set_bit(PG_reserved, &((page)->flags))
 #define ClearPageReserved(page)     clear_bit(PG_reserved, &((page)->flags))
@@ -145,6 +161,21 @@ struct Page {
 #define SetPageProperty(page)       set_bit(PG_property, &((page)->flags))
 #define ClearPageProperty(page)     clear_bit(PG_property, &((page)->flags))
 #define PageProperty(page)          test_bit(PG_property, &((page)->flags))
+#define SetPageSlab(page)           set_bit(PG_slab, &((page)->flags))
+#define ClearPageSlab(page)         clear_bit(PG_slab, &((page)->flags))
+#define PageSlab(page)              test_bit(PG_slab, &((page)->flags))
+#define SetPageKmalloc(page)        set_bit(PG_kmalloc, &((page)->flags))
+#define ClearPageKmalloc(page)      clear_bit(PG_kmalloc, &((page)->flags))
+#define PageKmalloc(page)           test_bit(PG_kmalloc, &((page)->flags))
+#define SetPageSwappable(page)      set_bit(PG_swappable, &((page)->flags))
+#define ClearPageSwappable(page)    clear_bit(PG_swappable, &((page)->flags))
+#define PageSwappable(page)         test_bit(PG_swappable, &((page)->flags))
+#define SetPageActive(page)         set_bit(PG_active, &((page)->flags))
+#define ClearPageActive(page)       clear_bit(PG_active, &((page)->flags))
+#define PageActive(page)            test_bit(PG_active, &((page)->flags))
+#define SetPageSwapCache(page)      set_bit(PG_swapcache, &((page)->flags))
+#define ClearPageSwapCache(page)    clear_bit(PG_swapcache, &((page)->flags))
+#define PageSwapCache(page)         test_bit(PG_swapcache, &((page)->flags))
 
 // convert list entry to page
 #define le2page(le, member)                 \
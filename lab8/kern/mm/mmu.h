@@ -268,5 +268,8 @@ struct taskstate {
 #define CR4_PVI         0x00000002              // Protected-Mode Virtual Interrupts
 #define CR4_VME         0x00000001              // V86 Mode Extensions
 
+// feature flags in %edx of cpuid 1
+#define CPUID_FEATURE_PSE   0x00000008          // Page Size Extensions
+
 #endif /* !__KERN_MM_MMU_H__ */
 
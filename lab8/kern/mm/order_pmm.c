@@ -0,0 +1,388 @@
+#include <pmm.h>
+#include <list.h>
+#include <string.h>
+#include <order_pmm.h>
+
+/*  The order pmm manager is a binary buddy allocator built on segregated free
+ * lists. Free memory is kept as naturally aligned blocks of 2^order pages, and
+ * every order has its own free list, so
+ *  - alloc_pages(n) takes the head of the smallest non-empty list whose order
+ *    is large enough, and splits it down; the single-page case is a list pop.
+ *  - free_pages(base, n) finds the buddy of a block with one xor on the page
+ *    frame number (pfn ^ (1 << order)) and merges while the buddy is a free
+ *    block of the same order, so coalescing never walks a list.
+ * Both are O(MAX_ORDER) in the worst case instead of O(number of free blocks).
+ *
+ *  The Page fields keep the same meaning as in default_pmm: the head page of a
+ * free block has PG_property set and `property` is the number of pages in the
+ * block, all other pages have PG_property cleared. Requests that are not a
+ * power of two are served from the next order and the unused tail is given
+ * back at once, so free_pages(base, n) with the same n always matches.
+ *
+ *  Every zone (see memlayout.h) has its own set of free lists. Zone boundaries
+ * are aligned far beyond 2^(MAX_ORDER-1) pages, so a block and its buddy are
+ * always in the same zone. alloc_pages takes ZONE_NORMAL memory first and
+ * falls back to ZONE_DMA, which keeps the DMA pool for the callers that need it.
+ */
+
+static free_area_t order_area[MAX_NR_ZONES][MAX_ORDER];
+static size_t order_zone_nr_free[MAX_NR_ZONES];
+static size_t order_nr_free;
+
+#define free_list(zone, order) (order_area[(zone)][(order)].free_list)
+#define nr_free(zone, order) (order_area[(zone)][(order)].nr_free)
+
+static void
+order_init(void) {
+    int zone, order;
+    for (zone = 0; zone < MAX_NR_ZONES; zone ++) {
+        for (order = 0; order < MAX_ORDER; order ++) {
+            list_init(&free_list(zone, order));
+            nr_free(zone, order) = 0;
+        }
+        order_zone_nr_free[zone] = 0;
+    }
+    order_nr_free = 0;
+}
+
+// order_add_block - put a free block of 2^order pages at the head of its free list
+static inline void
+order_add_block(struct Page *page, int order) {
+    int zone = page_zone(page);
+    page->property = (1 << order);
+    SetPageProperty(page);
+    list_add(&free_list(zone, order), &(page->page_link));
+    nr_free(zone, order) ++;
+    order_zone_nr_free[zone] += (1 << order);
+    order_nr_free += (1 << order);
+}
+
+// order_del_block - unlink the free block headed by page from its free list
+static inline void
+order_del_block(struct Page *page, int order) {
+    int zone = page_zone(page);
+    list_del(&(page->page_link));
+    nr_free(zone, order) --;
+    order_zone_nr_free[zone] -= (1 << order);
+    order_nr_free -= (1 << order);
+    page->property = 0;
+    ClearPageProperty(page);
+}
+
+// order_free_block - free an aligned block of 2^order pages, merging it with its buddy
+//                  - as long as the buddy is a free block of the same order
+static void
+order_free_block(struct Page *page, int order) {
+    ppn_t ppn = page2ppn(page);
+    while (order < MAX_ORDER - 1) {
+        ppn_t buddy_ppn = ppn ^ (1 << order);
+        if (buddy_ppn >= npage) {
+            break;
+        }
+        struct Page *buddy = pages + buddy_ppn;
+        if (!PageProperty(buddy) || buddy->property != (1 << order)) {
+            break;
+        }
+        order_del_block(buddy, order);
+        ppn &= ~(1 << order);
+        order ++;
+    }
+    order_add_block(pages + ppn, order);
+}
+
+// order_free_range - free [base, base + n) as the largest naturally aligned blocks
+static void
+order_free_range(struct Page *base, size_t n) {
+    while (n > 0) {
+        ppn_t ppn = page2ppn(base);
+        int order = 0;
+        while (order < MAX_ORDER - 1 && (ppn & (1 << order)) == 0 && (2 << order) <= n) {
+            order ++;
+        }
+        order_free_block(base, order);
+        base += (1 << order), n -= (1 << order);
+    }
+}
+
+static void
+order_init_memmap(struct Page *base, size_t n) {
+    assert(n > 0);
+    struct Page *p = base;
+    for (; p != base + n; p ++) {
+        assert(PageReserved(p));
+        p->flags = p->property = 0;
+        set_page_ref(p, 0);
+    }
+    order_free_range(base, n);
+}
+
+// order_alloc_zone - allocate n pages out of the free lists of one zone
+static struct Page *
+order_alloc_zone(size_t n, int zone) {
+    if (n > order_zone_nr_free[zone]) {
+        return NULL;
+    }
+    int order = 0, cur;
+    while ((1 << order) < n) {
+        order ++;
+    }
+    for (cur = order; cur < MAX_ORDER; cur ++) {
+        if (!list_empty(&free_list(zone, cur))) {
+            break;
+        }
+    }
+    if (cur >= MAX_ORDER) {
+        return NULL;
+    }
+    struct Page *page = le2page(list_next(&free_list(zone, cur)), page_link);
+    order_del_block(page, cur);
+    // split: the upper half of each step goes back to the next lower order
+    while (cur > order) {
+        cur --;
+        order_add_block(page + (1 << cur), cur);
+    }
+    if ((1 << order) > n) {
+        order_free_range(page + n, (1 << order) - n);
+    }
+    return page;
+}
+
+// order_alloc_pages_zone - try the zones in zone_mask from the highest one down
+static struct Page *
+order_alloc_pages_zone(size_t n, uint32_t zone_mask) {
+    assert(n > 0);
+    struct Page *page = NULL;
+    int zone;
+    for (zone = MAX_NR_ZONES - 1; zone >= 0 && page == NULL; zone --) {
+        if (zone_mask & (1 << zone)) {
+            page = order_alloc_zone(n, zone);
+        }
+    }
+    return page;
+}
+
+static struct Page *
+order_alloc_pages(size_t n) {
+    return order_alloc_pages_zone(n, ZONE_MASK_ANY);
+}
+
+static void
+order_free_pages(struct Page *base, size_t n) {
+    assert(n > 0);
+    struct Page *p = base;
+    for (; p != base + n; p ++) {
+        assert(!PageReserved(p) && !PageProperty(p));
+        p->flags = 0;
+        set_page_ref(p, 0);
+    }
+    order_free_range(base, n);
+}
+
+static size_t
+order_nr_free_pages(void) {
+    return order_nr_free;
+}
+
+// order_count - walk all free lists, check the free block invariants and
+//             - return the number of free pages they hold
+static size_t
+order_count(int *count) {
+    size_t total = 0;
+    int zone, order;
+    for (zone = 0; zone < MAX_NR_ZONES; zone ++) {
+        size_t zone_total = 0;
+        for (order = 0; order < MAX_ORDER; order ++) {
+            int blocks = 0;
+            list_entry_t *le = &free_list(zone, order);
+            while ((le = list_next(le)) != &free_list(zone, order)) {
+                struct Page *p = le2page(le, page_link);
+                assert(PageProperty(p) && p->property == (1 << order));
+                assert((page2ppn(p) & ((1 << order) - 1)) == 0);
+                assert(page_zone(p) == zone && page_zone(p + p->property - 1) == zone);
+                blocks ++, zone_total += p->property;
+            }
+            assert(blocks == nr_free(zone, order));
+            if (count != NULL) {
+                *count += blocks;
+            }
+        }
+        assert(zone_total == order_zone_nr_free[zone]);
+        total += zone_total;
+    }
+    return total;
+}
+
+// order_stash - move every free block aside, leaving the allocator empty.
+// PG_property is cleared on the stashed heads so that no buddy merges into them.
+static void
+order_stash(list_entry_t stash[][MAX_ORDER], size_t nr_store[][MAX_ORDER]) {
+    int zone, order;
+    for (zone = 0; zone < MAX_NR_ZONES; zone ++) {
+        for (order = 0; order < MAX_ORDER; order ++) {
+            list_init(&stash[zone][order]);
+            list_entry_t *le;
+            while ((le = list_next(&free_list(zone, order))) != &free_list(zone, order)) {
+                list_del(le);
+                ClearPageProperty(le2page(le, page_link));
+                list_add_before(&stash[zone][order], le);
+            }
+            nr_store[zone][order] = nr_free(zone, order);
+            nr_free(zone, order) = 0;
+        }
+        order_zone_nr_free[zone] = 0;
+    }
+    order_nr_free = 0;
+}
+
+// order_unstash - put the blocks saved by order_stash back
+static void
+order_unstash(list_entry_t stash[][MAX_ORDER], size_t nr_store[][MAX_ORDER]) {
+    int zone, order;
+    for (zone = 0; zone < MAX_NR_ZONES; zone ++) {
+        for (order = 0; order < MAX_ORDER; order ++) {
+            list_entry_t *le;
+            while ((le = list_next(&stash[zone][order])) != &stash[zone][order]) {
+                list_del(le);
+                SetPageProperty(le2page(le, page_link));
+                list_add_before(&free_list(zone, order), le);
+            }
+            nr_free(zone, order) += nr_store[zone][order];
+            order_zone_nr_free[zone] += nr_store[zone][order] << order;
+            order_nr_free += nr_store[zone][order] << order;
+        }
+    }
+}
+
+static void
+basic_check(void) {
+    struct Page *p0, *p1, *p2;
+    p0 = p1 = p2 = NULL;
+    assert((p0 = alloc_page()) != NULL);
+    assert((p1 = alloc_page()) != NULL);
+    assert((p2 = alloc_page()) != NULL);
+
+    assert(p0 != p1 && p0 != p2 && p1 != p2);
+    assert(page_ref(p0) == 0 && page_ref(p1) == 0 && page_ref(p2) == 0);
+
+    assert(page2pa(p0) < npage * PGSIZE);
+    assert(page2pa(p1) < npage * PGSIZE);
+    assert(page2pa(p2) < npage * PGSIZE);
+
+    list_entry_t stash[MAX_NR_ZONES][MAX_ORDER];
+    size_t nr_store[MAX_NR_ZONES][MAX_ORDER];
+    order_stash(stash, nr_store);
+
+    assert(alloc_page() == NULL);
+
+    free_page(p0);
+    free_page(p1);
+    free_page(p2);
+    assert(order_nr_free == 3);
+
+    assert((p0 = alloc_page()) != NULL);
+    assert((p1 = alloc_page()) != NULL);
+    assert((p2 = alloc_page()) != NULL);
+
+    assert(alloc_page() == NULL);
+
+    free_page(p0);
+    assert(!list_empty(&free_list(page_zone(p0), 0)));
+
+    struct Page *p;
+    assert((p = alloc_page()) == p0);
+    assert(alloc_page() == NULL);
+
+    assert(order_nr_free == 0);
+    order_unstash(stash, nr_store);
+
+    free_page(p);
+    free_page(p1);
+    free_page(p2);
+}
+
+// LAB2: below code is used to check the per-order buddy allocation algorithm,
+// it keeps the spirit of default_check but asserts buddy placement instead of first fit
+static void
+order_check(void) {
+    int count = 0;
+    size_t total = order_count(&count);
+    assert(total == nr_free_pages());
+
+    basic_check();
+
+    struct Page *p0 = alloc_pages(8), *p1, *p2;
+    assert(p0 != NULL);
+    assert(!PageProperty(p0));
+    assert(page2ppn(p0) % 8 == 0);
+
+    list_entry_t stash[MAX_NR_ZONES][MAX_ORDER];
+    size_t nr_store[MAX_NR_ZONES][MAX_ORDER];
+    order_stash(stash, nr_store);
+    assert(alloc_page() == NULL);
+
+    // [p0+2, p0+5) is split into an order-1 and an order-0 block
+    free_pages(p0 + 2, 3);
+    assert(order_nr_free == 3);
+    assert(PageProperty(p0 + 2) && p0[2].property == 2);
+    assert(PageProperty(p0 + 4) && p0[4].property == 1);
+    assert(alloc_pages(4) == NULL);
+    assert((p1 = alloc_pages(2)) == p0 + 2);
+    assert((p2 = alloc_page()) == p0 + 4);
+    assert(alloc_page() == NULL);
+
+    // p0 and p0+2 are buddies of order 1, p0+4 has no free buddy
+    free_pages(p1, 2);
+    free_page(p2);
+    free_pages(p0, 2);
+    assert(PageProperty(p0) && p0->property == 4);
+    assert(!PageProperty(p0 + 2));
+    assert(PageProperty(p0 + 4) && p0[4].property == 1);
+
+    // the rest completes the buddy chain back to one order-3 block
+    free_pages(p0 + 5, 3);
+    assert(PageProperty(p0) && p0->property == 8);
+    assert(!PageProperty(p0 + 4));
+    assert(order_nr_free == 8 && nr_free(page_zone(p0), 3) == 1);
+
+    // odd sizes are trimmed to exactly n pages
+    assert((p1 = alloc_pages(3)) == p0);
+    assert(order_nr_free == 5);
+    assert(PageProperty(p0 + 3) && p0[3].property == 1);
+    assert(PageProperty(p0 + 4) && p0[4].property == 4);
+    free_pages(p1, 3);
+
+    assert((p0 = alloc_pages(8)) != NULL);
+    assert(alloc_page() == NULL);
+    assert(order_nr_free == 0);
+
+    order_unstash(stash, nr_store);
+    free_pages(p0, 8);
+
+    // zone masks are honoured, and plain allocations leave ZONE_DMA alone
+    // while there is ZONE_NORMAL memory
+    if (order_zone_nr_free[ZONE_DMA] != 0) {
+        assert((p0 = order_alloc_pages_zone(1, ZONE_MASK_DMA)) != NULL);
+        assert(page_zone(p0) == ZONE_DMA);
+        free_page(p0);
+    }
+    if (order_zone_nr_free[ZONE_NORMAL] != 0) {
+        assert((p0 = alloc_page()) != NULL && page_zone(p0) == ZONE_NORMAL);
+        free_page(p0);
+    }
+
+    int count_after = 0;
+    assert(order_count(&count_after) == total);
+    assert(count_after == count);
+}
+
+const struct pmm_manager order_pmm_manager = {
+    .name = "order_pmm_manager",
+    .init = order_init,
+    .init_memmap = order_init_memmap,
+    .alloc_pages = order_alloc_pages,
+    .free_pages = order_free_pages,
+    .nr_free_pages = order_nr_free_pages,
+    .check = order_check,
+    .alloc_pages_zone = order_alloc_pages_zone,
+};
+
@@ -0,0 +1,11 @@
+#ifndef __KERN_MM_ORDER_PMM_H__
+#define  __KERN_MM_ORDER_PMM_H__
+
+#include <pmm.h>
+
+#define MAX_ORDER               11      // free blocks of 2^0 ~ 2^10 pages (4KB ~ 4MB)
+
+extern const struct pmm_manager order_pmm_manager;
+
+#endif /* ! __KERN_MM_ORDER_PMM_H__ */
+
@@ -6,11 +6,16 @@
 #include <memlayout.h>
 #include <pmm.h>
 #include <default_pmm.h>
+#include <order_pmm.h>
+#include <buddy_pmm.h>
 #include <sync.h>
 #include <error.h>
 #include <swap.h>
+#include <swap_slot.h>
 #include <vmm.h>
 #include <kmalloc.h>
+#include <compaction.h>
+#include <kswapd.h>
 
 /* *
  * Task State Segment:
@@ -64,6 +69,9 @@ const struct pmm_manager *pmm_manager;
 pte_t * const vpt = (pte_t *)VPT;
 pde_t * const vpd = (pde_t *)PGADDR(PDX(VPT), PDX(VPT), 0);
 
+// set when the CPU has PSE and the kernel direct map is built of 4MB pages
+static bool boot_pse;
+
 /* *
  * Global Descriptor Table:
  *
@@ -89,6 +97,7 @@ static struct segdesc gdt[] = {
 static struct pseudodesc gdt_pd = {
     sizeof(gdt) - 1, (uintptr_t)gdt
 };
+static void pcp_init(void);
 
 static void check_alloc_page(void);
 static void check_pgdir(void);
@@ -137,12 +146,18 @@ gdt_init(void) {
     ltr(GD_TSS);
 }
 
+// PMM_MANAGER selects the pmm_manager at build time, see PMM in the Makefile
+#ifndef PMM_MANAGER
+#define PMM_MANAGER                 order_pmm_manager
+#endif
+
 //init_pmm_manager - initialize a pmm_manager instance
 static void
 init_pmm_manager(void) {
-    pmm_manager = &default_pmm_manager;
+    pmm_manager = &PMM_MANAGER;
     cprintf("memory management: %s\n", pmm_manager->name);
     pmm_manager->init();
+    pcp_init();
 }
 
 //init_memmap - call pmm->init_memmap to build Page struct for free memory  
@@ -151,25 +166,188 @@ init_memmap(struct Page *base, size_t n) {
     pmm_manager->init_memmap(base, n);
 }
 
+/* *
+ * pcp - the per-CPU page cache in front of the pmm_manager (ucore runs on one
+ * CPU, so there is a single instance). Single pages are taken from and given
+ * back to it without calling into the pmm_manager; it is refilled with and
+ * drained by PCP_BATCH pages at a time. Hot pages (just freed, probably still
+ * in the CPU cache) are kept at the head of the list, cold pages at the tail.
+ * Pages in the cache are allocated as far as the pmm_manager knows, but they
+ * are counted by nr_free_pages.
+ * */
+#define PCP_HIGH                    32
+#define PCP_BATCH                   16
+
+static struct pcp_cache {
+    list_entry_t list;          // cached pages, hot at the head, cold at the tail
+    size_t count;               // number of pages in list
+    size_t high;                // drain down when count goes above high, 0 bypasses the cache
+} pcp;
+
+static void
+pcp_init(void) {
+    list_init(&(pcp.list));
+    pcp.count = 0;
+    pcp.high = PCP_HIGH;
+}
+
+// pcp_refill - get up to PCP_BATCH pages from the pmm_manager, as one block if it can
+static void
+pcp_refill(void) {
+    struct Page *page;
+    size_t i;
+    if ((page = pmm_manager->alloc_pages(PCP_BATCH)) != NULL) {
+        for (i = 0; i < PCP_BATCH; i ++) {
+            list_add_before(&(pcp.list), &(page[i].page_link));
+        }
+        pcp.count += PCP_BATCH;
+        return;
+    }
+    for (i = 0; i < PCP_BATCH && (page = pmm_manager->alloc_pages(1)) != NULL; i ++) {
+        list_add_before(&(pcp.list), &(page->page_link));
+        pcp.count ++;
+    }
+}
+
+// pcp_drain - give the n coldest cached pages back to the pmm_manager
+static void
+pcp_drain(size_t n) {
+    while (n -- > 0 && pcp.count > 0) {
+        list_entry_t *le = list_prev(&(pcp.list));
+        list_del(le);
+        pcp.count --;
+        pmm_manager->free_pages(le2page(le, page_link), 1);
+    }
+}
+
+// drain_pcp - give every cached page back to the pmm_manager, so that they can
+//           - be merged into bigger blocks again (used by compaction and alloc_pages_zone)
+void
+drain_pcp(void) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        pcp_drain(pcp.count);
+    }
+    local_intr_restore(intr_flag);
+}
+
+static struct Page *
+pcp_alloc(void) {
+    if (pcp.count == 0) {
+        pcp_refill();
+        if (pcp.count == 0) {
+            return NULL;
+        }
+    }
+    list_entry_t *le = list_next(&(pcp.list));
+    list_del(le);
+    pcp.count --;
+    return le2page(le, page_link);
+}
+
+// pcp_free - cache a freed page; it is reset as the pmm_manager resets the pages it
+//          - takes back, so that pcp_alloc hands out no stale flag or reference
+static void
+pcp_free(struct Page *page, bool cold) {
+    assert(!PageReserved(page) && !PageProperty(page));
+    page->flags = 0;
+    set_page_ref(page, 0);
+    if (cold) {
+        list_add_before(&(pcp.list), &(page->page_link));
+    }
+    else {
+        list_add(&(pcp.list), &(page->page_link));
+    }
+    if (++ pcp.count > pcp.high) {
+        pcp_drain(PCP_BATCH);
+    }
+}
+
+// pmm_alloc_zone - allocate from the zones in zone_mask. A pmm_manager without
+//                - alloc_pages_zone has a single pool, so its page is checked
+static struct Page *
+pmm_alloc_zone(size_t n, uint32_t zone_mask) {
+    if (pmm_manager->alloc_pages_zone != NULL) {
+        return pmm_manager->alloc_pages_zone(n, zone_mask);
+    }
+    struct Page *page = pmm_manager->alloc_pages(n);
+    if (page != NULL && !(zone_mask & (1 << page_zone(page)))) {
+        pmm_manager->free_pages(page, n);
+        page = NULL;
+    }
+    return page;
+}
+
 //alloc_pages - call pmm->alloc_pages to allocate a continuous n*PAGESIZE memory 
 struct Page *
 alloc_pages(size_t n) {
+    return alloc_pages_zone(n, ZONE_MASK_ANY);
+}
+
+//alloc_huge_page - allocate 4MB aligned to 4MB for a large user PDE, NULL without PSE
+//                - or if the pmm_manager gave a block which is not aligned
+struct Page *
+alloc_huge_page(void) {
+    struct Page *page;
+    if (!boot_pse || (page = alloc_pages(HUGE_NPAGES)) == NULL) {
+        return NULL;
+    }
+    if (page2pa(page) % PTSIZE != 0) {
+        free_huge_page(page);
+        return NULL;
+    }
+    return page;
+}
+
+//alloc_pages_zone - allocate a continuous n*PAGESIZE memory from the zones in zone_mask,
+//                 - the pcp holds pages of any zone and only serves ZONE_MASK_ANY
+//                 - a failed request the pcp does not serve drains the pcp and tries again,
+//                 - a failed multi-page request then compacts the zones once and tries again
+struct Page *
+alloc_pages_zone(size_t n, uint32_t zone_mask) {
     struct Page *page=NULL;
-    bool intr_flag;
+    bool intr_flag, drained = 0, compacted = 0;
     
     while (1)
     {
          local_intr_save(intr_flag);
          {
-              page = pmm_manager->alloc_pages(n);
+              if (n == 1 && pcp.high != 0 && zone_mask == ZONE_MASK_ANY) {
+                  page = pcp_alloc();
+              }
+              else if (zone_mask == ZONE_MASK_ANY) {
+                  page = pmm_manager->alloc_pages(n);
+              }
+              else {
+                  page = pmm_alloc_zone(n, zone_mask);
+              }
          }
          local_intr_restore(intr_flag);
 
-         if (page != NULL || n > 1 || swap_init_ok == 0) break;
+         if (page != NULL) {
+              if (swap_init_ok) {
+                   wakeup_kswapd();
+              }
+              break;
+         }
+         if (!drained && (n > 1 || zone_mask != ZONE_MASK_ANY) && pcp.count != 0) {
+              // the cached pages may complete a block, or be in the zone wanted
+              drain_pcp();
+              drained = 1;
+              continue;
+         }
+         if (n > 1) {
+              if (!compacted && try_to_compact_pages(n, zone_mask) == 0) {
+                   compacted = 1;
+                   continue;
+              }
+              break;
+         }
+         if (swap_init_ok == 0) break;
          
-         extern struct mm_struct *check_mm_struct;
-         //cprintf("page %x, call swap_out in alloc_pages %d\n",page, n);
-         swap_out(check_mm_struct, n, 0);
+         // kswapd did not keep up, swap out by ourselves
+         if (try_to_free_pages(n) == 0) break;
     }
     //cprintf("n %d,get page %x, No %d in alloc_pages\n",n,page,(page-pages));
     return page;
@@ -181,25 +359,124 @@ free_pages(struct Page *base, size_t n) {
     bool intr_flag;
     local_intr_save(intr_flag);
     {
-        pmm_manager->free_pages(base, n);
+        // a freed page can not stay in the list of the swap manager
+        if (PageSwappable(base)) {
+            swap_remove_page(base);
+        }
+        if (n == 1 && pcp.high != 0) {
+            pcp_free(base, 0);
+        }
+        else {
+            pmm_manager->free_pages(base, n);
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
+//free_page_cold - free a page whose content will not be touched again soon
+//               - (e.g. it was just written out), it is handed out last by the pcp
+void
+free_page_cold(struct Page *page) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        if (pcp.high != 0) {
+            pcp_free(page, 1);
+        }
+        else {
+            pmm_manager->free_pages(page, 1);
+        }
     }
     local_intr_restore(intr_flag);
 }
 
 //nr_free_pages - call pmm->nr_free_pages to get the size (nr*PAGESIZE) 
-//of current free memory
+//of current free memory, the pages in the pcp are free too
 size_t
 nr_free_pages(void) {
     size_t ret;
     bool intr_flag;
     local_intr_save(intr_flag);
     {
-        ret = pmm_manager->nr_free_pages();
+        ret = pmm_manager->nr_free_pages() + pcp.count;
     }
     local_intr_restore(intr_flag);
     return ret;
 }
 
+static const char *zone_names[MAX_NR_ZONES] = {"DMA", "Normal"};
+
+// print_zoneinfo - report every zone: managed and free pages, free blocks per order
+//                - and the unusable free space index, the share of free pages that
+//                - cannot serve a 2^order request. Free blocks are found from their
+//                - PG_property head pages, whose property is the block size with every
+//                - pmm_manager; a size that is not a power of two counts at the order
+//                - below it, and with a single-pool pmm_manager a block that crosses a
+//                - zone boundary counts in the zone of its head. Pages in the pcp are
+//                - free, but in no block.
+void
+print_zoneinfo(void) {
+    size_t managed[MAX_NR_ZONES], nr_free[MAX_NR_ZONES], nr_pcp[MAX_NR_ZONES];
+    size_t blocks[MAX_NR_ZONES][MAX_ORDER];
+    int zone, order;
+    size_t i;
+    memset(managed, 0, sizeof(managed));
+    memset(nr_free, 0, sizeof(nr_free));
+    memset(nr_pcp, 0, sizeof(nr_pcp));
+    memset(blocks, 0, sizeof(blocks));
+
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        for (i = 0; i < npage; i ++) {
+            struct Page *p = pages + i;
+            if (PageReserved(p)) {
+                continue;
+            }
+            zone = page_zone(p);
+            managed[zone] ++;
+            if (PageProperty(p)) {
+                for (order = 0; order < MAX_ORDER - 1 && (2 << order) <= p->property; order ++)
+                    /* nothing */;
+                blocks[zone][order] ++;
+                nr_free[zone] += p->property;
+                managed[zone] += p->property - 1;
+                i += p->property - 1;
+            }
+        }
+        list_entry_t *le = &(pcp.list);
+        while ((le = list_next(le)) != &(pcp.list)) {
+            nr_pcp[page_zone(le2page(le, page_link))] ++;
+        }
+    }
+    local_intr_restore(intr_flag);
+
+    for (zone = 0; zone < MAX_NR_ZONES; zone ++) {
+        uintptr_t start = (zone == ZONE_DMA) ? 0 : DMA_ZONE_END;
+        uintptr_t end = (zone == ZONE_DMA) ? DMA_ZONE_END : KMEMSIZE;
+        cprintf("zone %-6s [%08x, %08x): %u managed, %u free, %u in pcp\n", zone_names[zone],
+                start, end, managed[zone], nr_free[zone] + nr_pcp[zone], nr_pcp[zone]);
+        if (managed[zone] == 0) {
+            continue;
+        }
+        cprintf("  %-9s", "order");
+        for (order = 0; order < MAX_ORDER; order ++) {
+            cprintf(" %5d", order);
+        }
+        cprintf("\n  %-9s", "blocks");
+        for (order = 0; order < MAX_ORDER; order ++) {
+            cprintf(" %5u", blocks[zone][order]);
+        }
+        cprintf("\n  %-9s", "unusable%");
+        size_t usable = nr_free[zone];
+        for (order = 0; order < MAX_ORDER; order ++) {
+            cprintf(" %5u", nr_free[zone] == 0 ? 100 : (nr_free[zone] - usable) * 100 / nr_free[zone]);
+            usable -= blocks[zone][order] << order;
+        }
+        cprintf("\n");
+    }
+}
+
 /* pmm_init - initialize the physical memory management */
 static void
 page_init(void) {
@@ -253,12 +530,25 @@ page_init(void) {
     }
 }
 
+//pse_init - turn on CR4.PSE if the CPU supports 4MB pages
+static bool
+pse_init(void) {
+    uint32_t edx;
+    cpuid(1, NULL, NULL, NULL, &edx);
+    if (!(edx & CPUID_FEATURE_PSE)) {
+        return 0;
+    }
+    lcr4(rcr4() | CR4_PSE);
+    return 1;
+}
+
 //boot_map_segment - setup&enable the paging mechanism
 // parameters
 //  la:   linear address of this memory need to map (after x86 segment map)
 //  size: memory size
 //  pa:   physical address of this memory
 //  perm: permission of this memory  
+//note: with boot_pse, every 4MB aligned 4MB is mapped by one large PDE
 static void
 boot_map_segment(pde_t *pgdir, uintptr_t la, size_t size, uintptr_t pa, uint32_t perm) {
     assert(PGOFF(la) == PGOFF(pa));
@@ -266,6 +556,11 @@ boot_map_segment(pde_t *pgdir, uintptr_t la, size_t size, uintptr_t pa, uint32_t
     la = ROUNDDOWN(la, PGSIZE);
     pa = ROUNDDOWN(pa, PGSIZE);
     for (; n > 0; n --, la += PGSIZE, pa += PGSIZE) {
+        if (boot_pse && la % PTSIZE == 0 && pa % PTSIZE == 0 && n >= NPTEENTRY) {
+            pgdir[PDX(la)] = pa | PTE_PS | PTE_P | perm;
+            n -= NPTEENTRY - 1, la += PTSIZE - PGSIZE, pa += PTSIZE - PGSIZE;
+            continue;
+        }
         pte_t *ptep = get_pte(pgdir, la, 1);
         assert(ptep != NULL);
         *ptep = pa | PTE_P | perm;
@@ -305,6 +600,8 @@ pmm_init(void) {
     //use pmm->check to verify the correctness of the alloc/free function in a pmm
     check_alloc_page();
 
+    print_zoneinfo();
+
     check_pgdir();
 
     static_assert(KERNBASE % PTSIZE == 0 && KERNTOP % PTSIZE == 0);
@@ -315,7 +612,14 @@ pmm_init(void) {
 
     // map all physical memory to linear memory with base linear addr KERNBASE
     // linear_addr KERNBASE ~ KERNBASE + KMEMSIZE = phy_addr 0 ~ KMEMSIZE
+    // use 4MB pages if the CPU has them, the 4KB mapping of the first 4MB made
+    // by entry.S is replaced, so flush it out of the TLB
+    boot_pse = pse_init();
     boot_map_segment(boot_pgdir, KERNBASE, KMEMSIZE, 0, PTE_W);
+    if (boot_pse) {
+        lcr3(boot_cr3);
+    }
+    cprintf("kernel direct map: %s pages\n", boot_pse ? "4MB" : "4KB");
 
     // Since we are using bootloader's GDT,
     // we should reload gdt (second time, the last time) to get user segments and the TSS
@@ -375,6 +679,23 @@ get_pte(pde_t *pgdir, uintptr_t la, bool create) {
     }
     return NULL;          // (8) return page table entry
 #endif
+    pde_t *pdep = &pgdir[PDX(la)];
+    if (!(*pdep & PTE_P)) {
+        struct Page *page;
+        if (!create || (page = alloc_page()) == NULL) {
+            return NULL;
+        }
+        set_page_ref(page, 1);
+        set_pt_live(page, 0);
+        uintptr_t pa = page2pa(page);
+        memset(KADDR(pa), 0, PGSIZE);
+        *pdep = pa | PTE_U | PTE_W | PTE_P;
+    }
+    // a 4MB page has no page table, its PDE is the pte of every page in it
+    if (*pdep & PTE_PS) {
+        return pdep;
+    }
+    return &((pte_t *)KADDR(PDE_ADDR(*pdep)))[PTX(la)];
 }
 
 //get_page - get related Page struct for linear address la using PDT pgdir
@@ -385,14 +706,17 @@ get_page(pde_t *pgdir, uintptr_t la, pte_t **ptep_store) {
         *ptep_store = ptep;
     }
     if (ptep != NULL && *ptep & PTE_P) {
+        if (*ptep & PTE_PS) {
+            return pa2page(PDE_ADDR(*ptep) + (la & (PTSIZE - 1)));
+        }
         return pte2page(*ptep);
     }
     return NULL;
 }
 
 //page_remove_pte - free an Page sturct which is related linear address la
-//                - and clean(invalidate) pte which is related linear address la
-//note: PT is changed, so the TLB need to be invalidate 
+//                - and clean pte which is related linear address la
+//note: PT is changed, the caller invalidates the TLB entry, alone or with a tlb_gather
 static inline void
 page_remove_pte(pde_t *pgdir, uintptr_t la, pte_t *ptep) {
     /* LAB2 EXERCISE 3: YOUR CODE
@@ -420,6 +744,25 @@ page_remove_pte(pde_t *pgdir, uintptr_t la, pte_t *ptep) {
                                   //(6) flush tlb
     }
 #endif
+    if (*ptep & PTE_P) {
+        assert(!(*ptep & PTE_PS));
+        struct Page *page = pte2page(*ptep);
+        if (page_ref_dec(page) == 0) {
+            free_page(page);
+        }
+        *ptep = 0;
+        pt_live_dec(ptep);
+    }
+}
+
+//page_remove_pde - drop the 4MB page mapped by a large PDE, the caller flushes the TLB
+static inline void
+page_remove_pde(pde_t *pdep) {
+    struct Page *page = pde2page(*pdep);
+    if (page_ref_dec(page) == 0) {
+        free_huge_page(page);
+    }
+    *pdep = 0;
 }
 
 void
@@ -427,17 +770,50 @@ unmap_range(pde_t *pgdir, uintptr_t start, uintptr_t end) {
     assert(start % PGSIZE == 0 && end % PGSIZE == 0);
     assert(USER_ACCESS(start, end));
 
+    // the frames are freed before the flush; nothing touches the range until tlb_finish,
+    // so the stale entries are never used
+    struct tlb_gather tlb;
+    tlb_gather_init(&tlb, pgdir);
     do {
-        pte_t *ptep = get_pte(pgdir, start, 0);
-        if (ptep == NULL) {
-            start = ROUNDDOWN(start + PTSIZE, PTSIZE);
+        pde_t *pdep = &pgdir[PDX(start)];
+        uintptr_t next = ROUNDDOWN(start + PTSIZE, PTSIZE);
+        if (!(*pdep & PTE_P)) {
+            start = next;
             continue ;
         }
-        if (*ptep != 0) {
-            page_remove_pte(pgdir, start, ptep);
+        if (*pdep & PTE_PS) {
+            // a 4MB page, vma of huge pages are cut at 4MB boundaries only (see mm_unmap)
+            assert(start % PTSIZE == 0 && end - start >= PTSIZE);
+            tlb_gather_add(&tlb, start);
+            page_remove_pde(pdep);
+            start = next;
+            continue;
         }
-        start += PGSIZE;
+        struct Page *ptpage = pde2page(*pdep);
+        pte_t *pt = KADDR(PDE_ADDR(*pdep));
+        // stop as soon as the page table has no pte left
+        for (; pt_live(ptpage) != 0 && start != next && start < end; start += PGSIZE) {
+            pte_t *ptep = pt + PTX(start);
+            if (*ptep & PTE_P) {
+                tlb_gather_add(&tlb, start);
+                page_remove_pte(pgdir, start, ptep);
+            }
+            else if (*ptep != 0) {
+                // a swap entry, the slot is free once no pte holds it
+                swap_free(*ptep);
+                *ptep = 0;
+                pt_live_dec(ptep);
+            }
+        }
+        if (pt_live(ptpage) == 0) {
+            // the processor may cache the pde too, flush the 4MB with the ptes
+            *pdep = 0;
+            free_page(ptpage);
+            tlb_gather_add(&tlb, next - PTSIZE);
+        }
+        start = next;
     } while (start != 0 && start < end);
+    tlb_finish(&tlb);
 }
 
 void
@@ -448,6 +824,8 @@ exit_range(pde_t *pgdir, uintptr_t start, uintptr_t end) {
     start = ROUNDDOWN(start, PTSIZE);
     do {
         int pde_idx = PDX(start);
+        // unmap_range has removed the 4MB pages already, only page tables are left
+        assert(!(pgdir[pde_idx] & PTE_PS));
         if (pgdir[pde_idx] & PTE_P) {
             free_page(pde2page(pgdir[pde_idx]));
             pgdir[pde_idx] = 0;
@@ -458,7 +836,8 @@ exit_range(pde_t *pgdir, uintptr_t start, uintptr_t end) {
 /* copy_range - copy content of memory (start, end) of one process A to another process B
  * @to:    the addr of process B's Page Directory
  * @from:  the addr of process A's Page Directory
- * @share: flags to indicate to dup OR share. We just use dup method, so it didn't be used.
+ * @share: flags to indicate to dup OR share. When share, the pages are mapped read-only
+ *         in both A and B and copied on the first write, see do_pgfault.
  *
  * CALL GRAPH: copy_mm-->dup_mmap-->copy_range
  */
@@ -466,45 +845,106 @@ int
 copy_range(pde_t *to, pde_t *from, uintptr_t start, uintptr_t end, bool share) {
     assert(start % PGSIZE == 0 && end % PGSIZE == 0);
     assert(USER_ACCESS(start, end));
+    struct tlb_gather tlb;
+    tlb_gather_init(&tlb, from);
     // copy content by page unit.
     do {
+        pde_t pde = from[PDX(start)];
+        if ((pde & (PTE_P | PTE_PS)) == PTE_P && pt_live(pde2page(pde)) == 0) {
+            // nothing mapped in this 4MB
+            start = ROUNDDOWN(start + PTSIZE, PTSIZE);
+            continue ;
+        }
         //call get_pte to find process A's pte according to the addr start
         pte_t *ptep = get_pte(from, start, 0), *nptep;
         if (ptep == NULL) {
             start = ROUNDDOWN(start + PTSIZE, PTSIZE);
             continue ;
         }
+        if (*ptep & PTE_PS) {
+            // a 4MB page is shared or copied whole, B gets a large PDE too; or, when
+            // there is no 4MB block for the copy, a page table of 4KB copies
+            assert(start % PTSIZE == 0);
+            uint32_t perm = (*ptep & PTE_USER);
+            struct Page *page = pde2page(*ptep), *npage;
+            if (share) {
+                if (perm & PTE_W) {
+                    perm &= ~PTE_W;
+                    *ptep &= ~PTE_W;
+                    tlb_gather_add(&tlb, start);
+                }
+            }
+            else if ((npage = alloc_huge_page()) != NULL) {
+                memcpy(page2kva(npage), page2kva(page), PTSIZE);
+                page = npage;
+            }
+            else {
+                uintptr_t la;
+                for (la = start; la < start + PTSIZE; la += PGSIZE) {
+                    if ((npage = alloc_page()) == NULL) {
+                        tlb_finish(&tlb);
+                        return -E_NO_MEM;
+                    }
+                    memcpy(page2kva(npage), page2kva(page) + (la - start), PGSIZE);
+                    if (page_insert(to, npage, la, perm) != 0) {
+                        free_page(npage);
+                        tlb_finish(&tlb);
+                        return -E_NO_MEM;
+                    }
+                }
+                start += PTSIZE;
+                continue;
+            }
+            page_ref_inc(page);
+            to[PDX(start)] = page2pa(page) | PTE_PS | perm;
+            start += PTSIZE;
+            continue;
+        }
         //call get_pte to find process B's pte according to the addr start. If pte is NULL, just alloc a PT
         if (*ptep & PTE_P) {
             if ((nptep = get_pte(to, start, 1)) == NULL) {
+                tlb_finish(&tlb);
                 return -E_NO_MEM;
             }
-        uint32_t perm = (*ptep & PTE_USER);
-        //get page from ptep
-        struct Page *page = pte2page(*ptep);
-        // alloc a page for process B
-        struct Page *npage=alloc_page();
-        assert(page!=NULL);
-        assert(npage!=NULL);
-        int ret=0;
-        /* LAB5:EXERCISE2 YOUR CODE
-         * replicate content of page to npage, build the map of phy addr of nage with the linear addr start
-         *
-         * Some Useful MACROs and DEFINEs, you can use them in below implementation.
-         * MACROs or Functions:
-         *    page2kva(struct Page *page): return the kernel vritual addr of memory which page managed (SEE pmm.h)
-         *    page_insert: build the map of phy addr of an Page with the linear addr la
-         *    memcpy: typical memory copy function
-         *
-         * (1) find src_kvaddr: the kernel virtual address of page
-         * (2) find dst_kvaddr: the kernel virtual address of npage
-         * (3) memory copy from src_kvaddr to dst_kvaddr, size is PGSIZE
-         * (4) build the map of phy addr of  nage with the linear addr start
-         */
-        assert(ret == 0);
+            uint32_t perm = (*ptep & PTE_USER);
+            //get page from ptep
+            struct Page *page = pte2page(*ptep);
+            assert(page != NULL);
+            int ret = 0;
+            if (share) {
+                // copy on write: take the write permission away from A too, the page
+                // is shared until one of them writes it
+                if (perm & PTE_W) {
+                    perm &= ~PTE_W;
+                    *ptep &= ~PTE_W;
+                    tlb_gather_add(&tlb, start);
+                }
+                ret = page_insert(to, page, start, perm);
+            }
+            else {
+                // alloc a page for process B
+                struct Page *npage = alloc_page();
+                if (npage == NULL) {
+                    tlb_finish(&tlb);
+                    return -E_NO_MEM;
+                }
+                memcpy(page2kva(npage), page2kva(page), PGSIZE);
+                ret = page_insert(to, npage, start, perm);
+            }
+            assert(ret == 0);
+        }
+        else if (*ptep != 0) {
+            // a swap entry, B holds the slot too
+            if ((nptep = get_pte(to, start, 1)) == NULL || swap_dup(*ptep) != 0) {
+                tlb_finish(&tlb);
+                return -E_NO_MEM;
+            }
+            *nptep = *ptep;
+            pt_live_inc(nptep);
         }
         start += PGSIZE;
     } while (start != 0 && start < end);
+    tlb_finish(&tlb);
     return 0;
 }
 
@@ -514,6 +954,7 @@ page_remove(pde_t *pgdir, uintptr_t la) {
     pte_t *ptep = get_pte(pgdir, la, 0);
     if (ptep != NULL) {
         page_remove_pte(pgdir, la, ptep);
+        tlb_invalidate(pgdir, la);
     }
 }
 
@@ -531,7 +972,9 @@ page_insert(pde_t *pgdir, struct Page *page, uintptr_t la, uint32_t perm) {
     if (ptep == NULL) {
         return -E_NO_MEM;
     }
-    page_ref_inc(page);
+    if (page_ref_inc(page) == 1) {
+        page->pra_vaddr = la;           // where the only mapping is, see compaction.c
+    }
     if (*ptep & PTE_P) {
         struct Page *p = pte2page(*ptep);
         if (p == page) {
@@ -541,6 +984,9 @@ page_insert(pde_t *pgdir, struct Page *page, uintptr_t la, uint32_t perm) {
             page_remove_pte(pgdir, la, ptep);
         }
     }
+    if (*ptep == 0) {
+        pt_live_inc(ptep);
+    }
     *ptep = page2pa(page) | PTE_P | perm;
     tlb_invalidate(pgdir, la);
     return 0;
@@ -552,9 +998,55 @@ void
 tlb_invalidate(pde_t *pgdir, uintptr_t la) {
     if (rcr3() == PADDR(pgdir)) {
         invlpg((void *)la);
+        tlb_stat.nr_invlpg ++;
+    }
+}
+
+struct tlb_stat tlb_stat;
+
+// tlb_gather_init - start collecting the addresses changed in pgdir
+void
+tlb_gather_init(struct tlb_gather *tlb, pde_t *pgdir) {
+    tlb->pgdir = pgdir;
+    tlb->active = (rcr3() == PADDR(pgdir));
+    tlb->nr = 0;
+}
+
+// tlb_gather_add - remember that the pte of la changed, past TLB_GATHER_MAX of them
+//                - tlb_finish flushes the whole TLB instead
+void
+tlb_gather_add(struct tlb_gather *tlb, uintptr_t la) {
+    if (tlb->active && tlb->nr <= TLB_GATHER_MAX) {
+        if (tlb->nr < TLB_GATHER_MAX) {
+            tlb->la[tlb->nr] = la;
+        }
+        tlb->nr ++;
     }
 }
 
+// tlb_finish - flush the addresses collected by tlb, one invlpg each or one reload of cr3
+void
+tlb_finish(struct tlb_gather *tlb) {
+    if (tlb->nr > TLB_GATHER_MAX) {
+        lcr3(rcr3());
+        tlb_stat.nr_flush ++;
+    }
+    else {
+        int i;
+        for (i = 0; i < tlb->nr; i ++) {
+            invlpg((void *)tlb->la[i]);
+        }
+        tlb_stat.nr_invlpg += tlb->nr;
+    }
+    tlb->nr = 0;
+}
+
+void
+print_tlb_stat(void) {
+    cprintf("tlb: %u invlpg, %u full flushes, %u cr3 reloads skipped.\n",
+            tlb_stat.nr_invlpg, tlb_stat.nr_flush, tlb_stat.nr_cr3_skip);
+}
+
 // pgdir_alloc_page - call alloc_page & page_insert functions to 
 //                  - allocate a page size memory & setup an addr map
 //                  - pa<->la with linear address la and the PDT pgdir
@@ -573,12 +1065,8 @@ pgdir_alloc_page(pde_t *pgdir, uintptr_t la, uint32_t perm) {
                 assert(page_ref(page) == 1);
                 //cprintf("get No. %d  page: pra_vaddr %x, pra_link.prev %x, pra_link_next %x in pgdir_alloc_page\n", (page-pages), page->pra_vaddr,page->pra_page_link.prev, page->pra_page_link.next);
             } 
-            else  {  //now current is existed, should fix it in the future
-                //swap_map_swappable(current->mm, la, page, 0);
-                //page->pra_vaddr=la;
-                //assert(page_ref(page) == 1);
-                //panic("pgdir_alloc_page: no pages. now current is existed, should fix it in the future\n");
-            }
+            // else the page is not filled yet, do_pgfault hands it to the swap manager
+            // when it is (page_swappable)
         }
 
     }
@@ -586,9 +1074,67 @@ pgdir_alloc_page(pde_t *pgdir, uintptr_t la, uint32_t perm) {
     return page;
 }
 
+#define BENCH_ROUNDS                4096
+#define BENCH_BURST                 32
+#define BENCH_MAX_NPAGES            16
+
+// bench_alloc_page - hammer the alloc/free path of the pmm_manager: single pages
+//                  - as back-to-back pairs and as bursts of BENCH_BURST, then bursts
+//                  - of 1 ~ BENCH_MAX_NPAGES pages. Build with different PMM to compare.
+static void
+bench_alloc_page(void) {
+    struct Page *burst[BENCH_BURST];
+    uint64_t start, cycles;
+    int i, j;
+
+    start = rdtsc();
+    for (i = 0; i < BENCH_ROUNDS; i ++) {
+        struct Page *p = alloc_page();
+        assert(p != NULL);
+        free_page(p);
+    }
+    cycles = rdtsc() - start;
+    do_div(cycles, BENCH_ROUNDS);
+    cprintf("bench_alloc_page: %s, alloc+free pair: %u cycles\n", pmm_manager->name, (unsigned int)cycles);
+
+    start = rdtsc();
+    for (i = 0; i < BENCH_ROUNDS / BENCH_BURST; i ++) {
+        for (j = 0; j < BENCH_BURST; j ++) {
+            assert((burst[j] = alloc_page()) != NULL);
+        }
+        for (j = 0; j < BENCH_BURST; j ++) {
+            free_page(burst[j]);
+        }
+    }
+    cycles = rdtsc() - start;
+    do_div(cycles, BENCH_ROUNDS);
+    cprintf("bench_alloc_page: %s, burst of %d: %u cycles per page\n", pmm_manager->name, BENCH_BURST, (unsigned int)cycles);
+
+    start = rdtsc();
+    for (i = 0; i < BENCH_ROUNDS / BENCH_BURST; i ++) {
+        for (j = 0; j < BENCH_BURST; j ++) {
+            assert((burst[j] = alloc_pages(j % BENCH_MAX_NPAGES + 1)) != NULL);
+        }
+        for (j = 0; j < BENCH_BURST; j ++) {
+            free_pages(burst[j], j % BENCH_MAX_NPAGES + 1);
+        }
+    }
+    cycles = rdtsc() - start;
+    do_div(cycles, BENCH_ROUNDS);
+    cprintf("bench_alloc_page: %s, burst of 1~%d pages: %u cycles per call\n", pmm_manager->name, BENCH_MAX_NPAGES, (unsigned int)cycles);
+}
+
 static void
 check_alloc_page(void) {
+    size_t nr_free_store = nr_free_pages();
+    // the pmm_manager check counts on every free page being in the pmm_manager
+    size_t pcp_high_store = pcp.high;
+    pcp_drain(pcp.count);
+    pcp.high = 0;
     pmm_manager->check();
+    pcp.high = pcp_high_store;
+    bench_alloc_page();
+    assert(nr_free_store == nr_free_pages());
     cprintf("check_alloc_page() succeeded!\n");
 }
 
@@ -644,10 +1190,17 @@ static void
 check_boot_pgdir(void) {
     pte_t *ptep;
     int i;
-    for (i = 0; i < npage; i += PGSIZE) {
+    for (i = 0; i < npage * PGSIZE; i += PGSIZE) {
         assert((ptep = get_pte(boot_pgdir, (uintptr_t)KADDR(i), 0)) != NULL);
-        assert(PTE_ADDR(*ptep) == i);
+        if (*ptep & PTE_PS) {
+            assert(boot_pse && PDE_ADDR(*ptep) == ROUNDDOWN(i, PTSIZE));
+        }
+        else {
+            assert(PTE_ADDR(*ptep) == i);
+        }
+        assert(page2pa(get_page(boot_pgdir, (uintptr_t)KADDR(i), NULL)) == i);
     }
+    assert(!boot_pse || (boot_pgdir[PDX(KERNBASE)] & PTE_PS));
 
     assert(PDE_ADDR(boot_pgdir[PDX(VPT)]) == PADDR(boot_pgdir));
 
@@ -708,8 +1261,8 @@ get_pgtable_items(size_t left, size_t right, size_t start, uintptr_t *table, siz
         if (left_store != NULL) {
             *left_store = start;
         }
-        int perm = (table[start ++] & PTE_USER);
-        while (start < right && (table[start] & PTE_USER) == perm) {
+        int perm = (table[start ++] & (PTE_USER | PTE_PS));
+        while (start < right && (table[start] & (PTE_USER | PTE_PS)) == perm) {
             start ++;
         }
         if (right_store != NULL) {
@@ -726,8 +1279,13 @@ print_pgdir(void) {
     cprintf("-------------------- BEGIN --------------------\n");
     size_t left, right = 0, perm;
     while ((perm = get_pgtable_items(0, NPDEENTRY, right, vpd, &left, &right)) != 0) {
-        cprintf("PDE(%03x) %08x-%08x %08x %s\n", right - left,
-                left * PTSIZE, right * PTSIZE, (right - left) * PTSIZE, perm2str(perm));
+        cprintf("PDE(%03x) %08x-%08x %08x %s%s\n", right - left,
+                left * PTSIZE, right * PTSIZE, (right - left) * PTSIZE, perm2str(perm),
+                (perm & PTE_PS) ? " 4M" : "");
+        // 4MB pages have no page table to print
+        if (perm & PTE_PS) {
+            continue;
+        }
         size_t l, r = left * NPTEENTRY;
         while ((perm = get_pgtable_items(left * NPTEENTRY, right * NPTEENTRY, r, vpt, &l, &r)) != 0) {
             cprintf("  |-- PTE(%05x) %08x-%08x %08x %s\n", r - l,
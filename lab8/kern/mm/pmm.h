@@ -20,8 +20,16 @@ struct pmm_manager {
     void (*free_pages)(struct Page *base, size_t n);  // free >=n pages with "base" addr of Page descriptor structures(memlayout.h)
     size_t (*nr_free_pages)(void);                    // return the number of free pages 
     void (*check)(void);                              // check the correctness of XXX_pmm_manager 
+    struct Page *(*alloc_pages_zone)(size_t n, uint32_t zone_mask);
+                                                      // optional: allocate >=n pages from the zones in zone_mask,
+                                                      // managers without it keep all zones in one pool
 };
 
+// zone masks for alloc_pages_zone
+#define ZONE_MASK_DMA       (1 << ZONE_DMA)
+#define ZONE_MASK_NORMAL    (1 << ZONE_NORMAL)
+#define ZONE_MASK_ANY       (ZONE_MASK_DMA | ZONE_MASK_NORMAL)
+
 extern const struct pmm_manager *pmm_manager;
 extern pde_t *boot_pgdir;
 extern uintptr_t boot_cr3;
@@ -29,11 +37,19 @@ extern uintptr_t boot_cr3;
 void pmm_init(void);
 
 struct Page *alloc_pages(size_t n);
+struct Page *alloc_pages_zone(size_t n, uint32_t zone_mask);
 void free_pages(struct Page *base, size_t n);
+void drain_pcp(void);
 size_t nr_free_pages(void);
+void print_zoneinfo(void);
 
 #define alloc_page() alloc_pages(1)
 #define free_page(page) free_pages(page, 1)
+void free_page_cold(struct Page *page);
+
+#define HUGE_NPAGES                 (PTSIZE / PGSIZE)   // pages in a 4MB user page, one PDE with PTE_PS
+struct Page *alloc_huge_page(void);
+#define free_huge_page(page) free_pages(page, HUGE_NPAGES)
 
 pte_t *get_pte(pde_t *pgdir, uintptr_t la, bool create);
 struct Page *get_page(pde_t *pgdir, uintptr_t la, pte_t **ptep_store);
@@ -42,6 +58,32 @@ int page_insert(pde_t *pgdir, struct Page *page, uintptr_t la, uint32_t perm);
 
 void load_esp0(uintptr_t esp0);
 void tlb_invalidate(pde_t *pgdir, uintptr_t la);
+
+#define TLB_GATHER_MAX              32      // more pages than this are flushed by reloading cr3
+
+// the addresses whose ptes were changed by an operation on a range of pgdir, flushed
+// from the TLB together by tlb_finish
+struct tlb_gather {
+    pde_t *pgdir;
+    bool active;                            // pgdir is the one in cr3, else there is nothing to flush
+    int nr;                                 // addresses in la, TLB_GATHER_MAX + 1 for a full flush
+    uintptr_t la[TLB_GATHER_MAX];
+};
+
+// counters of TLB flushes, printed by print_tlb_stat
+struct tlb_stat {
+    size_t nr_invlpg;                       // invlpg instructions
+    size_t nr_flush;                        // full flushes by reloading cr3
+    size_t nr_cr3_skip;                     // switches between procs of the same pgdir without lcr3
+};
+
+extern struct tlb_stat tlb_stat;
+
+void tlb_gather_init(struct tlb_gather *tlb, pde_t *pgdir);
+void tlb_gather_add(struct tlb_gather *tlb, uintptr_t la);
+void tlb_finish(struct tlb_gather *tlb);
+void print_tlb_stat(void);
+
 struct Page *pgdir_alloc_page(pde_t *pgdir, uintptr_t la, uint32_t perm);
 void unmap_range(pde_t *pgdir, uintptr_t start, uintptr_t end);
 void exit_range(pde_t *pgdir, uintptr_t start, uintptr_t end);
@@ -88,6 +130,11 @@ page2pa(struct Page *page) {
     return page2ppn(page) << PGSHIFT;
 }
 
+static inline int
+page_zone(struct Page *page) {
+    return page2pa(page) < DMA_ZONE_END ? ZONE_DMA : ZONE_NORMAL;
+}
+
 static inline struct Page *
 pa2page(uintptr_t pa) {
     if (PPN(pa) >= npage) {
@@ -106,6 +153,33 @@ kva2page(void *kva) {
     return pa2page(PADDR(kva));
 }
 
+/* *
+ * A page table of a user pgdir counts its live (non-zero) ptes in property of its
+ * Page: page_insert and page_remove_pte keep the count, unmap_range frees the page
+ * table as soon as it drops to zero, and range walks skip page tables counting zero.
+ * */
+static inline unsigned int
+pt_live(struct Page *ptpage) {
+    return ptpage->property;
+}
+
+static inline void
+set_pt_live(struct Page *ptpage, unsigned int val) {
+    ptpage->property = val;
+}
+
+// pt_live_inc - a zero pte at ptep becomes live
+static inline void
+pt_live_inc(pte_t *ptep) {
+    kva2page(ptep)->property ++;
+}
+
+// pt_live_dec - the live pte at ptep becomes zero
+static inline void
+pt_live_dec(pte_t *ptep) {
+    kva2page(ptep)->property --;
+}
+
 static inline struct Page *
 pte2page(pte_t pte) {
     if (!(pte & PTE_P)) {
@@ -0,0 +1,573 @@
+#include <slub.h>
+#include <list.h>
+#include <defs.h>
+#include <string.h>
+#include <stdio.h>
+#include <sync.h>
+
+// slab分配算法采用cache存储内核对象。当创建cache时，起初包括若干标记为空闲的对象
+// 对象的数量与slab的大小有关。当需要内核数据结构的对象时，可以直接从cache上直接获取，并将对象初始化为使用
+// Slab是 2^order 个连续的物理页，分为三部分
+// Slab元数据slab_t、保存空闲信息的bufctl[num]以及可用内存区域buf[num][objsize]
+//
+// (ported from lab4) slab_t is kept at the head of the slab itself instead of
+// being overlaid on struct Page, and every page of a slab is marked PG_slab
+// with its index in the slab in property, so that the slab of any object is
+// found in O(1) from its address.
+
+struct slab_t {
+    struct kmem_cache_t *cachep;    // cache对象指针
+    uint16_t inuse;                 // 已经分配对象数目
+    int16_t free;                   // 下一个空闲对象下标，-1表示没有
+    list_entry_t slab_link;         // Slab链表
+};
+
+// a slab is at most 2^SLAB_MAX_ORDER pages, and grows up to that order as long
+// as more than 1/SLAB_WASTE_FRACTION of it is left unused
+#define SLAB_MAX_ORDER      3
+#define SLAB_WASTE_FRACTION 8
+#define SLAB_ALIGN          8
+
+#define le2slab(le, member)         to_struct((le), struct slab_t, member)
+#define slab_bufctl(slab)           ((int16_t *)((struct slab_t *)(slab) + 1))
+#define slab_obj(slab, cachep, i)   ((void *)(slab) + (cachep)->offset + (i) * (cachep)->objsize)
+
+struct kmem_magazine {
+    int rounds;                     // 弹匣中的对象数目
+    list_entry_t mag_link;          // depot链表
+    void *objs[MAGAZINE_SIZE];      // 对象栈，objs[rounds-1]是栈顶
+};
+
+#define le2mag(le, member)          to_struct((le), struct kmem_magazine, member)
+
+static list_entry_t cache_chain;
+static struct kmem_cache_t cache_cache;
+static char *cache_cache_name = "cache";
+// the magazines themselves come from mag_cache, which has no magazine layer
+static struct kmem_cache_t mag_cache;
+static char *mag_cache_name = "magazine";
+
+static void kmem_slab_free(struct kmem_cache_t *cachep, void *objp);
+static void kmem_cache_drain(struct kmem_cache_t *cachep);
+
+// kmem_cpu - id of the current CPU, ucore only runs on one
+static inline int
+kmem_cpu(void) {
+    return 0;
+}
+
+// obj2slab - find the slab that holds objp
+static inline struct slab_t *
+obj2slab(void *objp) {
+    struct Page *page = kva2page(objp);
+    assert(PageSlab(page));
+    return page2kva(page - page->property);
+}
+
+static size_t
+list_length(list_entry_t *listelm) {
+    size_t len = 0;
+    list_entry_t *le = listelm;
+    while ((le = list_next(le)) != listelm)
+        len ++;
+    return len;
+}
+
+// kmem_cache_estimate - layout of a slab of 2^order pages: how many objects of
+//                     - objsize fit after slab_t and their bufctl, and where they start
+static void
+kmem_cache_estimate(int order, size_t objsize, uint16_t *num, uint16_t *offset) {
+    size_t size = (PGSIZE << order), n = (size - sizeof(struct slab_t)) / (sizeof(int16_t) + objsize);
+    size_t off;
+    while ((off = ROUNDUP(sizeof(struct slab_t) + sizeof(int16_t) * n, SLAB_ALIGN)) + n * objsize > size) {
+        n --;
+    }
+    *num = n, *offset = off;
+}
+
+// kmem_cache_setup - choose the slab order and layout of a cache and init its lists
+static void
+kmem_cache_setup(struct kmem_cache_t *cachep, const char *name, size_t size,
+                       void (*ctor)(void*, struct kmem_cache_t *, size_t),
+                       void (*dtor)(void*, struct kmem_cache_t *, size_t)) {
+    size_t objsize = ROUNDUP(size, sizeof(long));
+    int order;
+    for (order = 0; order < SLAB_MAX_ORDER; order ++) {
+        kmem_cache_estimate(order, objsize, &(cachep->num), &(cachep->offset));
+        size_t waste = (PGSIZE << order) - cachep->offset - cachep->num * objsize;
+        if (cachep->num != 0 && waste * SLAB_WASTE_FRACTION <= (PGSIZE << order)) {
+            break;
+        }
+    }
+    if (order == SLAB_MAX_ORDER) {
+        kmem_cache_estimate(order, objsize, &(cachep->num), &(cachep->offset));
+    }
+    assert(cachep->num != 0);
+    cachep->objsize = objsize;
+    cachep->order = order;
+    cachep->ctor = ctor;
+    cachep->dtor = dtor;
+    strncpy(cachep->name, name, CACHE_NAMELEN - 1);
+    cachep->name[CACHE_NAMELEN - 1] = '\0';
+    list_init(&(cachep->slabs_full));
+    list_init(&(cachep->slabs_partial));
+    list_init(&(cachep->slabs_free));
+    cachep->flags = 0;
+    cachep->objects = cachep->peak_objects = cachep->nr_alloc = 0;
+    for (order = 0; order < KMEM_NCPU; order ++) {
+        cachep->cpu_cache[order].loaded = cachep->cpu_cache[order].previous = NULL;
+    }
+    list_init(&(cachep->depot_full));
+    list_init(&(cachep->depot_empty));
+}
+
+// 申请 2^order 页内存，初始化空闲链表bufctl，构造buf中的对象
+// 更新Slab元数据，最后将新的Slab加入到仓库的空闲Slab表中
+static struct slab_t *
+kmem_cache_grow(struct kmem_cache_t *cachep) {
+    struct Page *page = alloc_pages(1 << cachep->order);
+    if (page == NULL) {
+        return NULL;
+    }
+    int i;
+    for (i = 0; i < (1 << cachep->order); i ++) {
+        SetPageSlab(page + i);
+        page[i].property = i;
+    }
+    // Init slab meta data
+    struct slab_t *slab = page2kva(page);
+    slab->cachep = cachep;
+    slab->inuse = slab->free = 0;
+    // Init bufctl
+    int16_t *bufctl = slab_bufctl(slab);
+    for (i = 1; i < cachep->num; i++)
+        bufctl[i-1] = i;
+    bufctl[cachep->num-1] = -1;
+    // Init cache
+    if (cachep->ctor)
+        for (i = 0; i < cachep->num; i ++)
+            cachep->ctor(slab_obj(slab, cachep, i), cachep, cachep->objsize);
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    list_add(&(cachep->slabs_free), &(slab->slab_link));
+    local_intr_restore(intr_flag);
+    return slab;
+}
+
+// 析构buf中的对象后将内存页归还
+static void
+kmem_slab_destroy(struct kmem_cache_t *cachep, struct slab_t *slab) {
+    int i;
+    // Destruct cache
+    if (cachep->dtor)
+        for (i = 0; i < cachep->num; i ++)
+            cachep->dtor(slab_obj(slab, cachep, i), cachep, cachep->objsize);
+    // Return slab pages
+    list_del(&(slab->slab_link));
+    struct Page *page = kva2page(slab);
+    for (i = 0; i < (1 << cachep->order); i ++) {
+        ClearPageSlab(page + i);
+        page[i].property = 0;
+    }
+    free_pages(page, 1 << cachep->order);
+}
+
+// ! Test code
+#define TEST_OBJECT_LENTH 2046
+#define TEST_OBJECT_CTVAL 0x22
+#define TEST_OBJECT_DTVAL 0x11
+
+static const char *test_object_name = "test";
+
+struct test_object {
+    char test_member[TEST_OBJECT_LENTH];
+};
+
+static void
+test_ctor(void* objp, struct kmem_cache_t * cachep, size_t size) {
+    char *p = objp;
+    for (int i = 0; i < size; i++)
+        p[i] = TEST_OBJECT_CTVAL;
+}
+
+static void
+test_dtor(void* objp, struct kmem_cache_t * cachep, size_t size) {
+    char *p = objp;
+    for (int i = 0; i < size; i++)
+        p[i] = TEST_OBJECT_DTVAL;
+}
+
+#define TEST_OBJECT_MAX 32
+
+static void
+check_kmem(void) {
+    size_t fp;
+
+    // Create a cache
+    struct kmem_cache_t *cp0 = kmem_cache_create(test_object_name, sizeof(struct test_object), test_ctor, test_dtor);
+    assert(cp0 != NULL);
+    assert(kmem_cache_size(cp0) == ROUNDUP(sizeof(struct test_object), sizeof(long)));
+    assert(strcmp(kmem_cache_name(cp0), test_object_name) == 0);
+    int num = cp0->num, slab_pages = (1 << cp0->order);
+    // the slab of cache_cache holding cp0 is not given back below, nor is the
+    // slab of mag_cache until the final reap
+    kmem_cache_free(cp0, kmem_cache_alloc(cp0));
+    assert(kmem_cache_shrink(cp0) == 1);
+    fp = nr_free_pages();
+    assert(num >= 2 && num * 2 <= TEST_OBJECT_MAX);
+    // Allocate two full slabs of objects
+    struct test_object *objs[TEST_OBJECT_MAX];
+    char *p;
+    int i, j;
+    for (i = 0; i < num * 2 - 1; i ++) {
+        assert((objs[i] = kmem_cache_alloc(cp0)) != NULL);
+        assert(kmem_cache_of(objs[i]) == cp0);
+    }
+    p = (char *) objs[num];
+    for (j = 0; j < sizeof(struct test_object); j++)
+        assert(p[j] == TEST_OBJECT_CTVAL);
+    assert((objs[i] = kmem_cache_zalloc(cp0)) != NULL);
+    p = (char *) objs[i];
+    for (j = 0; j < sizeof(struct test_object); j++)
+        assert(p[j] == 0);
+    assert(nr_free_pages() + 2 * slab_pages == fp);
+    assert(list_empty(&(cp0->slabs_free)));
+    assert(list_empty(&(cp0->slabs_partial)));
+    assert(list_length(&(cp0->slabs_full)) == 2);
+    // Free the second slab and one object of the first one, they stay in the magazines
+    assert(num + 1 <= MAGAZINE_SIZE);
+    for (i = num - 1; i < num * 2; i ++)
+        kmem_cache_free(cp0, objs[i]);
+    assert(list_length(&(cp0->slabs_full)) == 2);
+    assert(cp0->cpu_cache[kmem_cpu()].loaded->rounds == num + 1);
+    // the magazine is a stack, the last object freed comes back first
+    assert(kmem_cache_alloc(cp0) == objs[num * 2 - 1]);
+    kmem_cache_free(cp0, objs[num * 2 - 1]);
+    // Shrink cache, which drains the magazines first
+    assert(kmem_cache_shrink(cp0) == 1);
+    assert(nr_free_pages() + slab_pages == fp);
+    assert(list_empty(&(cp0->slabs_free)));
+    assert(list_length(&(cp0->slabs_partial)) == 1);
+    assert(list_empty(&(cp0->slabs_full)));
+    p = (char *) objs[num];
+    for (j = 0; j < sizeof(struct test_object); j++)
+        assert(p[j] == TEST_OBJECT_DTVAL);
+    // Reap cache
+    for (i = 0; i < num - 1; i ++)
+        kmem_cache_free(cp0, objs[i]);
+    assert(kmem_cache_reap() >= 2);
+    assert(nr_free_pages() == fp + (1 << mag_cache.order));
+    // Destory a cache
+    kmem_cache_destroy(cp0);
+
+    cprintf("check_kmem() succeeded!\n");
+}
+// ! End of test code
+
+// 从cache_cache中获得一个kmem_cache_t，初始化成员，最后将它加入cache链表
+// 每个Slab的对象数目由kmem_cache_estimate决定：slab_t之后是每个对象2字节的bufctl，再之后是对象
+struct kmem_cache_t *
+kmem_cache_create(const char *name, size_t size,
+                       void (*ctor)(void*, struct kmem_cache_t *, size_t),
+                       void (*dtor)(void*, struct kmem_cache_t *, size_t)) {
+    assert(size > 0 && size <= PGSIZE);
+    struct kmem_cache_t *cachep = kmem_cache_alloc(&(cache_cache));
+    if (cachep != NULL) {
+        kmem_cache_setup(cachep, name, size, ctor, dtor);
+        bool intr_flag;
+        local_intr_save(intr_flag);
+        list_add(&(cache_chain), &(cachep->cache_link));
+        local_intr_restore(intr_flag);
+    }
+    return cachep;
+}
+
+// 释放cache中所有的Slab，释放kmem_cache_t
+void
+kmem_cache_destroy(struct kmem_cache_t *cachep) {
+    list_entry_t *heads[] = {&(cachep->slabs_full), &(cachep->slabs_partial), &(cachep->slabs_free)};
+    bool intr_flag;
+    int i;
+    kmem_cache_drain(cachep);
+    local_intr_save(intr_flag);
+    {
+        list_del(&(cachep->cache_link));
+        for (i = 0; i < sizeof(heads) / sizeof(heads[0]); i ++) {
+            list_entry_t *le;
+            while ((le = list_next(heads[i])) != heads[i]) {
+                kmem_slab_destroy(cachep, le2slab(le, slab_link));
+            }
+        }
+    }
+    local_intr_restore(intr_flag);
+    // Free kmem_cache
+    kmem_cache_free(&(cache_cache), cachep);
+}
+
+// 先查找slabs_partial，如果没找到空闲区域则查找slabs_free，还是没找到就申请一个新的slab
+// 从slab分配一个对象后，如果slab变满，那么将slab加入slabs_full
+static void *
+kmem_slab_alloc(struct kmem_cache_t *cachep) {
+    list_entry_t *le = NULL;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    // Grow with interrupts on, alloc_pages may have to swap out
+    while (list_empty(&(cachep->slabs_partial)) && list_empty(&(cachep->slabs_free))) {
+        local_intr_restore(intr_flag);
+        if (kmem_cache_grow(cachep) == NULL)
+            return NULL;
+        local_intr_save(intr_flag);
+    }
+    // Find in partial list first, then in empty list
+    if (!list_empty(&(cachep->slabs_partial)))
+        le = list_next(&(cachep->slabs_partial));
+    else
+        le = list_next(&(cachep->slabs_free));
+    // Alloc
+    list_del(le);
+    struct slab_t *slab = le2slab(le, slab_link);
+    int16_t *bufctl = slab_bufctl(slab);
+    void *objp = slab_obj(slab, cachep, slab->free);
+    // Update slab
+    slab->inuse ++;
+    slab->free = bufctl[slab->free];
+    if (slab->inuse == cachep->num)
+        list_add(&(cachep->slabs_full), le);
+    else
+        list_add(&(cachep->slabs_partial), le);
+    local_intr_restore(intr_flag);
+    return objp;
+}
+
+// kmem_depot_get - take a magazine out of one of the depot lists of cachep
+static struct kmem_magazine *
+kmem_depot_get(list_entry_t *depot) {
+    struct kmem_magazine *mag = NULL;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    if (!list_empty(depot)) {
+        list_entry_t *le = list_next(depot);
+        list_del(le);
+        mag = le2mag(le, mag_link);
+    }
+    local_intr_restore(intr_flag);
+    return mag;
+}
+
+// kmem_depot_put - hand a magazine back to the depot, full or empty
+static void
+kmem_depot_put(struct kmem_cache_t *cachep, struct kmem_magazine *mag) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    list_add(mag->rounds != 0 ? &(cachep->depot_full) : &(cachep->depot_empty), &(mag->mag_link));
+    local_intr_restore(intr_flag);
+}
+
+// The magazines of a CPU are only used by that CPU, and ucore neither preempts
+// the kernel nor allocates kernel objects from interrupt handlers, so the fast
+// paths below run with interrupts on. Only the depot is shared.
+
+// 先从当前CPU的loaded弹匣取对象，loaded为空而previous满时交换两者，
+// 两者都空时用previous向depot换一个满弹匣，depot也没有满弹匣才从Slab分配
+void *
+kmem_cache_alloc(struct kmem_cache_t *cachep) {
+    void *objp = NULL;
+    if (!(cachep->flags & KMEM_CACHE_NOMAG)) {
+        struct kmem_cpu_cache *cc = &(cachep->cpu_cache[kmem_cpu()]);
+        struct kmem_magazine *mag;
+        while (1) {
+            if (cc->loaded != NULL && cc->loaded->rounds > 0) {
+                objp = cc->loaded->objs[-- cc->loaded->rounds];
+                break;
+            }
+            if (cc->previous != NULL && cc->previous->rounds > 0) {
+                mag = cc->loaded, cc->loaded = cc->previous, cc->previous = mag;
+                continue;
+            }
+            if ((mag = kmem_depot_get(&(cachep->depot_full))) == NULL)
+                break;
+            if (cc->previous != NULL)
+                kmem_depot_put(cachep, cc->previous);
+            cc->previous = cc->loaded, cc->loaded = mag;
+        }
+    }
+    if (objp == NULL && (objp = kmem_slab_alloc(cachep)) == NULL)
+        return NULL;
+    if (++ cachep->objects > cachep->peak_objects)
+        cachep->peak_objects = cachep->objects;
+    cachep->nr_alloc ++;
+    return objp;
+}
+
+// 将对象放入当前CPU的loaded弹匣，loaded已满而previous为空时交换两者，
+// 两者都满时把previous交给depot，再换上一个空弹匣（depot没有就新分配一个）
+// 连空弹匣都分配不到时才将对象还给Slab
+void
+kmem_cache_free(struct kmem_cache_t *cachep, void *objp) {
+    cachep->objects --;
+    if (!(cachep->flags & KMEM_CACHE_NOMAG)) {
+        struct kmem_cpu_cache *cc = &(cachep->cpu_cache[kmem_cpu()]);
+        struct kmem_magazine *mag;
+        while (1) {
+            if (cc->loaded != NULL && cc->loaded->rounds < MAGAZINE_SIZE) {
+                cc->loaded->objs[cc->loaded->rounds ++] = objp;
+                return;
+            }
+            if (cc->previous != NULL && cc->previous->rounds == 0) {
+                mag = cc->loaded, cc->loaded = cc->previous, cc->previous = mag;
+                continue;
+            }
+            if ((mag = kmem_depot_get(&(cachep->depot_empty))) == NULL) {
+                if ((mag = kmem_slab_alloc(&mag_cache)) == NULL)
+                    break;
+                mag->rounds = 0;
+            }
+            if (cc->previous != NULL)
+                kmem_depot_put(cachep, cc->previous);
+            cc->previous = cc->loaded, cc->loaded = mag;
+        }
+    }
+    kmem_slab_free(cachep, objp);
+}
+
+// kmem_cache_drain - give the objects in every magazine of cachep back to their
+//                  - slabs and free the magazines. Taking the magazines of the
+//                  - other CPUs away is only safe because there are none.
+static void
+kmem_cache_drain(struct kmem_cache_t *cachep) {
+    struct kmem_magazine *mag;
+    int i;
+    for (i = 0; i < KMEM_NCPU; i ++) {
+        struct kmem_cpu_cache *cc = &(cachep->cpu_cache[i]);
+        if (cc->loaded != NULL)
+            kmem_depot_put(cachep, cc->loaded);
+        if (cc->previous != NULL)
+            kmem_depot_put(cachep, cc->previous);
+        cc->loaded = cc->previous = NULL;
+    }
+    while ((mag = kmem_depot_get(&(cachep->depot_full))) != NULL
+            || (mag = kmem_depot_get(&(cachep->depot_empty))) != NULL) {
+        while (mag->rounds > 0)
+            kmem_slab_free(cachep, mag->objs[-- mag->rounds]);
+        kmem_slab_free(&mag_cache, mag);
+    }
+}
+
+// 使用kmem_cache_alloc分配一个对象之后将对象内存区域初始化为零
+void *
+kmem_cache_zalloc(struct kmem_cache_t *cachep) {
+    void *objp = kmem_cache_alloc(cachep);
+    if (objp != NULL)
+        memset(objp, 0, cachep->objsize);
+    return objp;
+}
+
+// 将对象从Slab中释放，也就是将对象空间加入空闲链表，更新Slab元信息
+// 如果Slab变空，那么将Slab加入slabs_free链表，否则加入slabs_partial链表
+static void
+kmem_slab_free(struct kmem_cache_t *cachep, void *objp) {
+    // Get slab of object
+    struct slab_t *slab = obj2slab(objp);
+    assert(slab->cachep == cachep);
+    // Get offset in slab
+    int16_t *bufctl = slab_bufctl(slab);
+    int offset = (objp - slab_obj(slab, cachep, 0)) / cachep->objsize;
+    assert(objp == slab_obj(slab, cachep, offset));
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        // Update slab
+        list_del(&(slab->slab_link));
+        bufctl[offset] = slab->free;
+        slab->inuse --;
+        slab->free = offset;
+        if (slab->inuse == 0)
+            list_add(&(cachep->slabs_free), &(slab->slab_link));
+        else
+            list_add(&(cachep->slabs_partial), &(slab->slab_link));
+    }
+    local_intr_restore(intr_flag);
+}
+
+// 获得仓库中对象的大小
+size_t
+kmem_cache_size(struct kmem_cache_t *cachep) {
+    return cachep->objsize;
+}
+
+// 获得cache的名称
+const char *
+kmem_cache_name(struct kmem_cache_t *cachep) {
+    return cachep->name;
+}
+
+// 获得对象所在的cache，objp必须是kmem_cache_alloc分配的对象
+struct kmem_cache_t *
+kmem_cache_of(void *objp) {
+    return obj2slab(objp)->cachep;
+}
+
+// 将cache中slabs_free中所有Slab释放
+static int
+kmem_slab_shrink(struct kmem_cache_t *cachep) {
+    int count = 0;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        list_entry_t *le;
+        while ((le = list_next(&(cachep->slabs_free))) != &(cachep->slabs_free)) {
+            kmem_slab_destroy(cachep, le2slab(le, slab_link));
+            count ++;
+        }
+    }
+    local_intr_restore(intr_flag);
+    return count;
+}
+
+// 先清空cache的弹匣，再释放slabs_free中所有Slab
+int
+kmem_cache_shrink(struct kmem_cache_t *cachep) {
+    kmem_cache_drain(cachep);
+    return kmem_slab_shrink(cachep);
+}
+
+// 遍历cache链表，对每一个cache进行kmem_cache_shrink操作
+// 所有cache的弹匣都清空之后再释放Slab，这样mag_cache的Slab也能被释放
+int
+kmem_cache_reap(void) {
+    int count = 0;
+    list_entry_t *le = &(cache_chain);
+    while ((le = list_next(le)) != &(cache_chain))
+        kmem_cache_drain(to_struct(le, struct kmem_cache_t, cache_link));
+    while ((le = list_next(le)) != &(cache_chain))
+        count += kmem_slab_shrink(to_struct(le, struct kmem_cache_t, cache_link));
+    return count;
+}
+
+// kmem_cache_dump - print the usage of every cache
+void
+kmem_cache_dump(void) {
+    cprintf("kmem caches:\n  %-16s %6s %8s %8s %10s %6s\n", "name", "size", "objects", "peak", "allocs", "pages");
+    list_entry_t *le = &(cache_chain);
+    while ((le = list_next(le)) != &(cache_chain)) {
+        struct kmem_cache_t *cachep = to_struct(le, struct kmem_cache_t, cache_link);
+        size_t nslabs = list_length(&(cachep->slabs_full)) + list_length(&(cachep->slabs_partial))
+            + list_length(&(cachep->slabs_free));
+        cprintf("  %-16s %6u %8u %8u %10u %6u\n", cachep->name, cachep->objsize, cachep->objects,
+                cachep->peak_objects, cachep->nr_alloc, nslabs << cachep->order);
+    }
+}
+
+void
+kmem_cache_init(void) {
+    // 初始化kmem_cache_t
+    kmem_cache_setup(&cache_cache, cache_cache_name, sizeof(struct kmem_cache_t), NULL, NULL);
+    kmem_cache_setup(&mag_cache, mag_cache_name, sizeof(struct kmem_magazine), NULL, NULL);
+    cache_cache.flags = mag_cache.flags = KMEM_CACHE_NOMAG;
+    list_init(&(cache_chain));
+    list_add(&(cache_chain), &(cache_cache.cache_link));
+    list_add(&(cache_chain), &(mag_cache.cache_link));
+
+    check_kmem();
+}
+
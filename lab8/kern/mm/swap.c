@@ -1,13 +1,20 @@
 #include <swap.h>
 #include <swapfs.h>
 #include <swap_fifo.h>
+#include <swap_clock.h>
+#include <swap_aging.h>
+#include <swap_lru.h>
+#include <swap_slot.h>
+#include <swap_cache.h>
+#include <kswapd.h>
 #include <stdio.h>
 #include <string.h>
 #include <memlayout.h>
 #include <pmm.h>
 #include <mmu.h>
-#include <default_pmm.h>
 #include <kdebug.h>
+#include <error.h>
+#include <x86.h>
 
 // the valid vaddr for check is between 0~CHECK_VALID_VADDR-1
 #define CHECK_VALID_VIR_PAGE_NUM 5
@@ -18,16 +25,24 @@
 // the max access seq number
 #define MAX_SEQ_NO 10
 
+// SWAP_MANAGER selects the swap manager at build time, see SWAP in the Makefile
+#ifndef SWAP_MANAGER
+#define SWAP_MANAGER                swap_manager_fifo
+#endif
+
 static struct swap_manager *sm;
 size_t max_swap_offset;
 
 volatile int swap_init_ok = 0;
+volatile bool swap_quiet = 0;
 
 unsigned int swap_page[CHECK_VALID_VIR_PAGE_NUM];
 
 unsigned int swap_in_seq_no[MAX_SEQ_NO],swap_out_seq_no[MAX_SEQ_NO];
 
 static void check_swap(void);
+static void check_swap_cluster(void);
+static void bench_swap_manager(void);
 
 int
 swap_init(void)
@@ -38,9 +53,11 @@ swap_init(void)
      {
           panic("bad max_swap_offset %08x.\n", max_swap_offset);
      }
+     swap_cache_init();
+     swap_slot_init();
      
 
-     sm = &swap_manager_fifo;
+     sm = &SWAP_MANAGER;
      int r = sm->init();
      
      if (r == 0)
@@ -48,6 +65,8 @@ swap_init(void)
           swap_init_ok = 1;
           cprintf("SWAP: manager = %s\n", sm->name);
           check_swap();
+          check_swap_cluster();
+          bench_swap_manager();
      }
 
      return r;
@@ -59,6 +78,19 @@ swap_init_mm(struct mm_struct *mm)
      return sm->init_mm(mm);
 }
 
+int
+swap_exit_mm(struct mm_struct *mm)
+{
+     return sm->exit_mm(mm);
+}
+
+void
+swap_remove_page(struct Page *page)
+{
+     sm->remove_page(page);
+     ClearPageSwappable(page);
+}
+
 int
 swap_tick_event(struct mm_struct *mm)
 {
@@ -68,7 +100,11 @@ swap_tick_event(struct mm_struct *mm)
 int
 swap_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int swap_in)
 {
-     return sm->map_swappable(mm, addr, page, swap_in);
+     int r = sm->map_swappable(mm, addr, page, swap_in);
+     if (r == 0) {
+          SetPageSwappable(page);
+     }
+     return r;
 }
 
 int
@@ -77,62 +113,260 @@ swap_set_unswappable(struct mm_struct *mm, uintptr_t addr)
      return sm->set_unswappable(mm, addr);
 }
 
+// swap_page_referenced - PTE_A and PTE_D of the pte which maps page in the mm which
+//                      - owns it (see page_mm), 0 if no mm maps it. With clear, PTE_A is
+//                      - cleared and the TLB entry dropped, so that the next access sets it again.
+uint32_t
+swap_page_referenced(struct Page *page, bool clear)
+{
+     pte_t *ptep;
+     struct mm_struct *mm = page_mm(page, &ptep);
+     if (mm == NULL) {
+          return 0;
+     }
+     uint32_t bits = *ptep & (PTE_A | PTE_D);
+     if (clear && (bits & PTE_A)) {
+          *ptep &= ~PTE_A;
+          tlb_invalidate(mm->pgdir, page->pra_vaddr);
+     }
+     return bits;
+}
+
 volatile unsigned int swap_out_num=0;
 
+// the victims of swap_out bound for consecutive slots, written by one disk command
+struct swap_cluster {
+     swap_entry_t first;                           // the slot of pages[0]
+     int nr;
+     struct Page *pages[SWAPFS_MAX_PAGES];
+     pte_t *pteps[SWAPFS_MAX_PAGES];               // the pte which maps each page
+     struct mm_struct *owners[SWAPFS_MAX_PAGES];   // the mm of that pte (page_mm)
+     bool flush[SWAPFS_MAX_PAGES];                 // the pte is in the mm of cr3
+};
+
+// swap_write_cluster - write the pages of cluster out with one command, and put the
+//                    - swap entries into their ptes; returns the number of pages freed.
+//                    - If the write fails, each page goes back to the queue of its owner.
+static int
+swap_write_cluster(struct swap_cluster *cluster, struct tlb_gather *tlb, int i)
+{
+     int k, n = cluster->nr;
+     cluster->nr = 0;
+     if (n == 0) {
+          return 0;
+     }
+     if (swapfs_write_pages(cluster->first, cluster->pages, n) != 0) {
+          cprintf("SWAP: failed to save\n");
+          for (k = 0; k < n; k ++) {
+               swap_free(cluster->first + (k << 8));
+               swap_map_swappable(cluster->owners[k], cluster->pages[k]->pra_vaddr, cluster->pages[k], 0);
+          }
+          return 0;
+     }
+     swap_cache_stat.nr_write ++;
+     swap_cache_stat.nr_write_pages += n;
+     for (k = 0; k < n; k ++) {
+          struct Page *page = cluster->pages[k];
+          swap_entry_t entry = cluster->first + (k << 8);
+          uintptr_t v = page->pra_vaddr;
+          if (check_mm_struct != NULL && !swap_quiet) {
+               cprintf("swap_out: i %d, store page in vaddr 0x%x to disk swap entry %d\n", i + k, v, swap_offset(entry));
+          }
+          *(cluster->pteps[k]) = entry;
+          if (cluster->flush[k]) {
+               tlb_gather_add(tlb, v);
+          }
+          free_page_cold(page);
+     }
+     return n;
+}
+
+/* *
+ * swap_out - write out up to n victims picked by the swap manager, returns the number
+ * of pages freed. The victims may belong to any mm: the one which maps a victim is
+ * found by page_mm, and mm is only handed on to the swap manager (it is NULL unless
+ * check_swap runs). A victim stays in memory when it is shared copy-on-write since
+ * fork (the ptes of the other mm would still map the frame), when its mm is locked
+ * (lock_mm) or when no mm maps it; it goes back to the swap manager under its owner,
+ * which is NULL for the last case (the FIFO manager keeps those as orphans).
+ *
+ * swap_alloc hands the slots of a free run out in order, so the victims of one call
+ * mostly get consecutive slots: they are gathered into clusters of up to
+ * SWAPFS_MAX_PAGES pages, each written by a single disk command. Nothing runs
+ * between picking a victim and writing its cluster, the ptes still map the pages
+ * meanwhile.
+ * */
 int
 swap_out(struct mm_struct *mm, int n, int in_tick)
 {
-     int i;
+     int i, nr_freed = 0;
+     // the victims of the mm in cr3 are flushed from the TLB together at the end, no
+     // one runs in it meanwhile; any other mm gets a full flush when cr3 is loaded
+     struct tlb_gather tlb;
+     tlb_gather_init(&tlb, (pde_t *)KADDR(rcr3()));
+     struct swap_cluster cluster;
+     cluster.nr = 0;
      for (i = 0; i != n; ++ i)
      {
           uintptr_t v;
-          //struct Page **ptr_page=NULL;
           struct Page *page;
-          // cprintf("i %d, SWAP: call swap_out_victim\n",i);
           int r = sm->swap_out_victim(mm, &page, in_tick);
           if (r != 0) {
-                    cprintf("i %d, swap_out: call swap_out_victim failed\n",i);
+                  // nothing left in the swap manager
                   break;
           }          
           //assert(!PageReserved(page));
+          ClearPageSwappable(page);
 
           //cprintf("SWAP: choose victim page 0x%08x\n", page);
           
           v=page->pra_vaddr; 
-          pte_t *ptep = get_pte(mm->pgdir, v, 0);
-          assert((*ptep & PTE_P) != 0);
-
-          if (swapfs_write( (page->pra_vaddr/PGSIZE+1)<<8, page) != 0) {
-                    cprintf("SWAP: failed to save\n");
-                    sm->map_swappable(mm, v, page, 0);
+          pte_t *ptep;
+          struct mm_struct *owner = page_mm(page, &ptep);
+          if (owner == NULL || owner->mm_sem.value <= 0 || page_ref(page) > 1) {
+                    swap_map_swappable(owner, v, page, 0);
                     continue;
           }
-          else {
-                    cprintf("swap_out: i %d, store page in vaddr 0x%x to disk swap entry %d\n", i, v, page->pra_vaddr/PGSIZE+1);
-                    *ptep = (page->pra_vaddr/PGSIZE+1)<<8;
-                    free_page(page);
+          swap_entry_t entry = swap_alloc();
+          if (entry == 0) {
+                    cprintf("SWAP: no free swap slot\n");
+                    swap_map_swappable(owner, v, page, 0);
+                    break;
           }
-          
-          tlb_invalidate(mm->pgdir, v);
+          if (cluster.nr == SWAPFS_MAX_PAGES || (cluster.nr != 0 && entry != cluster.first + (cluster.nr << 8))) {
+                    nr_freed += swap_write_cluster(&cluster, &tlb, nr_freed);
+          }
+          if (cluster.nr == 0) {
+                    cluster.first = entry;
+          }
+          cluster.pages[cluster.nr] = page;
+          cluster.pteps[cluster.nr] = ptep;
+          cluster.owners[cluster.nr] = owner;
+          cluster.flush[cluster.nr] = (owner->pgdir == tlb.pgdir);
+          cluster.nr ++;
      }
-     return i;
+     nr_freed += swap_write_cluster(&cluster, &tlb, nr_freed);
+     tlb_finish(&tlb);
+     return nr_freed;
 }
 
+// swap_ra_slot - pte, k pages away from the pte of entry, holds the slot k slots away
+//              - and its page is not in memory yet
+static inline bool
+swap_ra_slot(pte_t pte, swap_entry_t entry, int k)
+{
+     return pte != 0 && !(pte & PTE_P) && (pte >> 8) == (entry >> 8) + k
+          && swap_cache_lookup(pte) == NULL;
+}
+
+/* *
+ * swap_readahead - read the slot of the swap entry in *ptep, the pte of addr, into
+ * page. The slots which follow and precede it on the disk are read by the same
+ * command while they hold the pages next to addr in the same vma and page table, up
+ * to SWAPFS_MAX_PAGES in all; those pages go to the swap cache. There is no read
+ * ahead when memory runs low, it would only make reclaim swap other pages out.
+ * */
+static int
+swap_readahead(struct mm_struct *mm, uintptr_t addr, pte_t *ptep, struct Page *page)
+{
+     struct Page *pages[SWAPFS_MAX_PAGES];
+     swap_entry_t entry = *ptep;
+     int before = 0, after = 0, k, r;
+     if (nr_free_pages() >= KSWAPD_HIGH + SWAPFS_MAX_PAGES) {
+          struct vma_struct *vma = find_vma(mm, addr);
+          assert(vma != NULL);
+          uintptr_t start = ROUNDDOWN(addr, PTSIZE), end = start + PTSIZE;
+          if (start < vma->vm_start) {
+               start = vma->vm_start;
+          }
+          if (end > vma->vm_end) {
+               end = vma->vm_end;
+          }
+          while (before + after + 1 < SWAPFS_MAX_PAGES && end - addr > (after + 1) * PGSIZE
+                    && swap_ra_slot(ptep[after + 1], entry, after + 1)) {
+               after ++;
+          }
+          while (before + after + 1 < SWAPFS_MAX_PAGES && addr - start >= (before + 1) * PGSIZE
+                    && swap_ra_slot(ptep[-(before + 1)], entry, -(before + 1))) {
+               before ++;
+          }
+     }
+     for (k = 0; k < before + after + 1; k ++) {
+          if (k == before) {
+               pages[k] = page;
+          }
+          else if ((pages[k] = alloc_page()) == NULL) {
+               // read the page of addr alone
+               while (-- k >= 0) {
+                    if (k != before) {
+                         free_page(pages[k]);
+                    }
+               }
+               pages[0] = page, before = after = 0;
+               break;
+          }
+     }
+     int nr = before + after + 1;
+     swap_entry_t first = entry - (before << 8);
+     if ((r = swapfs_read_pages(first, pages, nr)) != 0) {
+          for (k = 0; k < nr; k ++) {
+               if (k != before) {
+                    free_page(pages[k]);
+               }
+          }
+          return r;
+     }
+     swap_cache_stat.nr_read ++;
+     swap_cache_stat.nr_read_pages += nr;
+     for (k = 0; k < nr; k ++) {
+          if (k != before) {
+               swap_cache_add(first + (k << 8), pages[k]);
+          }
+     }
+     return 0;
+}
+
+/* *
+ * swap_in - the page of the swap entry in the pte of addr, from the swap cache or
+ * from the disk. A cached copy is taken as it is when the pte is the last to hold
+ * the slot, and copied otherwise: the other ptes may still find it.
+ * */
 int
 swap_in(struct mm_struct *mm, uintptr_t addr, struct Page **ptr_result)
 {
-     struct Page *result = alloc_page();
-     assert(result!=NULL);
-
      pte_t *ptep = get_pte(mm->pgdir, addr, 0);
+     swap_entry_t entry = *ptep;
+     struct Page *result, *cached;
      // cprintf("SWAP: load ptep %x swap entry %d to vaddr 0x%08x, page %x, No %d\n", ptep, (*ptep)>>8, addr, result, (result-pages));
     
-     int r;
-     if ((r = swapfs_read((*ptep), result)) != 0)
-     {
-        assert(r!=0);
+     if ((cached = swap_cache_lookup(entry)) != NULL && swap_count(entry) == 1) {
+          swap_cache_del(cached);
+          result = cached;
+          swap_cache_stat.nr_hit ++;
+     }
+     else {
+          if ((result = alloc_page()) == NULL) {
+               return -E_NO_MEM;
+          }
+          // reclaim in alloc_page may have dropped the cached copy
+          if ((cached = swap_cache_lookup(entry)) != NULL) {
+               memcpy(page2kva(result), page2kva(cached), PGSIZE);
+               swap_cache_stat.nr_hit ++;
+          }
+          else {
+               int r;
+               if ((r = swap_readahead(mm, addr, ptep, result)) != 0)
+               {
+                  free_page(result);
+                  return r;
+               }
+          }
      }
-     cprintf("swap_in: load disk swap entry %d with swap_page in vadr 0x%x\n", (*ptep)>>8, addr);
+     if (check_mm_struct != NULL && !swap_quiet) {
+          cprintf("swap_in: load disk swap entry %d with swap_page in vadr 0x%x\n", entry>>8, addr);
+     }
+     // the pte gets the page in place of the entry, other ptes may still hold it
+     swap_free(entry);
      *ptr_result=result;
      return 0;
 }
@@ -171,24 +405,13 @@ struct Page * check_rp[CHECK_VALID_PHY_PAGE_NUM];
 pte_t * check_ptep[CHECK_VALID_PHY_PAGE_NUM];
 unsigned int check_swap_addr[CHECK_VALID_VIR_PAGE_NUM];
 
-extern free_area_t free_area;
-
-#define free_list (free_area.free_list)
-#define nr_free (free_area.nr_free)
-
 static void
 check_swap(void)
 {
     //backup mem env
-     int ret, count = 0, total = 0, i;
-     list_entry_t *le = &free_list;
-     while ((le = list_next(le)) != &free_list) {
-        struct Page *p = le2page(le, page_link);
-        assert(PageProperty(p));
-        count ++, total += p->property;
-     }
-     assert(total == nr_free_pages());
-     cprintf("BEGIN check_swap: count %d, total %d\n",count,total);
+     int ret, i;
+     size_t total = nr_free_pages();
+     cprintf("BEGIN check_swap: total %d\n",total);
      
      //now we set the phy pages env     
      struct mm_struct *mm = mm_create();
@@ -198,6 +421,8 @@ check_swap(void)
      assert(check_mm_struct == NULL);
 
      check_mm_struct = mm;
+     // check_content_access counts every fault
+     mm->fault_around = 1;
 
      pde_t *pgdir = mm->pgdir = boot_pgdir;
      assert(pgdir[0] == 0);
@@ -219,18 +444,24 @@ check_swap(void)
           assert(check_rp[i] != NULL );
           assert(!PageProperty(check_rp[i]));
      }
-     list_entry_t free_list_store = free_list;
-     list_init(&free_list);
-     assert(list_empty(&free_list));
+     // hold every other free page aside, whatever the pmm_manager is, so that
+     // only the CHECK_VALID_PHY_PAGE_NUM pages freed below can be handed out
+     list_entry_t hoard;
+     list_init(&hoard);
+     size_t nr_hoard = nr_free_pages();
+     for (i=0;i<nr_hoard;i++) {
+          struct Page *p = alloc_page();
+          assert(p != NULL);
+          list_add(&hoard, &(p->page_link));
+     }
+     assert(nr_free_pages()==0);
      
      //assert(alloc_page() == NULL);
      
-     unsigned int nr_free_store = nr_free;
-     nr_free = 0;
      for (i=0;i<CHECK_VALID_PHY_PAGE_NUM;i++) {
         free_pages(check_rp[i],1);
      }
-     assert(nr_free==CHECK_VALID_PHY_PAGE_NUM);
+     assert(nr_free_pages()==CHECK_VALID_PHY_PAGE_NUM);
      
      cprintf("set up init env for check_swap begin!\n");
      //setup initial vir_page<->phy_page environment for page relpacement algorithm 
@@ -239,7 +470,7 @@ check_swap(void)
      pgfault_num=0;
      
      check_content_set();
-     assert( nr_free == 0);         
+     assert(nr_free_pages() == 0);         
      for(i = 0; i<MAX_SEQ_NO ; i++) 
          swap_out_seq_no[i]=swap_in_seq_no[i]=-1;
      
@@ -252,9 +483,23 @@ check_swap(void)
          assert((*check_ptep[i] & PTE_P));          
      }
      cprintf("set up init env for check_swap over!\n");
+     // a new mm, as fork and exec make, leaves the pages of this one where they are
+     struct mm_struct *other = mm_create();
+     assert(other != NULL);
+     mm_destroy(other);
      // now access the virt pages to test  page relpacement algorithm 
      ret=check_content_access();
      assert(ret==0);
+
+     // the pages which are on the disk now give their slots back
+     for (i = BEING_CHECK_VALID_VADDR; i < CHECK_VALID_VADDR; i += PGSIZE) {
+         pte_t *ptep = get_pte(pgdir, i, 0);
+         if (*ptep != 0 && !(*ptep & PTE_P)) {
+             swap_free(*ptep);
+             *ptep = 0;
+         }
+     }
+     assert(swap_slot_stat.nr_used == 0);
      
      //restore kernel mem env
      for (i=0;i<CHECK_VALID_PHY_PAGE_NUM;i++) {
@@ -268,17 +513,204 @@ check_swap(void)
      mm_destroy(mm);
      check_mm_struct = NULL;
      
-     nr_free = nr_free_store;
-     free_list = free_list_store;
-
-     
-     le = &free_list;
-     while ((le = list_next(le)) != &free_list) {
-         struct Page *p = le2page(le, page_link);
-         count --, total -= p->property;
+     list_entry_t *le;
+     while ((le = list_next(&hoard)) != &hoard) {
+         list_del(le);
+         free_page(le2page(le, page_link));
      }
-     cprintf("count is %d, total is %d\n",count,total);
-     //assert(count == 0);
+     
+     cprintf("total is %d, now %d\n",total,nr_free_pages());
+     // every page the check took, the frames, the page table and the hoard, is back
+     assert(total == nr_free_pages());
      
      cprintf("check_swap() succeeded!\n");
 }
+
+#define CHECK_CLUSTER_PAGES         SWAPFS_MAX_PAGES
+#define CHECK_CLUSTER_VADDR         0x1000
+
+// check_swap_cluster - pages swapped out together are written by one disk command per
+//                    - run of consecutive slots, and read back by as many, the faults on
+//                    - the other pages are served by the swap cache
+static void
+check_swap_cluster(void)
+{
+     struct mm_struct *mm = mm_create();
+     assert(mm != NULL && check_mm_struct == NULL);
+     check_mm_struct = mm;
+     mm->fault_around = 1;
+     pde_t *pgdir = mm->pgdir = boot_pgdir;
+     assert(pgdir[0] == 0);
+     struct vma_struct *vma = vma_create(CHECK_CLUSTER_VADDR, CHECK_CLUSTER_VADDR + CHECK_CLUSTER_PAGES * PGSIZE, VM_WRITE | VM_READ);
+     assert(vma != NULL);
+     insert_vma_struct(mm, vma);
+
+     swap_quiet = 1;
+     int i;
+     for (i = 0; i < CHECK_CLUSTER_PAGES; i ++) {
+          *(volatile uint32_t *)(CHECK_CLUSTER_VADDR + i * PGSIZE) = i;
+     }
+     struct swap_cache_stat stat = swap_cache_stat;
+     assert(swap_out(mm, CHECK_CLUSTER_PAGES, 0) == CHECK_CLUSTER_PAGES);
+     // a run of SWAP_CLUSTER slots may end among them
+     int nr_write = swap_cache_stat.nr_write - stat.nr_write;
+     assert(nr_write <= 2 && swap_cache_stat.nr_write_pages - stat.nr_write_pages == CHECK_CLUSTER_PAGES);
+
+     // a page which is read ahead is shared as if by fork: its cached copy is
+     // copied, and stays
+     pte_t *ptep = get_pte(pgdir, CHECK_CLUSTER_VADDR, 0);
+     for (i = CHECK_CLUSTER_PAGES - 1; ptep[i] != ptep[i - 1] + (1 << 8); i --) {
+          assert(i > 1);
+     }
+     swap_entry_t shared = ptep[i];
+     assert(swap_dup(shared) == 0);
+     for (i = 0; i < CHECK_CLUSTER_PAGES; i ++) {
+          assert(*(volatile uint32_t *)(CHECK_CLUSTER_VADDR + i * PGSIZE) == i);
+     }
+     assert(swap_cache_stat.nr_read - stat.nr_read == nr_write);
+     assert(swap_cache_stat.nr_read_pages - stat.nr_read_pages == CHECK_CLUSTER_PAGES);
+     assert(swap_cache_stat.nr_hit - stat.nr_hit == CHECK_CLUSTER_PAGES - nr_write);
+     assert(swap_cache_stat.nr_cached == 1 && swap_cache_lookup(shared) != NULL);
+     swap_free(shared);
+     assert(swap_cache_stat.nr_cached == 0);
+     swap_quiet = 0;
+
+     uintptr_t la;
+     for (la = CHECK_CLUSTER_VADDR; la < CHECK_CLUSTER_VADDR + CHECK_CLUSTER_PAGES * PGSIZE; la += PGSIZE) {
+          page_remove(pgdir, la);
+     }
+     assert(swap_slot_stat.nr_used == 0 && pt_live(pde2page(pgdir[0])) == 0);
+     free_page(pde2page(pgdir[0]));
+     pgdir[0] = 0;
+     mm->pgdir = NULL;
+     mm_destroy(mm);
+     check_mm_struct = NULL;
+
+     cprintf("check_swap_cluster() succeeded!\n");
+}
+
+#define BENCH_SWAP_FRAMES           16
+#define BENCH_SWAP_PAGES            32
+#define BENCH_SWAP_HOT              8
+#define BENCH_SWAP_ACCESSES         4096
+#define BENCH_SWAP_TICK             16
+#define BENCH_SWAP_VADDR            0x1000
+
+static struct swap_manager *bench_swap_managers[] = {
+     &swap_manager_fifo, &swap_manager_clock, &swap_manager_eclock, &swap_manager_aging,
+     &swap_manager_lru,
+};
+
+// bench_swap_run - run the working set of bench_swap_manager with the swap manager sm,
+//                - returns the page faults taken
+static int
+bench_swap_run(struct mm_struct *mm)
+{
+     pde_t *pgdir = mm->pgdir;
+     uint32_t seed = 1;
+     int i;
+
+     assert(get_pte(pgdir, BENCH_SWAP_VADDR, 1) != NULL);
+     // hold every free page aside but BENCH_SWAP_FRAMES, as check_swap does
+     struct Page *frames[BENCH_SWAP_FRAMES];
+     for (i = 0; i < BENCH_SWAP_FRAMES; i ++) {
+          frames[i] = alloc_page();
+          assert(frames[i] != NULL);
+     }
+     list_entry_t hoard, *le;
+     list_init(&hoard);
+     size_t nr_hoard = nr_free_pages();
+     for (i = 0; i < nr_hoard; i ++) {
+          struct Page *p = alloc_page();
+          assert(p != NULL);
+          list_add(&hoard, &(p->page_link));
+     }
+     for (i = 0; i < BENCH_SWAP_FRAMES; i ++) {
+          free_page(frames[i]);
+     }
+
+     // every page is written once, those faults do not count
+     for (i = 0; i < BENCH_SWAP_PAGES; i ++) {
+          *(volatile uint32_t *)(BENCH_SWAP_VADDR + i * PGSIZE) = i;
+     }
+     unsigned int faults = pgfault_num;
+     for (i = 0; i < BENCH_SWAP_ACCESSES; i ++) {
+          seed = seed * 1103515245 + 12345;
+          uint32_t r = (seed >> 8);
+          // 3 of 4 accesses go to the hot pages, 1 of 4 is a write
+          int p = (r % 4 != 0) ? (r >> 4) % BENCH_SWAP_HOT
+               : BENCH_SWAP_HOT + (r >> 4) % (BENCH_SWAP_PAGES - BENCH_SWAP_HOT);
+          volatile uint32_t *addr = (uint32_t *)(BENCH_SWAP_VADDR + p * PGSIZE);
+          if ((r >> 2) % 4 == 0) {
+               *addr = p;
+          }
+          else {
+               assert(*addr == p);
+          }
+          if (i % BENCH_SWAP_TICK == BENCH_SWAP_TICK - 1) {
+               sm->tick_event(mm);
+          }
+     }
+     faults = pgfault_num - faults;
+
+     // give the frames, the swap slots and the page table back
+     uintptr_t la;
+     for (la = BENCH_SWAP_VADDR; la < BENCH_SWAP_VADDR + BENCH_SWAP_PAGES * PGSIZE; la += PGSIZE) {
+          pte_t *ptep = get_pte(pgdir, la, 0);
+          if (*ptep & PTE_P) {
+               page_remove(pgdir, la);
+          }
+          else if (*ptep != 0) {
+               swap_free(*ptep);
+               *ptep = 0;
+               pt_live_dec(ptep);
+          }
+     }
+     assert(swap_slot_stat.nr_used == 0 && pt_live(pde2page(pgdir[0])) == 0);
+     free_page(pde2page(pgdir[0]));
+     pgdir[0] = 0;
+     while ((le = list_next(&hoard)) != &hoard) {
+          list_del(le);
+          free_page(le2page(le, page_link));
+     }
+     return faults;
+}
+
+// bench_swap_manager - the page faults of every swap manager on the same working set:
+//                    - BENCH_SWAP_PAGES pages in BENCH_SWAP_FRAMES frames, most accesses
+//                    - go to BENCH_SWAP_HOT of them, with a tick every BENCH_SWAP_TICK accesses.
+//                    - Select the manager the kernel uses with SWAP in the Makefile.
+static void
+bench_swap_manager(void)
+{
+     struct swap_manager *selected = sm;
+     struct mm_struct *mm = mm_create();
+     assert(mm != NULL && check_mm_struct == NULL);
+     check_mm_struct = mm;
+     mm->fault_around = 1;
+     mm->pgdir = boot_pgdir;
+     assert(boot_pgdir[0] == 0);
+     struct vma_struct *vma = vma_create(BENCH_SWAP_VADDR, BENCH_SWAP_VADDR + BENCH_SWAP_PAGES * PGSIZE, VM_WRITE | VM_READ);
+     assert(vma != NULL);
+     insert_vma_struct(mm, vma);
+
+     swap_quiet = 1;
+     sm->exit_mm(mm);
+     int i;
+     for (i = 0; i < sizeof(bench_swap_managers) / sizeof(bench_swap_managers[0]); i ++) {
+          sm = bench_swap_managers[i];
+          sm->init();
+          assert(sm->init_mm(mm) == 0);
+          int faults = bench_swap_run(mm);
+          cprintf("bench_swap_manager: %s: %d faults in %d accesses, %d per 1000\n",
+                  sm->name, faults, BENCH_SWAP_ACCESSES, faults * 1000 / BENCH_SWAP_ACCESSES);
+          sm->exit_mm(mm);
+     }
+     swap_quiet = 0;
+
+     sm = selected;
+     sm->init();
+     mm->pgdir = NULL;
+     mm_destroy(mm);
+     check_mm_struct = NULL;
+}
@@ -37,6 +37,8 @@ struct swap_manager
      int (*init)            (void);
      /* Initialize the priv data inside mm_struct */
      int (*init_mm)         (struct mm_struct *mm);
+     /* Free the priv data inside mm_struct, called by mm_destroy */
+     int (*exit_mm)         (struct mm_struct *mm);
      /* Called when tick interrupt occured */
      int (*tick_event)      (struct mm_struct *mm);
      /* Called when map a swappable page into the mm_struct */
@@ -44,6 +46,8 @@ struct swap_manager
      /* When a page is marked as shared, this routine is called to
       * delete the addr entry from the swap manager */
      int (*set_unswappable) (struct mm_struct *mm, uintptr_t addr);
+     /* A swappable page is freed, take it out of the lists */
+     void (*remove_page)    (struct Page *page);
      /* Try to swap out a page, return then victim */
      int (*swap_out_victim) (struct mm_struct *mm, struct Page **ptr_page, int in_tick);
      /* check the page relpacement algorithm */
@@ -51,13 +55,17 @@ struct swap_manager
 };
 
 extern volatile int swap_init_ok;
+extern volatile bool swap_quiet;
 int swap_init(void);
 int swap_init_mm(struct mm_struct *mm);
+int swap_exit_mm(struct mm_struct *mm);
+void swap_remove_page(struct Page *page);
 int swap_tick_event(struct mm_struct *mm);
 int swap_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int swap_in);
 int swap_set_unswappable(struct mm_struct *mm, uintptr_t addr);
 int swap_out(struct mm_struct *mm, int n, int in_tick);
 int swap_in(struct mm_struct *mm, uintptr_t addr, struct Page **ptr_result);
+uint32_t swap_page_referenced(struct Page *page, bool clear);
 
 //#define MEMBER_OFFSET(m,t) ((int)(&((t *)0)->m))
 //#define FROM_MEMBER(m,t,a) ((t *)((char *)(a) - MEMBER_OFFSET(m,t)))
@@ -0,0 +1,167 @@
+#include <defs.h>
+#include <mmu.h>
+#include <stdio.h>
+#include <assert.h>
+#include <error.h>
+#include <list.h>
+#include <swap.h>
+#include <swap_aging.h>
+
+/* *
+ * Aging page replacement, an approximation of LRU
+ *
+ * Every page keeps 8 bits of access history in page->pra_age. The timer interrupt
+ * (swap_tick_event) samples the accessed bits: the history of a page is shifted
+ * right, PTE_A goes into the top bit and is cleared. The page with the smallest
+ * history was used least recently, counted in ticks.
+ *
+ * A tick ages at most AGING_SCAN pages, the ones it aged least recently: they are
+ * taken at the tail of the list and put at the front. A victim is the page with
+ * the smallest history among the AGING_WINDOW pages at the tail, with the accessed
+ * bit seen now counted as if the tick came now; pages that compare equal go
+ * oldest first.
+ * */
+
+#define AGING_SCAN              256     // pages aged by one tick at most
+#define AGING_WINDOW            32      // pages looked at for a victim
+#define AGING_REFERENCED        0x80    // the bit of the last tick in the history
+
+static list_entry_t aging_list;
+
+// aging_next - the history of page after one more tick, clearing PTE_A if clear
+static unsigned int
+aging_next(struct Page *page, bool clear) {
+    unsigned int age = page->pra_age >> 1;
+    if (swap_page_referenced(page, clear) & PTE_A) {
+        age |= AGING_REFERENCED;
+    }
+    return age;
+}
+
+static int
+_aging_init(void)
+{
+    list_init(&aging_list);
+    return 0;
+}
+
+static int
+_aging_init_mm(struct mm_struct *mm)
+{
+    mm->sm_priv = &aging_list;
+    return 0;
+}
+
+static int
+_aging_exit_mm(struct mm_struct *mm)
+{
+    mm->sm_priv = NULL;
+    return 0;
+}
+
+static void
+_aging_remove_page(struct Page *page)
+{
+    list_del(&(page->pra_page_link));
+}
+
+static int
+_aging_tick_event(struct mm_struct *mm)
+{
+    list_entry_t *head = &aging_list, *le, *last = list_next(head);
+    int i;
+    for (i = 0; i < AGING_SCAN && (le = list_prev(head)) != head; i ++) {
+        struct Page *page = le2page(le, pra_page_link);
+        page->pra_age = aging_next(page, 1);
+        list_del(le);
+        list_add(head, le);
+        if (le == last) {
+            // every page was aged once
+            break;
+        }
+    }
+    return 0;
+}
+
+static int
+_aging_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int swap_in)
+{
+    page->pra_age = 0;
+    list_add(&aging_list, &(page->pra_page_link));
+    return 0;
+}
+
+static int
+_aging_set_unswappable(struct mm_struct *mm, uintptr_t addr)
+{
+    return 0;
+}
+
+static int
+_aging_swap_out_victim(struct mm_struct *mm, struct Page **ptr_page, int in_tick)
+{
+    list_entry_t *head = &aging_list, *le;
+    struct Page *victim = NULL;
+    unsigned int victim_age = 0;
+    int i;
+    assert(in_tick == 0);
+    for (i = 0, le = list_prev(head); i < AGING_WINDOW && le != head; i ++, le = list_prev(le)) {
+        struct Page *page = le2page(le, pra_page_link);
+        unsigned int age = aging_next(page, 0);
+        if (victim == NULL || age < victim_age) {
+            victim = page, victim_age = age;
+        }
+    }
+    if (victim == NULL) {
+        return -E_NO_MEM;
+    }
+    list_del(&(victim->pra_page_link));
+    *ptr_page = victim;
+    return 0;
+}
+
+/* *
+ * The check starts with the pages a, b, c, d written in this order at 0x1000 ~
+ * 0x4000 in 4 frames, see check_swap; it makes the ticks itself.
+ * */
+static int
+_aging_check_swap(void) {
+    _aging_tick_event(check_mm_struct);
+    cprintf("read Virt Page a in aging_check_swap\n");
+    assert(*(unsigned char *)0x1000 == 0x0a);
+    cprintf("write Virt Page b in aging_check_swap\n");
+    *(unsigned char *)0x2000 = 0x0b;
+    _aging_tick_event(check_mm_struct);
+    cprintf("write Virt Page e in aging_check_swap\n");
+    *(unsigned char *)0x5000 = 0x0e;
+    // a and b were used in both ticks, c and d only in the first; FIFO would take a
+    assert(pgfault_num==5);
+    cprintf("use Virt Page a, b, d, e in aging_check_swap\n");
+    assert(*(unsigned char *)0x1000 == 0x0a);
+    *(unsigned char *)0x2000 = 0x0b;
+    assert(*(unsigned char *)0x4000 == 0x0d);
+    *(unsigned char *)0x5000 = 0x0e;
+    assert(pgfault_num==5);
+    cprintf("write Virt Page c in aging_check_swap\n");
+    *(unsigned char *)0x3000 = 0x0c;
+    // e has no history yet, it goes although it is the newest
+    assert(pgfault_num==6);
+    cprintf("read Virt Page e in aging_check_swap\n");
+    assert(*(unsigned char *)0x5000 == 0x0e);
+    assert(pgfault_num==7);
+    return 0;
+}
+
+struct swap_manager swap_manager_aging =
+{
+     .name            = "aging swap manager",
+     .init            = &_aging_init,
+     .init_mm         = &_aging_init_mm,
+     .exit_mm         = &_aging_exit_mm,
+     .tick_event      = &_aging_tick_event,
+     .map_swappable   = &_aging_map_swappable,
+     .set_unswappable = &_aging_set_unswappable,
+     .remove_page     = &_aging_remove_page,
+     .swap_out_victim = &_aging_swap_out_victim,
+     .check_swap      = &_aging_check_swap,
+};
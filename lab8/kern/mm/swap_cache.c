@@ -0,0 +1,145 @@
+#include <defs.h>
+#include <list.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sync.h>
+#include <pmm.h>
+#include <swap.h>
+#include <swap_cache.h>
+
+/* *
+ * Swap cache
+ *
+ * swap_in reads the slots next to the one of a fault as well, when they hold the
+ * pages next to it in the same vma (see swap_readahead): a process which touches
+ * its memory in order after it was swapped out then faults once per disk command
+ * instead of once per page. The pages read ahead are not mapped; they wait in the
+ * swap cache, keyed by their swap entry, until a fault on a pte holding the entry
+ * finds them there without any I/O.
+ *
+ * A cached page holds a reference, and its entry in property. The slot stays on
+ * the disk as long as some pte holds it, so a cached page is only a copy: when the
+ * last pte lets the slot go (swap_free) the copy goes too, and reclaim may drop the
+ * copies at any time (swap_cache_shrink), oldest first. At most SWAP_CACHE_MAX pages
+ * are kept.
+ * */
+
+#define SWAP_CACHE_SIZE         (1 << SWAP_CACHE_SHIFT)
+
+static list_entry_t swap_cache_hash[SWAP_CACHE_SIZE];   // linked by page_link
+static list_entry_t swap_cache_lru;                     // the newest first, linked by pra_page_link
+
+struct swap_cache_stat swap_cache_stat;
+
+#define swap_cache_bucket(entry)            \
+    (swap_cache_hash + hash32((entry), SWAP_CACHE_SHIFT))
+
+void
+swap_cache_init(void) {
+    int i;
+    for (i = 0; i < SWAP_CACHE_SIZE; i ++) {
+        list_init(swap_cache_hash + i);
+    }
+    list_init(&swap_cache_lru);
+    memset(&swap_cache_stat, 0, sizeof(struct swap_cache_stat));
+}
+
+// swap_cache_lookup - the cached copy of the slot of entry, or NULL
+struct Page *
+swap_cache_lookup(swap_entry_t entry) {
+    struct Page *page = NULL;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        list_entry_t *list = swap_cache_bucket(entry), *le = list;
+        while ((le = list_next(le)) != list) {
+            struct Page *p = le2page(le, page_link);
+            if (p->property == entry) {
+                page = p;
+                break;
+            }
+        }
+    }
+    local_intr_restore(intr_flag);
+    return page;
+}
+
+// swap_cache_del - take page out of the swap cache, its reference goes with it
+void
+swap_cache_del(struct Page *page) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        assert(PageSwapCache(page));
+        list_del(&(page->page_link));
+        list_del(&(page->pra_page_link));
+        ClearPageSwapCache(page);
+        page->property = 0;
+        page_ref_dec(page);
+        swap_cache_stat.nr_cached --;
+    }
+    local_intr_restore(intr_flag);
+}
+
+// swap_cache_shrink - free up to n cached pages, the oldest first; returns how many
+int
+swap_cache_shrink(int n) {
+    int nr = 0;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        list_entry_t *le;
+        while (nr < n && (le = list_prev(&swap_cache_lru)) != &swap_cache_lru) {
+            struct Page *page = le2page(le, pra_page_link);
+            swap_cache_del(page);
+            free_page(page);
+            swap_cache_stat.nr_drop ++;
+            nr ++;
+        }
+    }
+    local_intr_restore(intr_flag);
+    return nr;
+}
+
+// swap_cache_add - keep page, which holds the data of the slot of entry, in the
+//                - swap cache; the oldest page goes if the cache is full
+void
+swap_cache_add(swap_entry_t entry, struct Page *page) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        assert(!PageSwapCache(page) && page_ref(page) == 0);
+        if (swap_cache_stat.nr_cached >= SWAP_CACHE_MAX) {
+            swap_cache_shrink(1);
+        }
+        SetPageSwapCache(page);
+        page->property = entry;
+        page_ref_inc(page);
+        list_add(swap_cache_bucket(entry), &(page->page_link));
+        list_add(&swap_cache_lru, &(page->pra_page_link));
+        swap_cache_stat.nr_cached ++;
+    }
+    local_intr_restore(intr_flag);
+}
+
+// swap_cache_drop - the slot of entry is free, its cached copy is of no use any more
+void
+swap_cache_drop(swap_entry_t entry) {
+    struct Page *page;
+    if ((page = swap_cache_lookup(entry)) != NULL) {
+        swap_cache_del(page);
+        free_page(page);
+        swap_cache_stat.nr_drop ++;
+    }
+}
+
+void
+print_swap_cache(void) {
+    struct swap_cache_stat *s = &swap_cache_stat;
+    cprintf("swap io: %u pages written in %u commands, %u pages read in %u commands.\n",
+            s->nr_write_pages, s->nr_write, s->nr_read_pages, s->nr_read);
+    cprintf("  swap cache: %u faults served without io, %u pages read ahead dropped, %u cached.\n",
+            s->nr_hit, s->nr_drop, s->nr_cached);
+}
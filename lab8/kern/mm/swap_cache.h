@@ -0,0 +1,31 @@
+#ifndef __KERN_MM_SWAP_CACHE_H__
+#define __KERN_MM_SWAP_CACHE_H__
+
+#include <defs.h>
+#include <memlayout.h>
+
+#define SWAP_CACHE_SHIFT        6       // log2 of the buckets of the swap cache
+#define SWAP_CACHE_MAX          256     // pages the swap cache keeps at most
+
+// counters of swap I/O and of the swap cache, printed by print_swap_cache
+struct swap_cache_stat {
+    size_t nr_write;                    // disk commands of swap_out
+    size_t nr_write_pages;              // pages they wrote
+    size_t nr_read;                     // disk commands of swap_in
+    size_t nr_read_pages;               // pages they read, the faulting ones and the ones read ahead
+    size_t nr_cached;                   // pages in the swap cache now
+    size_t nr_hit;                      // swap-in faults served from the swap cache
+    size_t nr_drop;                     // pages read ahead which no fault wanted
+};
+
+extern struct swap_cache_stat swap_cache_stat;
+
+void swap_cache_init(void);
+struct Page *swap_cache_lookup(swap_entry_t entry);
+void swap_cache_add(swap_entry_t entry, struct Page *page);
+void swap_cache_del(struct Page *page);
+void swap_cache_drop(swap_entry_t entry);
+int swap_cache_shrink(int n);
+void print_swap_cache(void);
+
+#endif /* !__KERN_MM_SWAP_CACHE_H__ */
@@ -0,0 +1,206 @@
+#include <defs.h>
+#include <mmu.h>
+#include <stdio.h>
+#include <assert.h>
+#include <error.h>
+#include <list.h>
+#include <swap.h>
+#include <swap_clock.h>
+
+/* *
+ * CLOCK and enhanced CLOCK page replacement
+ *
+ * FIFO evicts the oldest page even if it is used all the time. CLOCK (second
+ * chance) looks at the accessed bit (PTE_A) of the oldest page first: if it is
+ * set, the page was used since it came in or since the hand passed it last time,
+ * so the bit is cleared and the page goes to the front instead. The list is the
+ * clock, its tail is the hand; after one turn every bit is clear and the oldest
+ * page goes.
+ *
+ * Enhanced CLOCK also looks at the dirty bit (PTE_D), and takes the first page
+ * of the best class (accessed, dirty), oldest first:
+ *   (1) look for (0, 0), change nothing;
+ *   (2) look for (0, 1), clearing PTE_A of every page passed;
+ *   (3) (4) do (1) and (2) again, all the bits PTE_A are clear by now.
+ * A page which was used but not written is kept before a page which was written.
+ *
+ * The bits are in the pte of the mm which maps the page, see swap_page_referenced.
+ * */
+
+static list_entry_t clock_list;
+
+static int
+_clock_init(void)
+{
+    list_init(&clock_list);
+    return 0;
+}
+
+static int
+_clock_init_mm(struct mm_struct *mm)
+{
+    mm->sm_priv = &clock_list;
+    return 0;
+}
+
+static int
+_clock_exit_mm(struct mm_struct *mm)
+{
+    mm->sm_priv = NULL;
+    return 0;
+}
+
+static void
+_clock_remove_page(struct Page *page)
+{
+    list_del(&(page->pra_page_link));
+}
+
+static int
+_clock_tick_event(struct mm_struct *mm)
+{
+    return 0;
+}
+
+static int
+_clock_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int swap_in)
+{
+    list_add(&clock_list, &(page->pra_page_link));
+    return 0;
+}
+
+static int
+_clock_set_unswappable(struct mm_struct *mm, uintptr_t addr)
+{
+    return 0;
+}
+
+static int
+_clock_swap_out_victim(struct mm_struct *mm, struct Page **ptr_page, int in_tick)
+{
+    list_entry_t *head = &clock_list, *le;
+    assert(in_tick == 0);
+    while ((le = list_prev(head)) != head) {
+        struct Page *page = le2page(le, pra_page_link);
+        list_del(le);
+        if (swap_page_referenced(page, 1) & PTE_A) {
+            // a second chance
+            list_add(head, le);
+            continue;
+        }
+        *ptr_page = page;
+        return 0;
+    }
+    return -E_NO_MEM;
+}
+
+static int
+_eclock_swap_out_victim(struct mm_struct *mm, struct Page **ptr_page, int in_tick)
+{
+    list_entry_t *head = &clock_list, *le;
+    int round;
+    assert(in_tick == 0);
+    for (round = 0; round < 4; round ++) {
+        bool clear = (round % 2 == 1);
+        uint32_t want = clear ? PTE_D : 0;
+        for (le = list_prev(head); le != head; le = list_prev(le)) {
+            struct Page *page = le2page(le, pra_page_link);
+            if (swap_page_referenced(page, clear) == want) {
+                list_del(le);
+                *ptr_page = page;
+                return 0;
+            }
+        }
+    }
+    return -E_NO_MEM;
+}
+
+/* *
+ * The checks start with the pages a, b, c, d written in this order at 0x1000 ~
+ * 0x4000 in 4 frames, see check_swap: every accessed bit is set.
+ * */
+static int
+_clock_check_swap(void) {
+    cprintf("write Virt Page e in clock_check_swap\n");
+    *(unsigned char *)0x5000 = 0x0e;
+    // the hand cleared every bit in one turn, then took a
+    assert(pgfault_num==5);
+    cprintf("write Virt Page b in clock_check_swap\n");
+    *(unsigned char *)0x2000 = 0x0b;
+    assert(pgfault_num==5);
+    cprintf("write Virt Page a in clock_check_swap\n");
+    *(unsigned char *)0x1000 = 0x0a;
+    // b was used again, it is passed over for c
+    assert(pgfault_num==6);
+    cprintf("write Virt Page c in clock_check_swap\n");
+    *(unsigned char *)0x3000 = 0x0c;
+    assert(pgfault_num==7);
+    cprintf("write Virt Page d in clock_check_swap\n");
+    *(unsigned char *)0x4000 = 0x0d;
+    // e is passed over for b, FIFO would have taken e
+    assert(pgfault_num==8);
+    cprintf("write Virt Page e in clock_check_swap\n");
+    *(unsigned char *)0x5000 = 0x0e;
+    assert(pgfault_num==8);
+    cprintf("read Virt Page b in clock_check_swap\n");
+    assert(*(unsigned char *)0x2000 == 0x0b);
+    assert(pgfault_num==9);
+    return 0;
+}
+
+static int
+_eclock_check_swap(void) {
+    cprintf("write Virt Page e in eclock_check_swap\n");
+    *(unsigned char *)0x5000 = 0x0e;
+    // no page is (0, 0), the second round clears every PTE_A and the fourth takes a
+    assert(pgfault_num==5);
+    cprintf("read Virt Page a in eclock_check_swap\n");
+    assert(*(unsigned char *)0x1000 == 0x0a);
+    assert(pgfault_num==6);
+    cprintf("write Virt Page b in eclock_check_swap\n");
+    *(unsigned char *)0x2000 = 0x0b;
+    assert(pgfault_num==7);
+    cprintf("write Virt Page c in eclock_check_swap\n");
+    *(unsigned char *)0x3000 = 0x0c;
+    assert(pgfault_num==8);
+    cprintf("write Virt Page d in eclock_check_swap\n");
+    *(unsigned char *)0x4000 = 0x0d;
+    // a was only read since it came back, it is (0, 0) once PTE_A is cleared and
+    // goes before e, which is older but dirty
+    assert(pgfault_num==9);
+    cprintf("read Virt Page e in eclock_check_swap\n");
+    assert(*(unsigned char *)0x5000 == 0x0e);
+    assert(pgfault_num==9);
+    cprintf("read Virt Page a in eclock_check_swap\n");
+    assert(*(unsigned char *)0x1000 == 0x0a);
+    assert(pgfault_num==10);
+    return 0;
+}
+
+struct swap_manager swap_manager_clock =
+{
+     .name            = "clock swap manager",
+     .init            = &_clock_init,
+     .init_mm         = &_clock_init_mm,
+     .exit_mm         = &_clock_exit_mm,
+     .tick_event      = &_clock_tick_event,
+     .map_swappable   = &_clock_map_swappable,
+     .set_unswappable = &_clock_set_unswappable,
+     .remove_page     = &_clock_remove_page,
+     .swap_out_victim = &_clock_swap_out_victim,
+     .check_swap      = &_clock_check_swap,
+};
+
+struct swap_manager swap_manager_eclock =
+{
+     .name            = "enhanced clock swap manager",
+     .init            = &_clock_init,
+     .init_mm         = &_clock_init_mm,
+     .exit_mm         = &_clock_exit_mm,
+     .tick_event      = &_clock_tick_event,
+     .map_swappable   = &_clock_map_swappable,
+     .set_unswappable = &_clock_set_unswappable,
+     .remove_page     = &_clock_remove_page,
+     .swap_out_victim = &_eclock_swap_out_victim,
+     .check_swap      = &_eclock_check_swap,
+};
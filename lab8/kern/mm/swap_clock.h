@@ -0,0 +1,8 @@
+#ifndef __KERN_MM_SWAP_CLOCK_H__
+#define __KERN_MM_SWAP_CLOCK_H__
+
+#include <swap.h>
+extern struct swap_manager swap_manager_clock;
+extern struct swap_manager swap_manager_eclock;
+
+#endif
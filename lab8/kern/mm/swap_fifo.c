@@ -5,6 +5,8 @@
 #include <swap.h>
 #include <swap_fifo.h>
 #include <list.h>
+#include <error.h>
+#include <kmalloc.h>
 
 /* [wikipedia]The simplest Page Replacement Algorithm(PRA) is a FIFO algorithm. The first-in, first-out
  * page replacement algorithm is a low-overhead algorithm that requires little book-keeping on
@@ -25,34 +27,91 @@
  *              le2page (in memlayout.h), (in future labs: le2vma (in vmm.h), le2proc (in proc.h),etc.
  */
 
-list_entry_t pra_list_head;
 /*
- * (2) _fifo_init_mm: init pra_list_head and let  mm->sm_priv point to the addr of pra_list_head.
+ * Every mm has a queue of its own, struct fifo_mm, in mm->sm_priv: it is allocated by
+ * _fifo_init_mm and freed by _fifo_exit_mm, so a new mm (fork, exec) does not touch
+ * the queue of any other mm. Reclaim for a given mm takes the oldest page of its
+ * queue; reclaim for no mm in particular (kswapd) takes the oldest page of each mm in
+ * turn. The pages which a dead mm still shared with another one (copy-on-write since
+ * fork) go to fifo_orphans, which takes its turn like an mm.
+ */
+struct fifo_mm {
+     list_entry_t pra_list_head;        // the pages of the mm, the most recent arrival first
+     list_entry_t mm_link;              // in fifo_mm_list
+};
+
+#define le2fifo_mm(le)                  to_struct((le), struct fifo_mm, mm_link)
+
+static list_entry_t fifo_mm_list;       // every fifo_mm, the next one to give a page first
+static struct fifo_mm fifo_orphans;
+
+/*
+ * (2) _fifo_init_mm: alloc the queue of mm and let mm->sm_priv point to it.
  *              Now, From the memory control struct mm_struct, we can access FIFO PRA
  */
 static int
 _fifo_init_mm(struct mm_struct *mm)
 {     
-     list_init(&pra_list_head);
-     mm->sm_priv = &pra_list_head;
+     struct fifo_mm *fm = kmalloc(sizeof(struct fifo_mm));
+     if (fm == NULL) {
+          return -E_NO_MEM;
+     }
+     list_init(&(fm->pra_list_head));
+     list_add_before(&fifo_mm_list, &(fm->mm_link));
+     mm->sm_priv = fm;
      //cprintf(" mm->sm_priv %x in fifo_init_mm\n",mm->sm_priv);
      return 0;
 }
+
+static int
+_fifo_exit_mm(struct mm_struct *mm)
+{
+     struct fifo_mm *fm = mm->sm_priv;
+     if (fm != NULL) {
+          list_entry_t *le;
+          while ((le = list_prev(&(fm->pra_list_head))) != &(fm->pra_list_head)) {
+               list_del(le);
+               list_add(&(fifo_orphans.pra_list_head), le);
+          }
+          list_del(&(fm->mm_link));
+          kfree(fm);
+          mm->sm_priv = NULL;
+     }
+     return 0;
+}
 /*
  * (3)_fifo_map_swappable: According FIFO PRA, we should link the most recent arrival page at the back of pra_list_head qeueue
  */
 static int
 _fifo_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int swap_in)
 {
-    list_entry_t *head=(list_entry_t*) mm->sm_priv;
+    struct fifo_mm *fm = (mm != NULL && mm->sm_priv != NULL) ? mm->sm_priv : &fifo_orphans;
+    list_entry_t *head=&(fm->pra_list_head);
     list_entry_t *entry=&(page->pra_page_link);
  
     assert(entry != NULL && head != NULL);
     //record the page access situlation
     /*LAB3 EXERCISE 2: YOUR CODE*/ 
     //(1)link the most recent arrival page at the back of the pra_list_head qeueue.
+    list_add(head, entry);
     return 0;
 }
+
+// fifo_next_mm - the next queue with a page in it, which goes to the end of the turn
+static struct fifo_mm *
+fifo_next_mm(void)
+{
+     list_entry_t *le = &fifo_mm_list;
+     while ((le = list_next(le)) != &fifo_mm_list) {
+          struct fifo_mm *fm = le2fifo_mm(le);
+          if (!list_empty(&(fm->pra_list_head))) {
+               list_del(le);
+               list_add_before(&fifo_mm_list, le);
+               return fm;
+          }
+     }
+     return NULL;
+}
 /*
  *  (4)_fifo_swap_out_victim: According FIFO PRA, we should unlink the  earliest arrival page in front of pra_list_head qeueue,
  *                            then assign the value of *ptr_page to the addr of this page.
@@ -60,13 +119,24 @@ _fifo_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int
 static int
 _fifo_swap_out_victim(struct mm_struct *mm, struct Page ** ptr_page, int in_tick)
 {
-     list_entry_t *head=(list_entry_t*) mm->sm_priv;
-         assert(head != NULL);
+     struct fifo_mm *fm = (mm != NULL) ? mm->sm_priv : NULL;
+     if (fm == NULL || list_empty(&(fm->pra_list_head))) {
+          if ((fm = fifo_next_mm()) == NULL) {
+               // nothing left to reclaim
+               return -E_NO_MEM;
+          }
+     }
+     list_entry_t *head=&(fm->pra_list_head);
      assert(in_tick==0);
      /* Select the victim */
      /*LAB3 EXERCISE 2: YOUR CODE*/ 
      //(1)  unlink the  earliest arrival page in front of pra_list_head qeueue
      //(2)  assign the value of *ptr_page to the addr of this page
+     list_entry_t *le = head->prev;
+     struct Page *p = le2page(le, pra_page_link);
+     list_del(le);
+     assert(p != NULL);
+     *ptr_page = p;
      return 0;
 }
 
@@ -116,9 +186,18 @@ _fifo_check_swap(void) {
 static int
 _fifo_init(void)
 {
+    list_init(&fifo_mm_list);
+    list_init(&(fifo_orphans.pra_list_head));
+    list_add(&fifo_mm_list, &(fifo_orphans.mm_link));
     return 0;
 }
 
+static void
+_fifo_remove_page(struct Page *page)
+{
+    list_del(&(page->pra_page_link));
+}
+
 static int
 _fifo_set_unswappable(struct mm_struct *mm, uintptr_t addr)
 {
@@ -135,9 +214,11 @@ struct swap_manager swap_manager_fifo =
      .name            = "fifo swap manager",
      .init            = &_fifo_init,
      .init_mm         = &_fifo_init_mm,
+     .exit_mm         = &_fifo_exit_mm,
      .tick_event      = &_fifo_tick_event,
      .map_swappable   = &_fifo_map_swappable,
      .set_unswappable = &_fifo_set_unswappable,
+     .remove_page     = &_fifo_remove_page,
      .swap_out_victim = &_fifo_swap_out_victim,
      .check_swap      = &_fifo_check_swap,
 };
@@ -0,0 +1,177 @@
+#include <defs.h>
+#include <mmu.h>
+#include <stdio.h>
+#include <assert.h>
+#include <error.h>
+#include <list.h>
+#include <swap.h>
+#include <swap_lru.h>
+
+/* *
+ * Active/inactive LRU page replacement
+ *
+ * The swappable pages of every mm are in two global lists, so that reclaim picks
+ * the pages used least recently in the whole system, whichever process they belong
+ * to. A page comes in at the front of the inactive list. Reclaim looks at the tail
+ * of the inactive list: a page whose accessed bit (PTE_A) is set was used again
+ * since it came in, and moves to the front of the active list; any other page is
+ * the victim. When the inactive list gets shorter than the active list, pages move
+ * from the tail of the active list to the front of the inactive list, those used
+ * since the last look are kept active a while longer.
+ *
+ * A page has to be used twice to become active, so a scan through a lot of memory
+ * used once (a big read, a new program) does not push the working set of the other
+ * processes out. PG_active tells the list of a page, so that its count can be
+ * kept when the page is freed (_lru_remove_page).
+ * */
+
+#define LRU_SCAN                32      // active pages looked at per refill of the inactive list
+
+static list_entry_t lru_active, lru_inactive;
+static size_t nr_active, nr_inactive;
+
+static int
+_lru_init(void)
+{
+    list_init(&lru_active);
+    list_init(&lru_inactive);
+    nr_active = nr_inactive = 0;
+    return 0;
+}
+
+static int
+_lru_init_mm(struct mm_struct *mm)
+{
+    mm->sm_priv = &lru_inactive;
+    return 0;
+}
+
+static int
+_lru_exit_mm(struct mm_struct *mm)
+{
+    mm->sm_priv = NULL;
+    return 0;
+}
+
+static void
+_lru_remove_page(struct Page *page)
+{
+    list_del(&(page->pra_page_link));
+    if (PageActive(page)) {
+        ClearPageActive(page);
+        nr_active --;
+    }
+    else {
+        nr_inactive --;
+    }
+}
+
+static int
+_lru_tick_event(struct mm_struct *mm)
+{
+    return 0;
+}
+
+static int
+_lru_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int swap_in)
+{
+    ClearPageActive(page);
+    list_add(&lru_inactive, &(page->pra_page_link));
+    nr_inactive ++;
+    return 0;
+}
+
+static int
+_lru_set_unswappable(struct mm_struct *mm, uintptr_t addr)
+{
+    return 0;
+}
+
+// lru_refill - move pages from the tail of the active list to the inactive list
+//            - until it is as long, at most LRU_SCAN of them are looked at
+static void
+lru_refill(void)
+{
+    list_entry_t *le;
+    int scan;
+    for (scan = 0; scan < LRU_SCAN && nr_inactive < nr_active; scan ++) {
+        le = list_prev(&lru_active);
+        struct Page *page = le2page(le, pra_page_link);
+        list_del(le);
+        if (swap_page_referenced(page, 1) & PTE_A) {
+            list_add(&lru_active, le);
+            continue;
+        }
+        ClearPageActive(page);
+        list_add(&lru_inactive, le);
+        nr_active --, nr_inactive ++;
+    }
+}
+
+static int
+_lru_swap_out_victim(struct mm_struct *mm, struct Page **ptr_page, int in_tick)
+{
+    list_entry_t *le;
+    assert(in_tick == 0);
+    // every page looked at loses PTE_A, so this ends
+    while (nr_active + nr_inactive != 0) {
+        lru_refill();
+        if ((le = list_prev(&lru_inactive)) == &lru_inactive) {
+            continue;
+        }
+        struct Page *page = le2page(le, pra_page_link);
+        list_del(le);
+        nr_inactive --;
+        if (swap_page_referenced(page, 1) & PTE_A) {
+            SetPageActive(page);
+            list_add(&lru_active, le);
+            nr_active ++;
+            continue;
+        }
+        *ptr_page = page;
+        return 0;
+    }
+    return -E_NO_MEM;
+}
+
+/* *
+ * The check starts with the pages a, b, c, d written in this order at 0x1000 ~
+ * 0x4000 in 4 frames, see check_swap: all are inactive and were used once.
+ * */
+static int
+_lru_check_swap(void) {
+    cprintf("write Virt Page e in lru_check_swap\n");
+    *(unsigned char *)0x5000 = 0x0e;
+    // every page was used, they all become active, then a and b are inactive again
+    // and a goes
+    assert(pgfault_num==5);
+    assert(nr_active == 2 && nr_inactive == 2);
+    // c and d are used between the faults of a stream of pages used once: they are
+    // never taken, FIFO would take each of them in turn
+    const char *stream = "abeabe";
+    int i;
+    for (i = 0; stream[i] != '\0'; i ++) {
+        unsigned char c = stream[i] - 'a' + 0x0a;
+        unsigned char *addr = (unsigned char *)((stream[i] - 'a' + 1) * 0x1000);
+        cprintf("read Virt Page c, d, write Virt Page %c in lru_check_swap\n", stream[i]);
+        assert(*(unsigned char *)0x3000 == 0x0c && *(unsigned char *)0x4000 == 0x0d);
+        assert(pgfault_num==5 + i);
+        *addr = c;
+        assert(pgfault_num==6 + i);
+    }
+    return 0;
+}
+
+struct swap_manager swap_manager_lru =
+{
+     .name            = "lru swap manager",
+     .init            = &_lru_init,
+     .init_mm         = &_lru_init_mm,
+     .exit_mm         = &_lru_exit_mm,
+     .tick_event      = &_lru_tick_event,
+     .map_swappable   = &_lru_map_swappable,
+     .set_unswappable = &_lru_set_unswappable,
+     .remove_page     = &_lru_remove_page,
+     .swap_out_victim = &_lru_swap_out_victim,
+     .check_swap      = &_lru_check_swap,
+};
@@ -0,0 +1,215 @@
+#include <defs.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <error.h>
+#include <sync.h>
+#include <kmalloc.h>
+#include <swap.h>
+#include <swap_slot.h>
+#include <swap_cache.h>
+
+/* *
+ * Swap slot allocator
+ *
+ * A swap entry in a pte names a page-sized slot of the swap disk (swap_offset).
+ * Slots used to be derived from the virtual address, so two mms swapping out the
+ * same address wrote the same slot. Now every slot has a reference count, the
+ * number of ptes holding its entry: swap_out allocates a slot with a count of 1,
+ * fork (copy_range) adds one for the pte of the child, and swap-in and unmap drop
+ * theirs; the slot is free again at 0.
+ *
+ * A bitmap of the used slots, one bit per slot, speeds up the search: swap_alloc
+ * continues where the last search stopped (next fit) and prefers a whole free word
+ * of the bitmap, a run of SWAP_CLUSTER slots, which it then hands out in order, so
+ * the pages of one round of eviction land next to each other on the disk. Without
+ * any free run it takes the next single free slot.
+ * */
+
+#define BITS_PER_WORD           32
+
+static uint8_t *swap_map;               // reference count of each slot
+static uint32_t *swap_bitmap;           // bit set for slot with a non-zero count
+static size_t nr_word;
+
+static size_t cluster_next;             // the next slot of the current run
+static size_t cluster_left;             // slots of the run not handed out yet
+static size_t scan_next;                // where the next search for a free run starts
+
+struct swap_slot_stat swap_slot_stat;
+
+static void check_swap_slot(void);
+
+void
+swap_slot_init(void) {
+    size_t nr_slot = max_swap_offset;
+    nr_word = ROUNDUP_DIV(nr_slot, BITS_PER_WORD);
+    if ((swap_map = kmalloc(nr_slot)) == NULL ||
+        (swap_bitmap = kmalloc(nr_word * sizeof(uint32_t))) == NULL) {
+        panic("swap_slot_init: no memory for %d slots.\n", nr_slot);
+    }
+    memset(swap_map, 0, nr_slot);
+    memset(swap_bitmap, 0, nr_word * sizeof(uint32_t));
+    // slot 0 is not a valid entry, and the bits past the last slot never are free
+    swap_map[0] = SWAP_COUNT_MAX;
+    swap_bitmap[0] |= 1;
+    size_t i;
+    for (i = nr_slot; i < nr_word * BITS_PER_WORD; i ++) {
+        swap_bitmap[i / BITS_PER_WORD] |= (1 << (i % BITS_PER_WORD));
+    }
+    swap_slot_stat.nr_slot = nr_slot;
+    cluster_next = cluster_left = scan_next = 0;
+    check_swap_slot();
+}
+
+static inline void
+slot_set_used(size_t offset) {
+    swap_bitmap[offset / BITS_PER_WORD] |= (1 << (offset % BITS_PER_WORD));
+    if (++ swap_slot_stat.nr_used > swap_slot_stat.max_used) {
+        swap_slot_stat.max_used = swap_slot_stat.nr_used;
+    }
+}
+
+static inline void
+slot_set_free(size_t offset) {
+    swap_bitmap[offset / BITS_PER_WORD] &= ~(1 << (offset % BITS_PER_WORD));
+    swap_slot_stat.nr_used --;
+}
+
+// find_free_slot - the next free run of SWAP_CLUSTER slots from scan_next, or the
+//                - next single free slot; 0 if the disk is full
+static size_t
+find_free_slot(size_t *run_store) {
+    size_t i, w;
+    for (i = 0; i < nr_word; i ++) {
+        w = (scan_next + i) % nr_word;
+        if (swap_bitmap[w] == 0) {
+            scan_next = (w + 1) % nr_word;
+            *run_store = BITS_PER_WORD;
+            swap_slot_stat.nr_cluster ++;
+            return w * BITS_PER_WORD;
+        }
+    }
+    for (i = 0; i < nr_word; i ++) {
+        w = (scan_next + i) % nr_word;
+        if (swap_bitmap[w] != 0xffffffff) {
+            int bit = 0;
+            while (swap_bitmap[w] & (1 << bit)) {
+                bit ++;
+            }
+            scan_next = w;
+            *run_store = 1;
+            return w * BITS_PER_WORD + bit;
+        }
+    }
+    return 0;
+}
+
+// swap_alloc - a free slot with a count of 1 as a swap entry, 0 if swap is full
+swap_entry_t
+swap_alloc(void) {
+    size_t offset = 0;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        // the rest of the run may have been taken by single slot searches
+        while (cluster_left > 0 && swap_map[cluster_next] != 0) {
+            cluster_next ++, cluster_left --;
+        }
+        if (cluster_left == 0) {
+            cluster_next = find_free_slot(&cluster_left);
+        }
+        if (cluster_left > 0) {
+            offset = cluster_next ++;
+            cluster_left --;
+            assert(swap_map[offset] == 0);
+            swap_map[offset] = 1;
+            slot_set_used(offset);
+            swap_slot_stat.nr_alloc ++;
+        }
+    }
+    local_intr_restore(intr_flag);
+    return offset << 8;
+}
+
+// swap_dup - one more pte holds entry, -E_NO_MEM if the count is at its limit
+int
+swap_dup(swap_entry_t entry) {
+    size_t offset = swap_offset(entry);
+    int ret = 0;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        assert(swap_map[offset] != 0);
+        if (swap_map[offset] == SWAP_COUNT_MAX) {
+            ret = -E_NO_MEM;
+        }
+        else {
+            swap_map[offset] ++;
+        }
+    }
+    local_intr_restore(intr_flag);
+    return ret;
+}
+
+// swap_free - a pte holding entry is gone, the slot is free when none is left, and
+//           - so is a copy of it in the swap cache
+void
+swap_free(swap_entry_t entry) {
+    size_t offset = swap_offset(entry);
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        assert(swap_map[offset] != 0);
+        if (-- swap_map[offset] == 0) {
+            slot_set_free(offset);
+            swap_cache_drop(entry);
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
+// swap_count - the number of ptes holding entry
+int
+swap_count(swap_entry_t entry) {
+    return swap_map[swap_offset(entry)];
+}
+
+void
+print_swap_slot(void) {
+    cprintf("swap slots: %u of %u in use, at most %u, %u allocated in %u runs.\n",
+            swap_slot_stat.nr_used, swap_slot_stat.nr_slot, swap_slot_stat.max_used,
+            swap_slot_stat.nr_alloc, swap_slot_stat.nr_cluster);
+}
+
+static void
+check_swap_slot(void) {
+    swap_entry_t entries[SWAP_CLUSTER + 1];
+    size_t nr_used_store = swap_slot_stat.nr_used;
+    int i;
+
+    // a run is handed out in order, and never starts at slot 0
+    for (i = 0; i <= SWAP_CLUSTER; i ++) {
+        assert((entries[i] = swap_alloc()) != 0);
+        assert(swap_count(entries[i]) == 1);
+        if (i > 0 && i < SWAP_CLUSTER) {
+            assert(swap_offset(entries[i]) == swap_offset(entries[i - 1]) + 1);
+        }
+    }
+    assert(swap_slot_stat.nr_used == nr_used_store + SWAP_CLUSTER + 1);
+
+    // a shared entry stays until its last pte is gone
+    assert(swap_dup(entries[1]) == 0 && swap_count(entries[1]) == 2);
+    swap_free(entries[1]);
+    assert(swap_count(entries[1]) == 1);
+
+    for (i = 0; i <= SWAP_CLUSTER; i ++) {
+        swap_free(entries[i]);
+        assert(swap_count(entries[i]) == 0);
+    }
+    assert(swap_slot_stat.nr_used == nr_used_store);
+    cluster_next = cluster_left = scan_next = 0;
+
+    cprintf("check_swap_slot() succeeded!\n");
+}
+
@@ -0,0 +1,29 @@
+#ifndef __KERN_MM_SWAP_SLOT_H__
+#define __KERN_MM_SWAP_SLOT_H__
+
+#include <defs.h>
+#include <memlayout.h>
+
+#define SWAP_CLUSTER            32      // slots handed out in a row before looking for the next free run
+#define SWAP_COUNT_MAX          0xff    // ptes which can hold one swap entry
+
+// counters of the swap slot allocator, printed by print_swap_slot
+struct swap_slot_stat {
+    size_t nr_slot;                     // slots on the swap disk, slot 0 is never used
+    size_t nr_used;                     // slots held by some pte
+    size_t max_used;                    // the most slots held at a time
+    size_t nr_alloc;                    // slots allocated
+    size_t nr_cluster;                  // free runs of SWAP_CLUSTER slots started
+};
+
+extern struct swap_slot_stat swap_slot_stat;
+
+void swap_slot_init(void);
+swap_entry_t swap_alloc(void);
+int swap_dup(swap_entry_t entry);
+void swap_free(swap_entry_t entry);
+int swap_count(swap_entry_t entry);
+void print_swap_slot(void);
+
+#endif /* !__KERN_MM_SWAP_SLOT_H__ */
+
@@ -6,14 +6,20 @@
 #include <error.h>
 #include <pmm.h>
 #include <x86.h>
+#include <stdlib.h>
 #include <swap.h>
 #include <kmalloc.h>
+#include <slub.h>
+#include <inode.h>
+#include <iobuf.h>
+#include <filemap.h>
 
 /* 
   vmm design include two parts: mm_struct (mm) & vma_struct (vma)
   mm is the memory manager for the set of continuous virtual memory  
   area which have the same PDT. vma is a continuous virtual memory area.
-  There a linear link list for vma & a redblack link list for vma in mm.
+  There a linear link list for vma & a redblack tree for vma in mm, the list
+  is walked in address order, the tree makes find_vma and insert_vma_struct O(log n).
 ---------------
   mm related functions:
    golbal functions
@@ -38,20 +44,34 @@
 static void check_vmm(void);
 static void check_vma_struct(void);
 static void check_pgfault(void);
+static void check_cow(void);
+static void check_pt_live(void);
+static void bench_find_vma(void);
+
+static struct kmem_cache_t *mm_cachep;     // cache of mm_struct
+static struct kmem_cache_t *vma_cachep;    // cache of vma_struct
 
 // mm_create -  alloc a mm_struct & initialize it.
 struct mm_struct *
 mm_create(void) {
-    struct mm_struct *mm = kmalloc(sizeof(struct mm_struct));
+    struct mm_struct *mm = kmem_cache_alloc(mm_cachep);
 
     if (mm != NULL) {
         list_init(&(mm->mmap_list));
+        rb_tree_init(&(mm->mmap_tree));
         mm->mmap_cache = NULL;
         mm->pgdir = NULL;
         mm->map_count = 0;
-
-        if (swap_init_ok) swap_init_mm(mm);
-        else mm->sm_priv = NULL;
+        mm->brk_start = mm->brk = 0;
+        mm->fault_around = FAULT_AROUND_PAGES;
+        mm->nr_fault = mm->nr_around = 0;
+        mm->nr_zero = mm->nr_zero_cow = 0;
+
+        mm->sm_priv = NULL;
+        if (swap_init_ok && swap_init_mm(mm) != 0) {
+            kmem_cache_free(mm_cachep, mm);
+            return NULL;
+        }
         
         set_mm_count(mm, 0);
         sem_init(&(mm->mm_sem), 1);
@@ -62,16 +82,93 @@ mm_create(void) {
 // vma_create - alloc a vma_struct & initialize it. (addr range: vm_start~vm_end)
 struct vma_struct *
 vma_create(uintptr_t vm_start, uintptr_t vm_end, uint32_t vm_flags) {
-    struct vma_struct *vma = kmalloc(sizeof(struct vma_struct));
+    struct vma_struct *vma = kmem_cache_alloc(vma_cachep);
 
     if (vma != NULL) {
         vma->vm_start = vm_start;
         vma->vm_end = vm_end;
         vma->vm_flags = vm_flags;
+        vma->vm_file = NULL;
     }
     return vma;
 }
 
+// vma_set_file - back [start, start + filesz) of vma with the file node from offset
+static void
+vma_set_file(struct vma_struct *vma, struct inode *node, off_t offset, uintptr_t start, size_t filesz) {
+    assert(vma->vm_file == NULL && vma->vm_start <= start && start + filesz <= vma->vm_end);
+    vop_ref_inc(node);
+    vma->vm_file = node;
+    vma->vm_file_off = offset;
+    vma->vm_file_start = start;
+    vma->vm_file_end = start + filesz;
+}
+
+// vma_dup_file - back vma with the same file as from
+static void
+vma_dup_file(struct vma_struct *vma, struct vma_struct *from) {
+    if (from->vm_file != NULL) {
+        vop_ref_inc(from->vm_file);
+        vma->vm_file = from->vm_file;
+        vma->vm_file_off = from->vm_file_off;
+        vma->vm_file_start = from->vm_file_start;
+        vma->vm_file_end = from->vm_file_end;
+    }
+}
+
+// vma_destroy - free a vma which is not in any mm
+static void
+vma_destroy(struct vma_struct *vma) {
+    if (vma->vm_file != NULL) {
+        vop_ref_dec(vma->vm_file);
+    }
+    kmem_cache_free(vma_cachep, vma);
+}
+
+
+// vma_compare - order of vma in mm->mmap_tree
+static int
+vma_compare(rb_node_t *a, rb_node_t *b) {
+    uintptr_t start1 = rbn2vma(a, rb_link)->vm_start, start2 = rbn2vma(b, rb_link)->vm_start;
+    return (start1 < start2) ? -1 : (start1 > start2) ? 1 : 0;
+}
+
+// find_vma_rb - search mm->mmap_tree for the vma which includes addr, vma do not overlap
+static struct vma_struct *
+find_vma_rb(struct mm_struct *mm, uintptr_t addr) {
+    rb_node_t *node = mm->mmap_tree.root;
+    while (node != NULL) {
+        struct vma_struct *vma = rbn2vma(node, rb_link);
+        if (addr < vma->vm_start) {
+            node = node->left;
+        }
+        else if (addr >= vma->vm_end) {
+            node = node->right;
+        }
+        else {
+            return vma;
+        }
+    }
+    return NULL;
+}
+
+// find_vma_above - the first vma which ends above addr, it may start above addr too
+static struct vma_struct *
+find_vma_above(struct mm_struct *mm, uintptr_t addr) {
+    struct vma_struct *above = NULL;
+    rb_node_t *node = mm->mmap_tree.root;
+    while (node != NULL) {
+        struct vma_struct *vma = rbn2vma(node, rb_link);
+        if (addr < vma->vm_end) {
+            above = vma;
+            node = node->left;
+        }
+        else {
+            node = node->right;
+        }
+    }
+    return above;
+}
 
 // find_vma - find a vma  (vma->vm_start <= addr <= vma_vm_end)
 struct vma_struct *
@@ -80,18 +177,7 @@ find_vma(struct mm_struct *mm, uintptr_t addr) {
     if (mm != NULL) {
         vma = mm->mmap_cache;
         if (!(vma != NULL && vma->vm_start <= addr && vma->vm_end > addr)) {
-                bool found = 0;
-                list_entry_t *list = &(mm->mmap_list), *le = list;
-                while ((le = list_next(le)) != list) {
-                    vma = le2vma(le, list_link);
-                    if (vma->vm_start<=addr && addr < vma->vm_end) {
-                        found = 1;
-                        break;
-                    }
-                }
-                if (!found) {
-                    vma = NULL;
-                }
+            vma = find_vma_rb(mm, addr);
         }
         if (vma != NULL) {
             mm->mmap_cache = vma;
@@ -100,6 +186,15 @@ find_vma(struct mm_struct *mm, uintptr_t addr) {
     return vma;
 }
 
+// find_vma_intersection - a vma which overlaps [start, end), if there is one
+struct vma_struct *
+find_vma_intersection(struct mm_struct *mm, uintptr_t start, uintptr_t end) {
+    struct vma_struct *vma = find_vma_above(mm, start);
+    if (vma != NULL && end <= vma->vm_start) {
+        vma = NULL;
+    }
+    return vma;
+}
 
 // check_vma_overlap - check if vma1 overlaps vma2 ?
 static inline void
@@ -117,14 +212,18 @@ insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
     list_entry_t *list = &(mm->mmap_list);
     list_entry_t *le_prev = list, *le_next;
 
-        list_entry_t *le = list;
-        while ((le = list_next(le)) != list) {
-            struct vma_struct *mmap_prev = le2vma(le, list_link);
-            if (mmap_prev->vm_start > vma->vm_start) {
-                break;
-            }
-            le_prev = le;
+    // the last vma which starts at or below vma is the one to insert after
+    rb_node_t *node = mm->mmap_tree.root;
+    while (node != NULL) {
+        struct vma_struct *mmap_prev = rbn2vma(node, rb_link);
+        if (mmap_prev->vm_start > vma->vm_start) {
+            node = node->left;
         }
+        else {
+            le_prev = &(mmap_prev->list_link);
+            node = node->right;
+        }
+    }
 
     le_next = list_next(le_prev);
 
@@ -138,10 +237,23 @@ insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
 
     vma->vm_mm = mm;
     list_add_after(le_prev, &(vma->list_link));
+    rb_insert(&(mm->mmap_tree), &(vma->rb_link), vma_compare);
 
     mm->map_count ++;
 }
 
+// remove_vma_struct - take vma out of mm's list link and tree
+static void
+remove_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
+    assert(vma->vm_mm == mm);
+    list_del(&(vma->list_link));
+    rb_delete(&(mm->mmap_tree), &(vma->rb_link));
+    if (mm->mmap_cache == vma) {
+        mm->mmap_cache = NULL;
+    }
+    mm->map_count --;
+}
+
 // mm_destroy - free mm and mm internal fields
 void
 mm_destroy(struct mm_struct *mm) {
@@ -150,9 +262,12 @@ mm_destroy(struct mm_struct *mm) {
     list_entry_t *list = &(mm->mmap_list), *le;
     while ((le = list_next(list)) != list) {
         list_del(le);
-        kfree(le2vma(le, list_link));  //kfree vma        
+        vma_destroy(le2vma(le, list_link));  //kfree vma
     }
-    kfree(mm); //kfree mm
+    if (swap_init_ok) {
+        swap_exit_mm(mm);
+    }
+    kmem_cache_free(mm_cachep, mm); //kfree mm
     mm=NULL;
 }
 
@@ -187,9 +302,192 @@ out:
     return ret;
 }
 
+// mm_map_file - like mm_map, the first filesz bytes from addr are read from node at offset
+//             - the first time they are touched, the rest up to addr + len is zero filled
+int
+mm_map_file(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags,
+            struct inode *node, off_t offset, size_t filesz, struct vma_struct **vma_store) {
+    if (filesz > len || offset < 0) {
+        return -E_INVAL;
+    }
+    struct vma_struct *vma;
+    int ret;
+    if ((ret = mm_map(mm, addr, len, vm_flags, &vma)) != 0) {
+        return ret;
+    }
+    if (filesz != 0) {
+        vma_set_file(vma, node, offset, addr, filesz);
+    }
+    if (vma_store != NULL) {
+        *vma_store = vma;
+    }
+    return 0;
+}
+
+// huge_cut - whether cutting the vma of mm at addr would leave part of a 4MB page
+static bool
+huge_cut(struct mm_struct *mm, uintptr_t addr) {
+    struct vma_struct *vma = find_vma(mm, addr);
+    return vma != NULL && (vma->vm_flags & VM_HUGE) && vma->vm_start < addr && addr % PTSIZE != 0;
+}
+
+// mm_unmap - remove [addr, addr + len) from the vma of mm and unmap its pages,
+//          - the vma which are partly in the range are cut or split in two. A range
+//          - ending inside a 4MB page of a VM_HUGE vma takes all of it, one starting
+//          - there is refused. The dirty pages of shared file mappings are written back
+//          - first; the range is unmapped even if that fails, and the error is returned
+int
+mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len) {
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+    if (!USER_ACCESS(start, end)) {
+        return -E_INVAL;
+    }
+
+    assert(mm != NULL);
+    if (huge_cut(mm, start)) {
+        return -E_INVAL;
+    }
+    if (huge_cut(mm, end)) {
+        end = ROUNDUP(end, PTSIZE);
+    }
+
+    struct vma_struct *vma, *nvma;
+    if ((vma = find_vma_above(mm, start)) == NULL || end <= vma->vm_start) {
+        return 0;
+    }
+
+    int ret = 0, r;
+
+    if (vma->vm_start < start && end < vma->vm_end) {
+        if ((nvma = vma_create(end, vma->vm_end, vma->vm_flags)) == NULL) {
+            return -E_NO_MEM;
+        }
+        vma_dup_file(nvma, vma);
+        if (vma->vm_flags & VM_SHARE) {
+            ret = filemap_sync(mm, vma, start, end);
+        }
+        vma->vm_end = start;
+        insert_vma_struct(mm, nvma);
+        unmap_range(mm->pgdir, start, end);
+        if (vma->vm_flags & VM_SHARE) {
+            filemap_release(vma->vm_file);
+        }
+        return ret;
+    }
+
+    while (vma != NULL && vma->vm_start < end) {
+        list_entry_t *le = list_next(&(vma->list_link));
+        nvma = (le != &(mm->mmap_list)) ? le2vma(le, list_link) : NULL;
+        uintptr_t un_start = (vma->vm_start < start) ? start : vma->vm_start;
+        uintptr_t un_end = (end < vma->vm_end) ? end : vma->vm_end;
+        // the shared pages are written back while the ptes still tell which are dirty,
+        // the vma may hold the last reference to the inode, the entries hold their own
+        struct inode *shared = NULL;
+        if (vma->vm_flags & VM_SHARE) {
+            if ((r = filemap_sync(mm, vma, un_start, un_end)) != 0 && ret == 0) {
+                ret = r;
+            }
+            shared = vma->vm_file;
+        }
+        if (vma->vm_start < start) {
+            vma->vm_end = start;
+        }
+        else if (end < vma->vm_end) {
+            // the new start is still above the end of the vma before, so vma keeps its
+            // place in the list and in the tree
+            vma->vm_start = end;
+        }
+        else {
+            remove_vma_struct(mm, vma);
+            vma_destroy(vma);
+        }
+        unmap_range(mm->pgdir, un_start, un_end);
+        if (shared != NULL) {
+            filemap_release(shared);
+        }
+        vma = nvma;
+    }
+    return ret;
+}
+
+// mm_msync - write the pages of the shared file mappings in [addr, addr + len) which
+//          - were written back to their files
+int
+mm_msync(struct mm_struct *mm, uintptr_t addr, size_t len) {
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+    if (!USER_ACCESS(start, end)) {
+        return -E_INVAL;
+    }
+
+    int ret;
+    struct vma_struct *vma = find_vma_above(mm, start);
+    for (; vma != NULL && vma->vm_start < end; vma = find_vma_above(mm, vma->vm_end)) {
+        if (vma->vm_flags & VM_SHARE) {
+            uintptr_t sync_start = (vma->vm_start < start) ? start : vma->vm_start;
+            uintptr_t sync_end = (end < vma->vm_end) ? end : vma->vm_end;
+            if ((ret = filemap_sync(mm, vma, sync_start, sync_end)) != 0) {
+                return ret;
+            }
+        }
+    }
+    return 0;
+}
+
+// get_unmapped_area - the highest free range of len bytes below USERTOP which starts
+//                   - at a multiple of align, 0 if none
+uintptr_t
+get_unmapped_area(struct mm_struct *mm, size_t len, size_t align) {
+    if (len == 0 || len > USERTOP) {
+        return 0;
+    }
+    uintptr_t start = ROUNDDOWN(USERTOP - len, align);
+    list_entry_t *list = &(mm->mmap_list), *le = list;
+    while ((le = list_prev(le)) != list) {
+        struct vma_struct *vma = le2vma(le, list_link);
+        if (start >= vma->vm_end) {
+            return start;
+        }
+        if (start + len > vma->vm_start) {
+            if (len >= vma->vm_start) {
+                return 0;
+            }
+            start = ROUNDDOWN(vma->vm_start - len, align);
+        }
+    }
+    return (start >= USERBASE) ? start : 0;
+}
+
+// mm_brk - map [addr, addr + len) as anonymous read/write memory for the heap,
+//        - growing the vma just below it when it is anonymous heap too
+int
+mm_brk(struct mm_struct *mm, uintptr_t addr, size_t len) {
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+    if (!USER_ACCESS(start, end)) {
+        return -E_INVAL;
+    }
+
+    int ret;
+    // a shared file mapping whose write back failed is gone all the same
+    if ((ret = mm_unmap(mm, start, end - start)) != 0 && find_vma_intersection(mm, start, end) != NULL) {
+        return ret;
+    }
+    uint32_t vm_flags = VM_READ | VM_WRITE;
+    struct vma_struct *vma = find_vma(mm, start - 1);
+    if (vma != NULL && vma->vm_end == start && vma->vm_flags == vm_flags && vma->vm_file == NULL) {
+        vma->vm_end = end;
+        return 0;
+    }
+    if ((vma = vma_create(start, end, vm_flags)) == NULL) {
+        return -E_NO_MEM;
+    }
+    insert_vma_struct(mm, vma);
+    return 0;
+}
+
 int
 dup_mmap(struct mm_struct *to, struct mm_struct *from) {
     assert(to != NULL && from != NULL);
+    to->fault_around = from->fault_around;
     list_entry_t *list = &(from->mmap_list), *le = list;
     while ((le = list_prev(le)) != list) {
         struct vma_struct *vma, *nvma;
@@ -199,13 +497,16 @@ dup_mmap(struct mm_struct *to, struct mm_struct *from) {
             return -E_NO_MEM;
         }
 
+        vma_dup_file(nvma, vma);
         insert_vma_struct(to, nvma);
 
-        bool share = 0;
+        // share the pages copy-on-write, most children exec soon and never write them
+        bool share = 1;
         if (copy_range(to->pgdir, from->pgdir, vma->vm_start, vma->vm_end, share) != 0) {
             return -E_NO_MEM;
         }
     }
+    to->brk_start = from->brk_start, to->brk = from->brk;
     return 0;
 }
 
@@ -216,7 +517,17 @@ exit_mmap(struct mm_struct *mm) {
     list_entry_t *list = &(mm->mmap_list), *le = list;
     while ((le = list_next(le)) != list) {
         struct vma_struct *vma = le2vma(le, list_link);
+        if (vma->vm_flags & VM_SHARE) {
+            // nobody is left to return the error to
+            int ret = filemap_sync(mm, vma, vma->vm_start, vma->vm_end);
+            if (ret != 0) {
+                cprintf("filemap_sync in exit_mmap failed: %e\n", ret);
+            }
+        }
         unmap_range(pgdir, vma->vm_start, vma->vm_end);
+        if (vma->vm_flags & VM_SHARE) {
+            filemap_release(vma->vm_file);
+        }
     }
     while ((le = list_next(le)) != list) {
         struct vma_struct *vma = le2vma(le, list_link);
@@ -246,6 +557,18 @@ copy_to_user(struct mm_struct *mm, void *dst, const void *src, size_t len) {
 //          - now just call check_vmm to check correctness of vmm
 void
 vmm_init(void) {
+    if ((mm_cachep = kmem_cache_create("mm_struct", sizeof(struct mm_struct), NULL, NULL)) == NULL ||
+        (vma_cachep = kmem_cache_create("vma_struct", sizeof(struct vma_struct), NULL, NULL)) == NULL) {
+        panic("vmm_init: cannot create mm/vma caches.\n");
+    }
+    filemap_init();
+    // the zero page is never freed, and Reserved keeps compaction from moving it
+    if ((zero_page = alloc_page()) == NULL) {
+        panic("vmm_init: cannot alloc the zero page.\n");
+    }
+    memset(page2kva(zero_page), 0, PGSIZE);
+    page_ref_inc(zero_page);
+    SetPageReserved(zero_page);
     check_vmm();
 }
 
@@ -256,6 +579,9 @@ check_vmm(void) {
     
     check_vma_struct();
     check_pgfault();
+    check_cow();
+    check_pt_live();
+    bench_find_vma();
 
     cprintf("check_vmm() succeeded.\n");
 }
@@ -283,13 +609,18 @@ check_vma_struct(void) {
     }
 
     list_entry_t *le = list_next(&(mm->mmap_list));
+    rb_node_t *node = rb_first(&(mm->mmap_tree));
 
+    assert(rb_tree_check(&(mm->mmap_tree), vma_compare) > 0);
     for (i = 1; i <= step2; i ++) {
-        assert(le != &(mm->mmap_list));
+        assert(le != &(mm->mmap_list) && node != NULL);
         struct vma_struct *mmap = le2vma(le, list_link);
         assert(mmap->vm_start == i * 5 && mmap->vm_end == i * 5 + 2);
+        assert(rbn2vma(node, rb_link) == mmap);
         le = list_next(le);
+        node = rb_next(node);
     }
+    assert(node == NULL);
 
     for (i = 5; i <= 5 * step2; i +=5) {
         struct vma_struct *vma1 = find_vma(mm, i);
@@ -333,6 +664,8 @@ check_pgfault(void) {
     struct mm_struct *mm = check_mm_struct;
     pde_t *pgdir = mm->pgdir = boot_pgdir;
     assert(pgdir[0] == 0);
+    // only the page at addr is removed below
+    mm->fault_around = 1;
 
     struct vma_struct *vma = vma_create(0, PTSIZE, VM_WRITE);
     assert(vma != NULL);
@@ -364,8 +697,465 @@ check_pgfault(void) {
 
     cprintf("check_pgfault() succeeded!\n");
 }
+// check_cow - share a page between two mm with copy_range, then write it from both sides
+static void
+check_cow(void) {
+    struct mm_struct *mm1 = mm_create(), *mm2 = mm_create();
+    assert(mm1 != NULL && mm2 != NULL);
+    struct Page *pd1 = alloc_page(), *pd2 = alloc_page();
+    assert(pd1 != NULL && pd2 != NULL);
+    mm1->pgdir = page2kva(pd1), mm2->pgdir = page2kva(pd2);
+    memcpy(mm1->pgdir, boot_pgdir, PGSIZE);
+    memcpy(mm2->pgdir, boot_pgdir, PGSIZE);
+
+    struct vma_struct *vma1 = vma_create(UTEXT, UTEXT + PGSIZE, VM_READ | VM_WRITE);
+    struct vma_struct *vma2 = vma_create(UTEXT, UTEXT + PGSIZE, VM_READ | VM_WRITE);
+    assert(vma1 != NULL && vma2 != NULL);
+    insert_vma_struct(mm1, vma1);
+    insert_vma_struct(mm2, vma2);
+
+    size_t nr_free_pages_store = nr_free_pages();
+
+    assert(do_pgfault(mm1, 2, UTEXT) == 0);
+    pte_t *ptep1 = get_pte(mm1->pgdir, UTEXT, 0), *ptep2;
+    assert(ptep1 != NULL && (*ptep1 & PTE_W));
+    struct Page *page = pte2page(*ptep1), *npage;
+    memset(page2kva(page), 0x5a, PGSIZE);
+
+    assert(copy_range(mm2->pgdir, mm1->pgdir, UTEXT, UTEXT + PGSIZE, 1) == 0);
+    assert((ptep2 = get_pte(mm2->pgdir, UTEXT, 0)) != NULL && pte2page(*ptep2) == page);
+    assert(page_ref(page) == 2 && !(*ptep1 & PTE_W) && !(*ptep2 & PTE_W));
+
+    // the first writer gets a copy, the last one gets the page back writable
+    assert(do_pgfault(mm2, 3, UTEXT) == 0);
+    npage = pte2page(*ptep2);
+    assert(npage != page && page_ref(page) == 1 && page_ref(npage) == 1 && (*ptep2 & PTE_W));
+    assert(*(uint8_t *)(page2kva(npage) + PGSIZE - 1) == 0x5a);
+    assert(do_pgfault(mm1, 3, UTEXT) == 0);
+    assert(pte2page(*ptep1) == page && (*ptep1 & PTE_W));
+
+    unmap_range(mm1->pgdir, UTEXT, UTEXT + PGSIZE);
+    unmap_range(mm2->pgdir, UTEXT, UTEXT + PGSIZE);
+    exit_range(mm1->pgdir, UTEXT, UTEXT + PGSIZE);
+    exit_range(mm2->pgdir, UTEXT, UTEXT + PGSIZE);
+    assert(nr_free_pages_store == nr_free_pages());
+
+    free_page(pd1);
+    free_page(pd2);
+    mm1->pgdir = mm2->pgdir = NULL;
+    mm_destroy(mm1);
+    mm_destroy(mm2);
+
+    cprintf("check_cow() succeeded!\n");
+}
+
+// check_pt_live - page tables count their live ptes, and unmap_range frees them
+//               - when the count drops to zero
+static void
+check_pt_live(void) {
+    struct Page *pd = alloc_page(), *p;
+    assert(pd != NULL);
+    pde_t *pgdir = page2kva(pd);
+    memcpy(pgdir, boot_pgdir, PGSIZE);
+
+    size_t nr_free_pages_store = nr_free_pages();
+
+    int i;
+    for (i = 0; i < 4; i ++) {
+        assert((p = alloc_page()) != NULL);
+        assert(page_insert(pgdir, p, UTEXT + i * 2 * PGSIZE, PTE_U | PTE_W) == 0);
+    }
+    struct Page *ptpage = pde2page(pgdir[PDX(UTEXT)]);
+    assert(pt_live(ptpage) == 4);
+
+    // mapping a page where one is mapped already does not add a pte
+    assert(page_insert(pgdir, p, UTEXT, PTE_U) == 0);
+    assert(pt_live(ptpage) == 4 && page_ref(p) == 2);
+
+    unmap_range(pgdir, UTEXT, UTEXT + 3 * PGSIZE);
+    assert(pt_live(ptpage) == 2 && (pgdir[PDX(UTEXT)] & PTE_P));
+    unmap_range(pgdir, UTEXT, UTEXT + PTSIZE);
+    assert(pgdir[PDX(UTEXT)] == 0);
+    assert(nr_free_pages_store == nr_free_pages());
+
+    free_page(pd);
+
+    cprintf("check_pt_live() succeeded!\n");
+}
+
+#define BENCH_NR_VMA                4096
+#define BENCH_ROUNDS                4096
+#define BENCH_FAULTS                1024
+#define BENCH_BASE                  0x10000000
+
+// find_vma_list - the linear search of mm->mmap_list find_vma did before the tree
+static struct vma_struct *
+find_vma_list(struct mm_struct *mm, uintptr_t addr) {
+    list_entry_t *list = &(mm->mmap_list), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct vma_struct *vma = le2vma(le, list_link);
+        if (vma->vm_start <= addr && addr < vma->vm_end) {
+            return vma;
+        }
+    }
+    return NULL;
+}
+
+// bench_find_vma - a mm with BENCH_NR_VMA one-page vma (one page apart), look up
+//                - random addresses in it through the list and through the tree,
+//                - then take random page faults in it through do_pgfault
+static void
+bench_find_vma(void) {
+    uint64_t start, cycles;
+    uintptr_t addr;
+    int i;
+
+    struct mm_struct *mm = mm_create();
+    assert(mm != NULL);
+    pde_t *pgdir = mm->pgdir = boot_pgdir;
+
+    // insert them in a shuffled order, so that the tree has to rebalance
+    for (i = 0; i < BENCH_NR_VMA; i ++) {
+        addr = BENCH_BASE + (uintptr_t)((i * 1021) % BENCH_NR_VMA) * 2 * PGSIZE;
+        struct vma_struct *vma = vma_create(addr, addr + PGSIZE, VM_READ | VM_WRITE);
+        assert(vma != NULL);
+        insert_vma_struct(mm, vma);
+    }
+    assert(mm->map_count == BENCH_NR_VMA && rb_tree_check(&(mm->mmap_tree), vma_compare) > 0);
+    size_t nr_free_pages_store = nr_free_pages();
+
+    srand(BENCH_NR_VMA);
+    for (i = 0; i < BENCH_ROUNDS; i ++) {
+        addr = BENCH_BASE + (rand() % (2 * BENCH_NR_VMA)) * PGSIZE + rand() % PGSIZE;
+        assert(find_vma(mm, addr) == find_vma_list(mm, addr));
+    }
+
+    srand(BENCH_NR_VMA);
+    start = rdtsc();
+    for (i = 0; i < BENCH_ROUNDS; i ++) {
+        find_vma_list(mm, BENCH_BASE + (rand() % (2 * BENCH_NR_VMA)) * PGSIZE);
+    }
+    cycles = rdtsc() - start;
+    do_div(cycles, BENCH_ROUNDS);
+    cprintf("bench_find_vma: %d vma, list lookup: %u cycles\n", BENCH_NR_VMA, (unsigned int)cycles);
+
+    srand(BENCH_NR_VMA);
+    start = rdtsc();
+    for (i = 0; i < BENCH_ROUNDS; i ++) {
+        find_vma(mm, BENCH_BASE + (rand() % (2 * BENCH_NR_VMA)) * PGSIZE);
+    }
+    cycles = rdtsc() - start;
+    do_div(cycles, BENCH_ROUNDS);
+    cprintf("bench_find_vma: %d vma, rb tree lookup: %u cycles\n", BENCH_NR_VMA, (unsigned int)cycles);
+
+    // every fault maps a new page, which is unmapped again outside of the timing
+    unsigned int pgfault_num_store = pgfault_num;
+    cycles = 0;
+    for (i = 0; i < BENCH_FAULTS; i ++) {
+        addr = BENCH_BASE + (rand() % BENCH_NR_VMA) * 2 * PGSIZE + rand() % PGSIZE;
+        start = rdtsc();
+        assert(do_pgfault(mm, 2, addr) == 0);
+        cycles += rdtsc() - start;
+        page_remove(pgdir, ROUNDDOWN(addr, PGSIZE));
+    }
+    do_div(cycles, BENCH_FAULTS);
+    cprintf("bench_find_vma: %d vma, random page fault: %u cycles\n", BENCH_NR_VMA, (unsigned int)cycles);
+    pgfault_num = pgfault_num_store;
+
+    for (addr = BENCH_BASE; addr < BENCH_BASE + BENCH_NR_VMA * 2 * PGSIZE; addr += PTSIZE) {
+        if (pgdir[PDX(addr)] & PTE_P) {
+            free_page(pde2page(pgdir[PDX(addr)]));
+            pgdir[PDX(addr)] = 0;
+        }
+    }
+    assert(nr_free_pages_store == nr_free_pages());
+
+    mm->pgdir = NULL;
+    mm_destroy(mm);
+    kmem_cache_shrink(vma_cachep);
+}
+
 //page fault number
 volatile unsigned int pgfault_num=0;
+//pages mapped by fault-around
+volatile unsigned int pgfault_around_num=0;
+
+// the frame mapped read-only by every read of anonymous memory nobody wrote yet
+struct Page *zero_page;
+struct zero_page_stat zero_page_stat;
+
+// vma_zero_page - whether the page at addr of vma reads as zero until it is written:
+//               - anonymous memory and the bss part of a program
+static inline bool
+vma_zero_page(struct vma_struct *vma, uintptr_t addr) {
+    if (vma->vm_flags & VM_SHARE) {
+        return 0;
+    }
+    return vma->vm_file == NULL || addr >= vma->vm_file_end || addr + PGSIZE <= vma->vm_file_start;
+}
+
+// map_zero_page - map the zero page at addr read-only, the first write gets a private
+//               - page in do_pgfault like copy-on-write
+static int
+map_zero_page(struct mm_struct *mm, uintptr_t addr, uint32_t perm) {
+    int ret;
+    if ((ret = page_insert(mm->pgdir, zero_page, addr, perm & ~PTE_W)) != 0) {
+        return ret;
+    }
+    mm->nr_zero ++, zero_page_stat.nr_zero ++;
+    if (page_ref(zero_page) - 1 > zero_page_stat.max_shared) {
+        zero_page_stat.max_shared = page_ref(zero_page) - 1;
+    }
+    return 0;
+}
+
+void
+print_zero_page(void) {
+    cprintf("zero page: %u reads mapped it, %u of them written later, %u ptes (%u KB) shared it at most.\n",
+            zero_page_stat.nr_zero, zero_page_stat.nr_zero_cow,
+            zero_page_stat.max_shared, zero_page_stat.max_shared * (PGSIZE / 1024));
+}
+
+struct huge_page_stat huge_page_stat;
+
+void
+print_huge_page(void) {
+    cprintf("huge pages: %u mapped, %u faults fell back to 4KB pages, %u copied on write, %u split.\n",
+            huge_page_stat.nr_fault, huge_page_stat.nr_fallback, huge_page_stat.nr_cow, huge_page_stat.nr_split);
+}
+
+// page_swappable - hand a private page of mm, which is filled now, to the swap manager
+static void
+page_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page) {
+    if (swap_init_ok && !PageSwappable(page)) {
+        page->pra_vaddr = addr;
+        swap_map_swappable(mm, addr, page, 0);
+    }
+}
+
+/* *
+ * A VM_HUGE vma (mmap with MMAP_HUGE) is anonymous memory which starts and ends at
+ * 4MB boundaries. The first fault in each 4MB of it maps a whole 4MB page with one
+ * large PDE when alloc_huge_page finds an aligned 4MB block; else that 4MB falls back
+ * to a page table and 4KB pages as usual. A 4MB page shared since fork is copied whole
+ * on the first write, or into 4KB pages when there is no 4MB block free.
+ * */
+
+// huge_fault - map a new zero filled 4MB page for the 4MB of vma around addr
+static int
+huge_fault(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr, uint32_t perm) {
+    uintptr_t la = ROUNDDOWN(addr, PTSIZE);
+    assert(vma->vm_start <= la && la + PTSIZE <= vma->vm_end);
+    struct Page *page;
+    if ((page = alloc_huge_page()) == NULL) {
+        return -E_NO_MEM;
+    }
+    memset(page2kva(page), 0, PTSIZE);
+    page_ref_inc(page);
+    mm->pgdir[PDX(la)] = page2pa(page) | PTE_PS | PTE_P | perm;
+    huge_page_stat.nr_fault ++;
+    return 0;
+}
+
+// huge_split - copy the shared 4MB page of the large PDE at pdep into a page table of
+//            - 4KB pages, for a write when there is no 4MB page for a copy
+static int
+huge_split(struct mm_struct *mm, uintptr_t la, pde_t *pdep, uint32_t perm) {
+    struct Page *page = pde2page(*pdep), *ptpage, *npage;
+    if ((ptpage = alloc_page()) == NULL) {
+        return -E_NO_MEM;
+    }
+    pte_t *pt = page2kva(ptpage);
+    int i;
+    for (i = 0; i < NPTEENTRY; i ++) {
+        if ((npage = alloc_page()) == NULL) {
+            while (-- i >= 0) {
+                free_page(pte2page(pt[i]));
+            }
+            free_page(ptpage);
+            return -E_NO_MEM;
+        }
+        memcpy(page2kva(npage), page2kva(page) + i * PGSIZE, PGSIZE);
+        set_page_ref(npage, 1);
+        npage->pra_vaddr = la + i * PGSIZE;
+        pt[i] = page2pa(npage) | PTE_P | perm;
+    }
+    set_page_ref(ptpage, 1);
+    set_pt_live(ptpage, NPTEENTRY);
+    page_ref_dec(page);
+    *pdep = page2pa(ptpage) | PTE_U | PTE_W | PTE_P;
+    tlb_invalidate(mm->pgdir, la);
+    // the 4KB pages are private pages like any other, reclaim may write them out
+    for (i = 0; i < NPTEENTRY; i ++) {
+        page_swappable(mm, la + i * PGSIZE, pte2page(pt[i]));
+    }
+    huge_page_stat.nr_split ++;
+    return 0;
+}
+
+// huge_cow - a write to the read-only large PDE at pdep in a writable vma
+static int
+huge_cow(struct mm_struct *mm, uintptr_t addr, pde_t *pdep, uint32_t perm) {
+    uintptr_t la = ROUNDDOWN(addr, PTSIZE);
+    struct Page *page = pde2page(*pdep), *npage;
+    if (page_ref(page) > 1) {
+        if ((npage = alloc_huge_page()) == NULL) {
+            return huge_split(mm, la, pdep, perm);
+        }
+        memcpy(page2kva(npage), page2kva(page), PTSIZE);
+        page_ref_inc(npage);
+        page_ref_dec(page);
+        *pdep = page2pa(npage) | PTE_PS | PTE_P | perm;
+        huge_page_stat.nr_cow ++;
+    }
+    else {
+        *pdep |= PTE_W;
+    }
+    tlb_invalidate(mm->pgdir, la);
+    return 0;
+}
+
+// mm_set_fault_around - set the fault-around window of mm to pages, a power of 2
+int
+mm_set_fault_around(struct mm_struct *mm, int pages) {
+    if (pages <= 0 || pages > FAULT_AROUND_MAX || (pages & (pages - 1)) != 0) {
+        return -E_INVAL;
+    }
+    mm->fault_around = pages;
+    return 0;
+}
+
+// vma_fill_page - read the part of the page at addr which is backed by the file of vma
+//               - into page, and zero the rest of it
+static int
+vma_fill_page(struct vma_struct *vma, uintptr_t addr, struct Page *page) {
+    uintptr_t start = addr, end = addr + PGSIZE;
+    void *kva = page2kva(page);
+    if (start < vma->vm_file_start) {
+        start = vma->vm_file_start;
+    }
+    if (end > vma->vm_file_end) {
+        end = vma->vm_file_end;
+    }
+    memset(kva, 0, PGSIZE);
+    if (start < end) {
+        struct iobuf __iob, *iob = iobuf_init(&__iob, kva + (start - addr), end - start,
+                                              vma->vm_file_off + (start - vma->vm_file_start));
+        int ret;
+        if ((ret = vop_read(vma->vm_file, iob)) != 0) {
+            return ret;
+        }
+        if (iob->io_resid != 0) {
+            return -E_INVAL;
+        }
+    }
+    return 0;
+}
+
+// mm_maps_page - does mm map page at page->pra_vaddr, as a user page?
+static bool
+mm_maps_page(struct mm_struct *mm, struct Page *page, pte_t **ptep_store) {
+    if (mm == NULL || mm->pgdir == NULL) {
+        return 0;
+    }
+    pte_t *ptep = get_pte(mm->pgdir, page->pra_vaddr, 0);
+    if (ptep == NULL || (*ptep & (PTE_P | PTE_U | PTE_PS)) != (PTE_P | PTE_U)) {
+        return 0;
+    }
+    if (pte2page(*ptep) != page) {
+        return 0;
+    }
+    *ptep_store = ptep;
+    return 1;
+}
+
+// page_mm - find the mm which maps page, NULL if it is not a user page. There is no
+//         - reverse map, the page tables of every process and of check_mm_struct are looked at
+struct mm_struct *
+page_mm(struct Page *page, pte_t **ptep_store) {
+    uintptr_t la = page->pra_vaddr;
+    if (la % PGSIZE != 0 || la >= USERTOP) {
+        return NULL;
+    }
+    if (mm_maps_page(check_mm_struct, page, ptep_store)) {
+        return check_mm_struct;
+    }
+    list_entry_t *le = &proc_list;
+    while ((le = list_next(le)) != &proc_list) {
+        struct mm_struct *mm = le2proc(le, list_link)->mm;
+        if (mm_maps_page(mm, page, ptep_store)) {
+            return mm;
+        }
+    }
+    return NULL;
+}
+
+/* *
+ * fault_around - after a not-present fault at addr, map the other unmapped pages of
+ * the aligned window of mm->fault_around pages around it, within vma and the page
+ * table of addr. Sequential accesses (bss zeroing, stack growth, scans of a heap
+ * array) then take one trap per window instead of one per page.
+ *
+ * Only pages which are resident already are mapped: the zero page for reads of
+ * anonymous memory, and pages of a shared file mapping which are in the filemap.
+ * A page which would have to be allocated or read from the file is left to its own
+ * fault, the access may never come. Nothing is allocated here, but the window is
+ * still halved (it stays aligned) while fewer than FAULT_AROUND_MIN_FREE pages plus
+ * the window are free: under memory pressure the pages mapped around would only be
+ * more ptes for reclaim to walk.
+ * */
+static void
+fault_around(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr, uint32_t perm, bool read) {
+    size_t nr_free = nr_free_pages();
+    int pages = mm->fault_around;
+    pte_t *ptep;
+    while (pages > 1 && nr_free < FAULT_AROUND_MIN_FREE + pages) {
+        pages >>= 1;
+    }
+    if (pages <= 1) {
+        return;
+    }
+    size_t window = pages * PGSIZE;
+    // the fault may have slept in vop_read, while another thread of mm unmapped vma
+    // or the page table of addr: look both up again
+    if (find_vma(mm, addr) != vma) {
+        return;
+    }
+    if ((ptep = get_pte(mm->pgdir, addr, 0)) == NULL || (*ptep & PTE_PS)) {
+        return;
+    }
+    uintptr_t start = ROUNDDOWN(addr, window), end = start + window;
+    if (start < vma->vm_start) {
+        start = vma->vm_start;
+    }
+    if (end > vma->vm_end || end < start) {
+        end = vma->vm_end;
+    }
+    // the window is within the page table of addr, as it is at most PTSIZE and aligned
+    pte_t *pt = ptep - PTX(addr);
+    uintptr_t la;
+    for (la = start; la < end; la += PGSIZE) {
+        if (pt[PTX(la)] != 0) {
+            // addr itself, a present page or a swap entry
+            continue;
+        }
+        if (vma->vm_flags & VM_SHARE) {
+            if (!filemap_map_resident(mm, vma, la, perm)) {
+                continue;
+            }
+        }
+        else if (read && vma_zero_page(vma, la)) {
+            if (map_zero_page(mm, la, perm) != 0) {
+                break;
+            }
+        }
+        else {
+            // a private page of its own, or one read from the file
+            continue;
+        }
+        mm->nr_around ++, pgfault_around_num ++;
+    }
+}
 
 /* do_pgfault - interrupt handler to process the page fault execption
  * @mm         : the control struct for a set of vma using the same PDT
@@ -395,6 +1185,7 @@ do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
     struct vma_struct *vma = find_vma(mm, addr);
 
     pgfault_num++;
+    mm->nr_fault ++;
     //If the addr is in the range of a mm's vma?
     if (vma == NULL || vma->vm_start > addr) {
         cprintf("not valid addr %x, and  can not find it in vma\n", addr);
@@ -451,6 +1242,121 @@ do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
     *   mm->pgdir : the PDT of these vma
     *
     */
+    // try to find a pte, if pte's PT(Page Table) isn't existed, then create a PT.
+    if ((vma->vm_flags & VM_HUGE) && !(mm->pgdir[PDX(addr)] & PTE_P)) {
+        if (huge_fault(mm, vma, addr, perm) == 0) {
+            return 0;
+        }
+        // no 4MB block, this 4MB of the vma uses 4KB pages
+        huge_page_stat.nr_fallback ++;
+    }
+    if ((ptep = get_pte(mm->pgdir, addr, 1)) == NULL) {
+        cprintf("get_pte in do_pgfault failed\n");
+        goto failed;
+    }
+
+    if (*ptep == 0) {
+        // 物理页不存在，分配一页并建立映射
+        struct Page *page;
+        if (vma->vm_flags & VM_SHARE) {
+            // a page of a shared file mapping, every mm maps the same frame
+            if ((ret = filemap_fault(mm, vma, addr, perm)) != 0) {
+                cprintf("filemap_fault in do_pgfault failed: %e\n", ret);
+                goto failed;
+            }
+        }
+        else if (!(error_code & 2) && vma_zero_page(vma, addr)) {
+            // a read of memory nobody wrote yet, no need for a page of its own
+            if ((ret = map_zero_page(mm, addr, perm)) != 0) {
+                cprintf("map_zero_page in do_pgfault failed: %e\n", ret);
+                goto failed;
+            }
+        }
+        else {
+            if ((page = alloc_page()) == NULL) {
+                cprintf("alloc_page in do_pgfault failed\n");
+                goto failed;
+            }
+            // a page of a program (or its bss) mapped by load_icode, or of a private
+            // file mapping, read it in now. It is not mapped yet: vop_read may sleep,
+            // and another thread of mm may unmap addr, or fault it in, meanwhile
+            if (vma->vm_file != NULL) {
+                if ((ret = vma_fill_page(vma, addr, page)) != 0) {
+                    cprintf("vma_fill_page in do_pgfault failed: %e\n", ret);
+                    free_page(page);
+                    goto failed;
+                }
+                struct vma_struct *nvma = find_vma(mm, addr);
+                if (nvma != vma || vma->vm_start > addr
+                    || ((ptep = get_pte(mm->pgdir, addr, 0)) != NULL && *ptep != 0)) {
+                    // the access faults again, on whatever is mapped there now
+                    free_page(page);
+                    return 0;
+                }
+            }
+            if ((ret = page_insert(mm->pgdir, page, addr, perm)) != 0) {
+                cprintf("page_insert in do_pgfault failed: %e\n", ret);
+                free_page(page);
+                goto failed;
+            }
+            // not before it is filled, reclaim must not write out a page being read in
+            page_swappable(mm, addr, page);
+        }
+        fault_around(mm, vma, addr, perm, !(error_code & 2));
+    }
+    else if (*ptep & PTE_P) {
+        // write to a read-only pte in a writable vma: the page is shared copy-on-write
+        // since fork, see copy_range, or it is the zero page. The last one to write a shared
+        // page just gets it back writable, and so does everyone in a shared file mapping.
+        struct Page *page = pte2page(*ptep);
+        if (*ptep & PTE_PS) {
+            if ((ret = huge_cow(mm, addr, ptep, perm)) != 0) {
+                cprintf("huge_cow in do_pgfault failed: %e\n", ret);
+                goto failed;
+            }
+        }
+        else if (page == zero_page) {
+            // the first write to memory which was read as zero
+            if ((page = pgdir_alloc_page(mm->pgdir, addr, perm)) == NULL) {
+                cprintf("pgdir_alloc_page in do_pgfault failed\n");
+                goto failed;
+            }
+            memset(page2kva(page), 0, PGSIZE);
+            page_swappable(mm, addr, page);
+            mm->nr_zero_cow ++, zero_page_stat.nr_zero_cow ++;
+        }
+        else if (page_ref(page) > 1 && !(vma->vm_flags & VM_SHARE)) {
+            struct Page *npage;
+            if ((npage = alloc_page()) == NULL) {
+                cprintf("alloc_page in do_pgfault failed\n");
+                goto failed;
+            }
+            memcpy(page2kva(npage), page2kva(page), PGSIZE);
+            page_insert(mm->pgdir, npage, addr, perm);
+            page_swappable(mm, addr, npage);
+        }
+        else {
+            *ptep |= PTE_W;
+            tlb_invalidate(mm->pgdir, addr);
+        }
+    }
+    else {
+        // the pte is a swap entry, load the page from disk and map it again
+        if (swap_init_ok) {
+            struct Page *page = NULL;
+            if ((ret = swap_in(mm, addr, &page)) != 0) {
+                cprintf("swap_in in do_pgfault failed\n");
+                goto failed;
+            }
+            page_insert(mm->pgdir, page, addr, perm);
+            swap_map_swappable(mm, addr, page, 1);
+            page->pra_vaddr = addr;
+        }
+        else {
+            cprintf("no swap_init_ok but ptep is %x, failed\n", *ptep);
+            goto failed;
+        }
+    }
 #if 0
     /*LAB3 EXERCISE 1: YOUR CODE*/
     ptep = ???              //(1) try to find a pte, if pte's PT(Page Table) isn't existed, then create a PT.
@@ -3,6 +3,7 @@
 
 #include <defs.h>
 #include <list.h>
+#include <rb_tree.h>
 #include <memlayout.h>
 #include <sync.h>
 #include <proc.h>
@@ -10,6 +11,7 @@
 
 //pre define
 struct mm_struct;
+struct inode;
 
 // the virtual continuous memory area(vma), [vm_start, vm_end), 
 // addr belong to a vma means  vma.vm_start<= addr <vma.vm_end 
@@ -19,22 +21,43 @@ struct vma_struct {
     uintptr_t vm_end;        // end addr of vma, not include the vm_end itself
     uint32_t vm_flags;       // flags of vma
     list_entry_t list_link;  // linear list link which sorted by start addr of vma
+    rb_node_t rb_link;       // node in mm->mmap_tree
+    struct inode *vm_file;   // the file [vm_file_start, vm_file_end) is read from on fault, NULL if none
+    off_t vm_file_off;       // the offset in vm_file of vm_file_start
+    uintptr_t vm_file_start; // the rest of the vma is zero filled, like the bss
+    uintptr_t vm_file_end;
 };
 
 #define le2vma(le, member)                  \
     to_struct((le), struct vma_struct, member)
 
+#define rbn2vma(node, member)               \
+    rbn2struct((node), struct vma_struct, member)
+
 #define VM_READ                 0x00000001
 #define VM_WRITE                0x00000002
 #define VM_EXEC                 0x00000004
 #define VM_STACK                0x00000008
+#define VM_SHARE                0x00000010  // shared file mapping, writes go back to vm_file
+#define VM_HUGE                 0x00000020  // anonymous memory in 4MB pages where it can get them, 4MB aligned
+
+#define FAULT_AROUND_PAGES      16          // default fault-around window of a mm, in pages
+#define FAULT_AROUND_MAX        (PTSIZE / PGSIZE)
+#define FAULT_AROUND_MIN_FREE   256         // free pages kept above the window, see fault_around
 
 // the control struct for a set of vma using the same PDT
 struct mm_struct {
     list_entry_t mmap_list;        // linear list link which sorted by start addr of vma
+    rb_tree_t mmap_tree;           // red-black tree of the same vma keyed by start addr, for find_vma
     struct vma_struct *mmap_cache; // current accessed vma, used for speed purpose
     pde_t *pgdir;                  // the PDT of these vma
     int map_count;                 // the count of these vma
+    uintptr_t brk_start, brk;      // the heap grown by sys_brk is [brk_start, brk)
+    int fault_around;              // pages mapped on a not-present fault, 1 for only the faulting page
+    uint32_t nr_fault;             // page faults of the mm
+    uint32_t nr_around;            // pages mapped by fault-around, each saves a fault once touched
+    uint32_t nr_zero;              // ptes which got the zero page on a read
+    uint32_t nr_zero_cow;          // of them, ptes which got a page of their own on a later write
     void *sm_priv;                 // the private data for swap manager
     int mm_count;                  // the number ofprocess which shared the mm
     semaphore_t mm_sem;            // mutex for using dup_mmap fun to duplicat the mm 
@@ -43,6 +66,7 @@ struct mm_struct {
 };
 
 struct vma_struct *find_vma(struct mm_struct *mm, uintptr_t addr);
+struct vma_struct *find_vma_intersection(struct mm_struct *mm, uintptr_t start, uintptr_t end);
 struct vma_struct *vma_create(uintptr_t vm_start, uintptr_t vm_end, uint32_t vm_flags);
 void insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma);
 
@@ -52,15 +76,43 @@ void mm_destroy(struct mm_struct *mm);
 void vmm_init(void);
 int mm_map(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags,
            struct vma_struct **vma_store);
+int mm_map_file(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags,
+                struct inode *node, off_t offset, size_t filesz, struct vma_struct **vma_store);
 int do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr);
 
 int mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len);
+int mm_msync(struct mm_struct *mm, uintptr_t addr, size_t len);
 int dup_mmap(struct mm_struct *to, struct mm_struct *from);
 void exit_mmap(struct mm_struct *mm);
-uintptr_t get_unmapped_area(struct mm_struct *mm, size_t len);
+uintptr_t get_unmapped_area(struct mm_struct *mm, size_t len, size_t align);
 int mm_brk(struct mm_struct *mm, uintptr_t addr, size_t len);
+int mm_set_fault_around(struct mm_struct *mm, int pages);
+struct mm_struct *page_mm(struct Page *page, pte_t **ptep_store);
+
+// counters of the zero page, summed over all mms, printed by print_zero_page
+struct zero_page_stat {
+    size_t nr_zero;                     // ptes which got the zero page on a read
+    size_t nr_zero_cow;                 // of them, ptes which got a page of their own on a later write
+    size_t max_shared;                  // the most ptes which mapped the zero page at a time
+};
+
+// counters of 4MB user pages, summed over all mms, printed by print_huge_page
+struct huge_page_stat {
+    size_t nr_fault;                    // faults which mapped a 4MB page
+    size_t nr_fallback;                 // faults in VM_HUGE vma which had to use 4KB pages
+    size_t nr_cow;                      // writes to a shared 4MB page which copied it to a new one
+    size_t nr_split;                    // writes to a shared 4MB page which copied it to 4KB pages
+};
+
+extern struct huge_page_stat huge_page_stat;
+void print_huge_page(void);
+
+extern struct Page *zero_page;
+extern struct zero_page_stat zero_page_stat;
+void print_zero_page(void);
 
 extern volatile unsigned int pgfault_num;
+extern volatile unsigned int pgfault_around_num;
 extern struct mm_struct *check_mm_struct;
 
 bool user_mem_check(struct mm_struct *mm, uintptr_t start, size_t len, bool write);
@@ -1,5 +1,6 @@
 #include <proc.h>
 #include <kmalloc.h>
+#include <slub.h>
 #include <string.h>
 #include <sync.h>
 #include <pmm.h>
@@ -15,6 +16,12 @@
 #include <fs.h>
 #include <vfs.h>
 #include <sysfile.h>
+#include <file.h>
+#include <stat.h>
+#include <compaction.h>
+#include <kswapd.h>
+#include <swap_slot.h>
+#include <swap_cache.h>
 
 /* ------------- process/thread mechanism design&implementation -------------
 (an simplified Linux process/thread mechanism )
@@ -81,6 +88,9 @@ struct proc_struct *current = NULL;
 
 static int nr_process = 0;
 
+// cache of proc_struct
+static struct kmem_cache_t *proc_cachep;
+
 void kernel_thread_entry(void);
 void forkrets(struct trapframe *tf);
 void switch_to(struct context *from, struct context *to);
@@ -88,8 +98,32 @@ void switch_to(struct context *from, struct context *to);
 // alloc_proc - alloc a proc_struct and init all fields of proc_struct
 static struct proc_struct *
 alloc_proc(void) {
-    struct proc_struct *proc = kmalloc(sizeof(struct proc_struct));
+    struct proc_struct *proc = kmem_cache_alloc(proc_cachep);
     if (proc != NULL) {
+        proc->state = PROC_UNINIT;
+        proc->pid = -1;
+        proc->runs = 0;
+        proc->kstack = 0;
+        proc->need_resched = 0;
+        proc->parent = NULL;
+        proc->mm = NULL;
+        memset(&(proc->context), 0, sizeof(struct context));
+        proc->tf = NULL;
+        proc->cr3 = boot_cr3;
+        proc->flags = 0;
+        memset(proc->name, 0, PROC_NAME_LEN);
+        proc->wait_state = 0;
+        proc->cptr = proc->optr = proc->yptr = NULL;
+
+        proc->rq = NULL;
+        list_init(&(proc->run_link));
+        proc->time_slice = 0;
+        skew_heap_init(&(proc->lab6_run_pool));
+        proc->lab6_stride = 0;
+        proc->lab6_priority = 0;
+
+        proc->filesp = NULL;
+
     //LAB4:EXERCISE1 YOUR CODE
     /*
      * below fields in proc_struct need to be initialized
@@ -216,7 +250,14 @@ proc_run(struct proc_struct *proc) {
         {
             current = proc;
             load_esp0(next->kstack + KSTACKSIZE);
-            lcr3(next->cr3);
+            // threads of one mm, and all kernel threads, run on the same pgdir. Compare
+            // with cr3 itself: do_exit moves to boot_cr3 and leaves prev->cr3 stale
+            if (next->cr3 != rcr3()) {
+                lcr3(next->cr3);
+            }
+            else {
+                tlb_stat.nr_cr3_skip ++;
+            }
             switch_to(&(prev->context), &(next->context));
         }
         local_intr_restore(intr_flag);
@@ -427,6 +468,36 @@ do_fork(uint32_t clone_flags, uintptr_t stack, struct trapframe *tf) {
         goto fork_out;
     }
     ret = -E_NO_MEM;
+    if ((proc = alloc_proc()) == NULL) {
+        goto fork_out;
+    }
+
+    proc->parent = current;
+    assert(current->wait_state == 0);
+
+    if (setup_kstack(proc) != 0) {
+        goto bad_fork_cleanup_proc;
+    }
+    if (copy_files(clone_flags, proc) != 0) {
+        goto bad_fork_cleanup_kstack;
+    }
+    if (copy_mm(clone_flags, proc) != 0) {
+        goto bad_fork_cleanup_fs;
+    }
+    copy_thread(proc, stack, tf);
+
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        proc->pid = get_pid();
+        hash_proc(proc);
+        set_links(proc);
+    }
+    local_intr_restore(intr_flag);
+
+    wakeup_proc(proc);
+
+    ret = proc->pid;
     //LAB4:EXERCISE2 YOUR CODE
     //LAB8:EXERCISE2 YOUR CODE  HINT:how to copy the fs in parent's proc_struct?
     /*
@@ -470,7 +541,7 @@ bad_fork_cleanup_fs:  //for LAB8
 bad_fork_cleanup_kstack:
     put_kstack(proc);
 bad_fork_cleanup_proc:
-    kfree(proc);
+    kmem_cache_free(proc_cachep, proc);
     goto fork_out;
 }
 
@@ -546,33 +617,127 @@ load_icode_read(int fd, void *buf, size_t len, off_t offset) {
 }
 
 // load_icode -  called by sys_exec-->do_execve
-  
+//             - the segments of the program are not read here: each one becomes a vma
+//             - backed by the file, and do_pgfault reads a page of it (or zero fills
+//             - a page of the bss) when it is touched for the first time
 static int
 load_icode(int fd, int argc, char **kargv) {
-    /* LAB8:EXERCISE2 YOUR CODE  HINT:how to load the file with handler fd  in to process's memory? how to setup argc/argv?
-     * MACROs or Functions:
-     *  mm_create        - create a mm
-     *  setup_pgdir      - setup pgdir in mm
-     *  load_icode_read  - read raw data content of program file
-     *  mm_map           - build new vma
-     *  pgdir_alloc_page - allocate new memory for  TEXT/DATA/BSS/stack parts
-     *  lcr3             - update Page Directory Addr Register -- CR3
-     */
-	/* (1) create a new mm for current process
-     * (2) create a new PDT, and mm->pgdir= kernel virtual addr of PDT
-     * (3) copy TEXT/DATA/BSS parts in binary to memory space of process
-     *    (3.1) read raw data content in file and resolve elfhdr
-     *    (3.2) read raw data content in file and resolve proghdr based on info in elfhdr
-     *    (3.3) call mm_map to build vma related to TEXT/DATA
-     *    (3.4) callpgdir_alloc_page to allocate page for TEXT/DATA, read contents in file
-     *          and copy them into the new allocated pages
-     *    (3.5) callpgdir_alloc_page to allocate pages for BSS, memset zero in these pages
-     * (4) call mm_map to setup user stack, and put parameters into user stack
-     * (5) setup current process's mm, cr3, reset pgidr (using lcr3 MARCO)
-     * (6) setup uargc and uargv in user stacks
-     * (7) setup trapframe for user environment
-     * (8) if up steps failed, you should cleanup the env.
-     */
+    assert(argc >= 0 && argc <= EXEC_MAX_ARG_NUM);
+    if (current->mm != NULL) {
+        panic("load_icode: current->mm must be empty.\n");
+    }
+
+    int ret = -E_NO_MEM;
+    struct mm_struct *mm;
+    //(1) create a new mm for current process
+    if ((mm = mm_create()) == NULL) {
+        goto bad_mm;
+    }
+    //(2) create a new PDT, and mm->pgdir= kernel virtual addr of PDT
+    if (setup_pgdir(mm) != 0) {
+        goto bad_pgdir_cleanup_mm;
+    }
+    //(3) map TEXT/DATA/BSS parts of the binary to the file
+    struct inode *node;
+    if ((ret = file_inode(fd, &node)) != 0) {
+        goto bad_elf_cleanup_pgdir;
+    }
+    //(3.1) read raw data content in file and resolve elfhdr
+    struct elfhdr __elf, *elf = &__elf;
+    if ((ret = load_icode_read(fd, elf, sizeof(struct elfhdr), 0)) != 0) {
+        goto bad_elf_cleanup_pgdir;
+    }
+    if (elf->e_magic != ELF_MAGIC) {
+        ret = -E_INVAL_ELF;
+        goto bad_elf_cleanup_pgdir;
+    }
+
+    struct proghdr __ph, *ph = &__ph;
+    uint32_t vm_flags, phnum;
+    uintptr_t brk = 0;
+    for (phnum = 0; phnum < elf->e_phnum; phnum ++) {
+        //(3.2) read raw data content in file and resolve proghdr based on info in elfhdr
+        off_t phoff = elf->e_phoff + sizeof(struct proghdr) * phnum;
+        if ((ret = load_icode_read(fd, ph, sizeof(struct proghdr), phoff)) != 0) {
+            goto bad_cleanup_mmap;
+        }
+        if (ph->p_type != ELF_PT_LOAD) {
+            continue ;
+        }
+        if (ph->p_filesz > ph->p_memsz) {
+            ret = -E_INVAL_ELF;
+            goto bad_cleanup_mmap;
+        }
+        if (ph->p_memsz == 0) {
+            continue ;
+        }
+        //(3.3) call mm_map_file to build the vma of TEXT/DATA/BSS, backed by the file
+        vm_flags = 0;
+        if (ph->p_flags & ELF_PF_X) vm_flags |= VM_EXEC;
+        if (ph->p_flags & ELF_PF_W) vm_flags |= VM_WRITE;
+        if (ph->p_flags & ELF_PF_R) vm_flags |= VM_READ;
+        if ((ret = mm_map_file(mm, ph->p_va, ph->p_memsz, vm_flags, node, ph->p_offset, ph->p_filesz, NULL)) != 0) {
+            goto bad_cleanup_mmap;
+        }
+        if (brk < ph->p_va + ph->p_memsz) {
+            brk = ph->p_va + ph->p_memsz;
+        }
+    }
+    // the heap starts empty right above the program
+    mm->brk_start = mm->brk = ROUNDUP(brk, PGSIZE);
+
+    //(4) call mm_map to setup user stack, its pages are also allocated on fault
+    vm_flags = VM_READ | VM_WRITE | VM_STACK;
+    if ((ret = mm_map(mm, USTACKTOP - USTACKSIZE, USTACKSIZE, vm_flags, NULL)) != 0) {
+        goto bad_cleanup_mmap;
+    }
+    // the vma hold their own references to the inode
+    sysfile_close(fd);
+
+    //(5) set current process's mm, sr3, and set CR3 reg = physical addr of Page Directory
+    mm_count_inc(mm);
+    current->mm = mm;
+    current->cr3 = PADDR(mm->pgdir);
+    lcr3(PADDR(mm->pgdir));
+
+    //(6) setup uargc and uargv in user stacks, writing them faults the pages in
+    uint32_t argv_size = 0, i;
+    for (i = 0; i < argc; i ++) {
+        argv_size += strnlen(kargv[i], EXEC_MAX_ARG_LEN + 1) + 1;
+    }
+
+    uintptr_t stacktop = USTACKTOP - (argv_size / sizeof(long) + 1) * sizeof(long);
+    char **uargv = (char **)(stacktop - argc * sizeof(char *));
+
+    argv_size = 0;
+    for (i = 0; i < argc; i ++) {
+        uargv[i] = strcpy((char *)(stacktop + argv_size), kargv[i]);
+        argv_size += strnlen(kargv[i], EXEC_MAX_ARG_LEN + 1) + 1;
+    }
+
+    stacktop = (uintptr_t)uargv - sizeof(int);
+    *(int *)stacktop = argc;
+
+    //(7) setup trapframe for user environment
+    struct trapframe *tf = current->tf;
+    memset(tf, 0, sizeof(struct trapframe));
+    tf->tf_cs = USER_CS;
+    tf->tf_ds = tf->tf_es = tf->tf_ss = USER_DS;
+    tf->tf_esp = stacktop;
+    tf->tf_eip = elf->e_entry;
+    tf->tf_eflags = FL_IF;
+    ret = 0;
+out:
+    return ret;
+bad_cleanup_mmap:
+    exit_mmap(mm);
+bad_elf_cleanup_pgdir:
+    put_pgdir(mm);
+bad_pgdir_cleanup_mm:
+    mm_destroy(mm);
+bad_mm:
+    sysfile_close(fd);
+    goto out;
 }
 
 // this function isn't very correct in LAB8
@@ -673,6 +838,176 @@ execve_exit:
     panic("already exit: %e.\n", ret);
 }
 
+// do_brk - move the end of the heap of current to *brk_store, and store the end
+//        - it ends up at in *brk_store; a brk below the start of the heap just reads it
+int
+do_brk(uintptr_t *brk_store) {
+    struct mm_struct *mm = current->mm;
+    if (mm == NULL) {
+        panic("kernel thread call sys_brk!!.\n");
+    }
+    if (brk_store == NULL) {
+        return -E_INVAL;
+    }
+
+    uintptr_t brk;
+
+    lock_mm(mm);
+    if (!copy_from_user(mm, &brk, brk_store, sizeof(uintptr_t), 1)) {
+        unlock_mm(mm);
+        return -E_INVAL;
+    }
+
+    if (brk < mm->brk_start) {
+        goto out_unlock;
+    }
+    uintptr_t newbrk = ROUNDUP(brk, PGSIZE), oldbrk = mm->brk;
+    assert(oldbrk % PGSIZE == 0);
+    if (newbrk == oldbrk) {
+        goto out_unlock;
+    }
+    if (newbrk < oldbrk) {
+        if (mm_unmap(mm, newbrk, oldbrk - newbrk) != 0) {
+            goto out_unlock;
+        }
+    }
+    else {
+        // keep a guard page between the heap and whatever is mapped above it
+        if (find_vma_intersection(mm, oldbrk, newbrk + PGSIZE) != NULL) {
+            goto out_unlock;
+        }
+        if (mm_brk(mm, oldbrk, newbrk - oldbrk) != 0) {
+            goto out_unlock;
+        }
+    }
+    mm->brk = newbrk;
+out_unlock:
+    copy_to_user(mm, brk_store, &(mm->brk), sizeof(uintptr_t));
+    unlock_mm(mm);
+    return 0;
+}
+
+// do_mmap - map len bytes at *addr_store, or anywhere if it is 0, and store where they
+//         - are mapped in *addr_store. The memory is anonymous if fd < 0, otherwise it is
+//         - the file fd from offset: a MMAP_PRIVATE mapping reads it, a MMAP_SHARED
+//         - mapping also writes back to it (see filemap.c). MMAP_HUGE anonymous memory is
+//         - 4MB aligned and rounded up to 4MB, and uses 4MB pages when it can (see vmm.c)
+int
+do_mmap(uintptr_t *addr_store, size_t len, uint32_t mmap_flags, int fd, off_t offset) {
+    struct mm_struct *mm = current->mm;
+    if (mm == NULL) {
+        panic("kernel thread call mmap!!.\n");
+    }
+    if (addr_store == NULL || len == 0) {
+        return -E_INVAL;
+    }
+
+    int ret = -E_INVAL;
+
+    bool shared = ((mmap_flags & MMAP_SHARED) != 0), huge = ((mmap_flags & MMAP_HUGE) != 0);
+    struct inode *node = NULL;
+    struct stat __stat, *stat = &__stat;
+    if (huge && fd >= 0) {
+        return -E_INVAL;
+    }
+    if (fd < 0) {
+        if (shared) {
+            return -E_INVAL;
+        }
+    }
+    else {
+        if (shared == ((mmap_flags & MMAP_PRIVATE) != 0) || offset < 0 || offset % PGSIZE != 0) {
+            return -E_INVAL;
+        }
+        if (shared && (mmap_flags & MMAP_WRITE) && !file_testfd(fd, 1, 1)) {
+            return -E_INVAL;
+        }
+        if ((ret = file_inode(fd, &node)) != 0 || (ret = file_fstat(fd, stat)) != 0) {
+            return ret;
+        }
+        ret = -E_INVAL;
+    }
+
+    uintptr_t addr;
+
+    lock_mm(mm);
+    if (!copy_from_user(mm, &addr, addr_store, sizeof(uintptr_t), 1)) {
+        goto out_unlock;
+    }
+
+    size_t align = (huge) ? PTSIZE : PGSIZE;
+    if (huge && addr % PTSIZE != 0) {
+        goto out_unlock;
+    }
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, align);
+    addr = start, len = end - start;
+
+    uint32_t vm_flags = VM_READ;
+    if (mmap_flags & MMAP_WRITE) vm_flags |= VM_WRITE;
+    if (mmap_flags & MMAP_STACK) vm_flags |= VM_STACK;
+    if (shared) vm_flags |= VM_SHARE;
+    if (huge) vm_flags |= VM_HUGE;
+
+    ret = -E_NO_MEM;
+    if (addr == 0) {
+        if ((addr = get_unmapped_area(mm, len, align)) == 0) {
+            goto out_unlock;
+        }
+    }
+    if (node != NULL) {
+        // a private mapping reads the file up to its end, a shared one maps whole pages
+        size_t filesz = (stat->st_size > offset) ? stat->st_size - offset : 0;
+        if (shared || filesz > len) {
+            filesz = len;
+        }
+        ret = mm_map_file(mm, addr, len, vm_flags, node, offset, filesz, NULL);
+    }
+    else {
+        ret = mm_map(mm, addr, len, vm_flags, NULL);
+    }
+    if (ret == 0) {
+        copy_to_user(mm, addr_store, &addr, sizeof(uintptr_t));
+    }
+out_unlock:
+    unlock_mm(mm);
+    return ret;
+}
+
+// do_munmap - unmap [addr, addr + len) of current
+int
+do_munmap(uintptr_t addr, size_t len) {
+    struct mm_struct *mm = current->mm;
+    if (mm == NULL) {
+        panic("kernel thread call munmap!!.\n");
+    }
+    if (len == 0) {
+        return -E_INVAL;
+    }
+    int ret;
+    lock_mm(mm);
+    {
+        ret = mm_unmap(mm, addr, len);
+    }
+    unlock_mm(mm);
+    return ret;
+}
+
+// do_msync - write the dirty pages of the shared file mappings in [addr, addr + len) back
+int
+do_msync(uintptr_t addr, size_t len) {
+    struct mm_struct *mm = current->mm;
+    if (mm == NULL) {
+        panic("kernel thread call msync!!.\n");
+    }
+    int ret;
+    lock_mm(mm);
+    {
+        ret = mm_msync(mm, addr, len);
+    }
+    unlock_mm(mm);
+    return ret;
+}
+
 // do_yield - ask the scheduler to reschedule
 int
 do_yield(void) {
@@ -739,7 +1074,7 @@ found:
     }
     local_intr_restore(intr_flag);
     put_kstack(proc);
-    kfree(proc);
+    kmem_cache_free(proc_cachep, proc);
     return 0;
 }
 
@@ -816,6 +1151,9 @@ init_main(void *arg) {
     size_t nr_free_pages_store = nr_free_pages();
     size_t kernel_allocated_store = kallocated();
 
+    kcompactd_init();
+    kswapd_init();
+
     int pid = kernel_thread(user_main, NULL, 0);
     if (pid <= 0) {
         panic("create user_main failed.\n");
@@ -823,6 +1161,11 @@ init_main(void *arg) {
  extern void check_sync(void);
     check_sync();                // check philosopher sync problem
 
+    // kcompactd and kswapd never quit by themselves, stop them when user_main is gone
+    do_wait(pid, NULL);
+    kcompactd_stop();
+    kswapd_stop();
+
     while (do_wait(0, NULL) == 0) {
         schedule();
     }
@@ -830,10 +1173,22 @@ init_main(void *arg) {
     fs_cleanup();
         
     cprintf("all user-mode processes have quit.\n");
+    cprintf("page faults: %u, %u pages mapped by fault-around.\n", pgfault_num, pgfault_around_num);
+    print_zero_page();
+    print_huge_page();
+    print_swap_slot();
+    print_swap_cache();
+    print_tlb_stat();
+    print_compaction();
+    print_kswapd();
     assert(initproc->cptr == NULL && initproc->yptr == NULL && initproc->optr == NULL);
     assert(nr_process == 2);
     assert(list_next(&proc_list) == &(initproc->list_link));
     assert(list_prev(&proc_list) == &(initproc->list_link));
+    if (kallocated() != kernel_allocated_store) {
+        cprintf("kmalloc: %u bytes in use before user_main, %u bytes now.\n", kernel_allocated_store, kallocated());
+        kmalloc_dump();
+    }
 
     cprintf("init check memory pass.\n");
     return 0;
@@ -845,6 +1200,10 @@ void
 proc_init(void) {
     int i;
 
+    if ((proc_cachep = kmem_cache_create("proc_struct", sizeof(struct proc_struct), NULL, NULL)) == NULL) {
+        panic("cannot create proc_struct cache.\n");
+    }
+
     list_init(&proc_list);
     for (i = 0; i < HASH_LIST_SIZE; i ++) {
         list_init(hash_list + i);
@@ -74,6 +74,8 @@ struct proc_struct {
 #define WT_INTERRUPTED               0x80000000                    // the wait state could be interrupted
 #define WT_CHILD                    (0x00000001 | WT_INTERRUPTED)  // wait child process
 #define WT_KSEM                      0x00000100                    // wait kernel semaphore
+#define WT_KCOMPACTD                 0x00000200                    // kcompactd waits for a request
+#define WT_KSWAPD                    0x00000400                    // kswapd waits for the free pages to run low
 #define WT_TIMER                    (0x00000002 | WT_INTERRUPTED)  // wait timer
 #define WT_KBD                      (0x00000004 | WT_INTERRUPTED)  // wait the input of keyboard
 
@@ -97,6 +99,10 @@ int do_yield(void);
 int do_execve(const char *name, int argc, const char **argv);
 int do_wait(int pid, int *code_store);
 int do_kill(int pid);
+int do_brk(uintptr_t *brk_store);
+int do_mmap(uintptr_t *addr_store, size_t len, uint32_t mmap_flags, int fd, off_t offset);
+int do_msync(uintptr_t addr, size_t len);
+int do_munmap(uintptr_t addr, size_t len);
 //FOR LAB6, set the process's priority (bigger value will get more CPU time)
 void lab6_set_priority(uint32_t priority);
 int do_sleep(unsigned int time);
@@ -10,6 +10,13 @@
 #include <stat.h>
 #include <dirent.h>
 #include <sysfile.h>
+#include <kmalloc.h>
+#include <kmstat.h>
+#include <faultstat.h>
+#include <reclaimstat.h>
+#include <kswapd.h>
+#include <vmm.h>
+#include <error.h>
 
 static int
 sys_exit(uint32_t arg[]) {
@@ -62,12 +69,118 @@ sys_putc(uint32_t arg[]) {
     return 0;
 }
 
+static int
+sys_brk(uint32_t arg[]) {
+    uintptr_t *brk_store = (uintptr_t *)arg[0];
+    return do_brk(brk_store);
+}
+
+static int
+sys_mmap(uint32_t arg[]) {
+    uintptr_t *addr_store = (uintptr_t *)arg[0];
+    size_t len = (size_t)arg[1];
+    uint32_t mmap_flags = (uint32_t)arg[2];
+    int fd = (int)arg[3];
+    off_t offset = (off_t)arg[4];
+    return do_mmap(addr_store, len, mmap_flags, fd, offset);
+}
+
+static int
+sys_msync(uint32_t arg[]) {
+    uintptr_t addr = (uintptr_t)arg[0];
+    size_t len = (size_t)arg[1];
+    return do_msync(addr, len);
+}
+
+static int
+sys_munmap(uint32_t arg[]) {
+    uintptr_t addr = (uintptr_t)arg[0];
+    size_t len = (size_t)arg[1];
+    return do_munmap(addr, len);
+}
+
 static int
 sys_pgdir(uint32_t arg[]) {
     print_pgdir();
     return 0;
 }
 
+static int
+sys_kmstat(uint32_t arg[]) {
+    struct kmstat *__st = (struct kmstat *)arg[0];
+    struct mm_struct *mm = current->mm;
+    struct kmstat st;
+    int ret = 0;
+    kmalloc_stat(&st);
+    lock_mm(mm);
+    {
+        if (!copy_to_user(mm, __st, &st, sizeof(struct kmstat))) {
+            ret = -E_INVAL;
+        }
+    }
+    unlock_mm(mm);
+    return ret;
+}
+
+// sys_faultaround - set the fault-around window of the process to pages if it is
+//                 - not 0, and read its fault counters into st if it is not NULL
+static int
+sys_faultaround(uint32_t arg[]) {
+    int pages = (int)arg[0];
+    struct faultstat *__st = (struct faultstat *)arg[1];
+    struct mm_struct *mm = current->mm;
+    struct faultstat st;
+    int ret = 0;
+    if (mm == NULL) {
+        return -E_INVAL;
+    }
+    lock_mm(mm);
+    {
+        if (pages != 0 && (ret = mm_set_fault_around(mm, pages)) != 0) {
+            goto out;
+        }
+        st.fault_around = mm->fault_around;
+        st.nr_fault = mm->nr_fault;
+        st.nr_around = mm->nr_around;
+        st.nr_zero = mm->nr_zero;
+        st.nr_zero_cow = mm->nr_zero_cow;
+        if (__st != NULL && !copy_to_user(mm, __st, &st, sizeof(struct faultstat))) {
+            ret = -E_INVAL;
+        }
+    }
+out:
+    unlock_mm(mm);
+    return ret;
+}
+
+// sys_reclaimstat - read the page reclaim counters into st
+static int
+sys_reclaimstat(uint32_t arg[]) {
+    struct reclaimstat *__st = (struct reclaimstat *)arg[0];
+    struct mm_struct *mm = current->mm;
+    struct reclaimstat st;
+    int ret = 0;
+#ifdef NO_KSWAPD
+    st.kswapd = 0;
+#else
+    st.kswapd = 1;
+#endif
+    st.nr_free = nr_free_pages();
+    st.nr_wakeup = reclaim_stat.nr_wakeup;
+    st.nr_kswapd = reclaim_stat.nr_kswapd;
+    st.nr_direct = reclaim_stat.nr_direct;
+    st.nr_stall = reclaim_stat.nr_stall;
+    st.stall_cycles = reclaim_stat.stall_cycles;
+    lock_mm(mm);
+    {
+        if (!copy_to_user(mm, __st, &st, sizeof(struct reclaimstat))) {
+            ret = -E_INVAL;
+        }
+    }
+    unlock_mm(mm);
+    return ret;
+}
+
 static int
 sys_gettime(uint32_t arg[]) {
     return (int)ticks;
@@ -165,8 +278,15 @@ static int (*syscalls[])(uint32_t arg[]) = {
     [SYS_yield]             sys_yield,
     [SYS_kill]              sys_kill,
     [SYS_getpid]            sys_getpid,
+    [SYS_brk]               sys_brk,
+    [SYS_mmap]              sys_mmap,
+    [SYS_munmap]            sys_munmap,
+    [SYS_msync]             sys_msync,
+    [SYS_faultaround]       sys_faultaround,
+    [SYS_reclaimstat]       sys_reclaimstat,
     [SYS_putc]              sys_putc,
     [SYS_pgdir]             sys_pgdir,
+    [SYS_kmstat]            sys_kmstat,
     [SYS_gettime]           sys_gettime,
     [SYS_lab6_set_priority] sys_lab6_set_priority,
     [SYS_sleep]             sys_sleep,
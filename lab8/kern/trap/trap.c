@@ -161,7 +161,7 @@ print_pgfault(struct trapframe *tf) {
 static int
 pgfault_handler(struct trapframe *tf) {
     extern struct mm_struct *check_mm_struct;
-    if(check_mm_struct !=NULL) { //used for test check_swap
+    if(check_mm_struct !=NULL && !swap_quiet) { //used for test check_swap
             print_pgfault(tf);
         }
     struct mm_struct *mm;
@@ -210,10 +210,6 @@ trap_dispatch(struct trapframe *tf) {
         syscall();
         break;
     case IRQ_OFFSET + IRQ_TIMER:
-#if 0
-    LAB3 : If some page replacement algorithm(such as CLOCK PRA) need tick to change the priority of pages,
-    then you can add code here. 
-#endif
         /* LAB1 YOUR CODE : STEP 3 */
         /* handle the timer interrupt */
         /* (1) After a timer interrupt, you should record this event using a global variable (increase it), such as ticks in kern/driver/clock.c
@@ -234,6 +230,16 @@ trap_dispatch(struct trapframe *tf) {
          * IMPORTANT FUNCTIONS:
 	     * run_timer_list
          */
+        ticks ++;
+        assert(current != NULL);
+        run_timer_list();
+        // the swap manager samples the accessed bits only when the tick comes from
+        // user mode: no kernel path is halfway through a page table or its list then
+        if (swap_init_ok && !trap_in_kernel(tf) && !in_swap_tick_event) {
+            in_swap_tick_event = 1;
+            swap_tick_event(current->mm);
+            in_swap_tick_event = 0;
+        }
         break;
     case IRQ_OFFSET + IRQ_COM1:
     case IRQ_OFFSET + IRQ_KBD:
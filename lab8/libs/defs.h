@@ -34,6 +34,7 @@ typedef uint32_t uintptr_t;
 
 /* size_t is used for memory object sizes */
 typedef uintptr_t size_t;
+#define SIZE_MAX        ((size_t)-1)
 
 /* off_t is used for file offsets and lengths */
 typedef intptr_t off_t;
@@ -0,0 +1,16 @@
+#ifndef __LIBS_FAULTSTAT_H__
+#define __LIBS_FAULTSTAT_H__
+
+#include <defs.h>
+
+// page fault counters of the calling process, read by sys_faultaround
+struct faultstat {
+    uint32_t fault_around;              // the fault-around window in pages, 1 if it is off
+    uint32_t nr_fault;                  // page faults taken
+    uint32_t nr_around;                 // pages mapped by fault-around, each saves a fault once touched
+    uint32_t nr_zero;                   // pages which got the shared zero page on a read
+    uint32_t nr_zero_cow;               // of them, pages which got a frame of their own on a later write
+};
+
+#endif /* !__LIBS_FAULTSTAT_H__ */
+
@@ -0,0 +1,25 @@
+#ifndef __LIBS_KMSTAT_H__
+#define __LIBS_KMSTAT_H__
+
+#include <defs.h>
+
+// kmalloc size classes: 16, 32, ..., 2048 bytes, and big blocks of whole pages
+#define KMSTAT_NCLASS           9
+
+struct kmclass_stat {
+    uint32_t size;                      // block size of the class, 0 for big blocks
+    uint32_t objects;                   // blocks in use
+    uint32_t bytes;                     // bytes in use
+    uint32_t peak_bytes;                // high-water mark of bytes
+    uint32_t nr_alloc;                  // number of kmalloc calls served
+};
+
+struct kmstat {
+    uint32_t bytes;                     // bytes in use, same as kallocated()
+    uint32_t peak_bytes;                // high-water mark of bytes
+    uint32_t nr_alloc;                  // number of kmalloc calls
+    uint32_t nr_free;                   // number of kfree calls
+    struct kmclass_stat classes[KMSTAT_NCLASS];
+};
+
+#endif /* !__LIBS_KMSTAT_H__ */
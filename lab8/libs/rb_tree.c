@@ -0,0 +1,293 @@
+#include <defs.h>
+#include <rb_tree.h>
+
+/* *
+ * The algorithms are the ones of "Introduction to Algorithms" chapter 13,
+ * with NULL leaves instead of a sentinel node: a NULL node is black, and the
+ * parent of the node which replaces a deleted one is tracked separately
+ * because that node may be NULL.
+ * */
+
+static inline bool
+rb_is_red(rb_node_t *node) {
+    return node != NULL && node->red;
+}
+
+// rb_replace - put new in the place of old under the parent of old
+static inline void
+rb_replace(rb_tree_t *tree, rb_node_t *old, rb_node_t *new) {
+    rb_node_t *parent = old->parent;
+    if (parent == NULL) {
+        tree->root = new;
+    }
+    else if (parent->left == old) {
+        parent->left = new;
+    }
+    else {
+        parent->right = new;
+    }
+    if (new != NULL) {
+        new->parent = parent;
+    }
+}
+
+static void
+rb_rotate_left(rb_tree_t *tree, rb_node_t *x) {
+    rb_node_t *y = x->right;
+    if ((x->right = y->left) != NULL) {
+        y->left->parent = x;
+    }
+    rb_replace(tree, x, y);
+    y->left = x;
+    x->parent = y;
+}
+
+static void
+rb_rotate_right(rb_tree_t *tree, rb_node_t *x) {
+    rb_node_t *y = x->left;
+    if ((x->left = y->right) != NULL) {
+        y->right->parent = x;
+    }
+    rb_replace(tree, x, y);
+    y->right = x;
+    x->parent = y;
+}
+
+static void
+rb_insert_fixup(rb_tree_t *tree, rb_node_t *node) {
+    rb_node_t *parent, *gparent, *uncle;
+    while (rb_is_red(parent = node->parent)) {
+        // a red node is never the root, so gparent exists
+        gparent = parent->parent;
+        if (parent == gparent->left) {
+            uncle = gparent->right;
+            if (rb_is_red(uncle)) {
+                parent->red = uncle->red = 0;
+                gparent->red = 1;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->right) {
+                rb_rotate_left(tree, parent);
+                node = parent, parent = node->parent;
+            }
+            parent->red = 0;
+            gparent->red = 1;
+            rb_rotate_right(tree, gparent);
+        }
+        else {
+            uncle = gparent->left;
+            if (rb_is_red(uncle)) {
+                parent->red = uncle->red = 0;
+                gparent->red = 1;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->left) {
+                rb_rotate_right(tree, parent);
+                node = parent, parent = node->parent;
+            }
+            parent->red = 0;
+            gparent->red = 1;
+            rb_rotate_left(tree, gparent);
+        }
+    }
+    tree->root->red = 0;
+}
+
+// rb_insert - add node to the tree, after the nodes which compare equal to it
+void
+rb_insert(rb_tree_t *tree, rb_node_t *node, rb_compare_f compare) {
+    rb_node_t *parent = NULL, **link = &(tree->root);
+    while (*link != NULL) {
+        parent = *link;
+        link = (compare(node, parent) < 0) ? &(parent->left) : &(parent->right);
+    }
+    node->parent = parent;
+    node->left = node->right = NULL;
+    node->red = 1;
+    *link = node;
+    rb_insert_fixup(tree, node);
+}
+
+// rb_delete_fixup - node (maybe NULL) under parent has one black less than its sibling
+static void
+rb_delete_fixup(rb_tree_t *tree, rb_node_t *node, rb_node_t *parent) {
+    rb_node_t *sibling;
+    while (node != tree->root && !rb_is_red(node)) {
+        if (node == parent->left) {
+            sibling = parent->right;
+            if (rb_is_red(sibling)) {
+                sibling->red = 0;
+                parent->red = 1;
+                rb_rotate_left(tree, parent);
+                sibling = parent->right;
+            }
+            if (!rb_is_red(sibling->left) && !rb_is_red(sibling->right)) {
+                sibling->red = 1;
+                node = parent, parent = node->parent;
+                continue;
+            }
+            if (!rb_is_red(sibling->right)) {
+                sibling->left->red = 0;
+                sibling->red = 1;
+                rb_rotate_right(tree, sibling);
+                sibling = parent->right;
+            }
+            sibling->red = parent->red;
+            parent->red = 0;
+            sibling->right->red = 0;
+            rb_rotate_left(tree, parent);
+        }
+        else {
+            sibling = parent->left;
+            if (rb_is_red(sibling)) {
+                sibling->red = 0;
+                parent->red = 1;
+                rb_rotate_right(tree, parent);
+                sibling = parent->left;
+            }
+            if (!rb_is_red(sibling->left) && !rb_is_red(sibling->right)) {
+                sibling->red = 1;
+                node = parent, parent = node->parent;
+                continue;
+            }
+            if (!rb_is_red(sibling->left)) {
+                sibling->right->red = 0;
+                sibling->red = 1;
+                rb_rotate_left(tree, sibling);
+                sibling = parent->left;
+            }
+            sibling->red = parent->red;
+            parent->red = 0;
+            sibling->left->red = 0;
+            rb_rotate_right(tree, parent);
+        }
+        node = tree->root;
+        break;
+    }
+    if (node != NULL) {
+        node->red = 0;
+    }
+}
+
+// rb_delete - take node out of the tree
+void
+rb_delete(rb_tree_t *tree, rb_node_t *node) {
+    rb_node_t *child, *parent;
+    bool red = node->red;
+    if (node->left == NULL || node->right == NULL) {
+        child = (node->left != NULL) ? node->left : node->right;
+        parent = node->parent;
+        rb_replace(tree, node, child);
+    }
+    else {
+        // the successor of node has no left child, it takes the place of node
+        rb_node_t *next = node->right;
+        while (next->left != NULL) {
+            next = next->left;
+        }
+        red = next->red;
+        child = next->right;
+        if (next->parent == node) {
+            parent = next;
+        }
+        else {
+            parent = next->parent;
+            rb_replace(tree, next, child);
+            next->right = node->right;
+            next->right->parent = next;
+        }
+        rb_replace(tree, node, next);
+        next->left = node->left;
+        next->left->parent = next;
+        next->red = node->red;
+    }
+    if (!red) {
+        rb_delete_fixup(tree, child, parent);
+    }
+}
+
+rb_node_t *
+rb_first(rb_tree_t *tree) {
+    rb_node_t *node = tree->root;
+    if (node != NULL) {
+        while (node->left != NULL) {
+            node = node->left;
+        }
+    }
+    return node;
+}
+
+rb_node_t *
+rb_last(rb_tree_t *tree) {
+    rb_node_t *node = tree->root;
+    if (node != NULL) {
+        while (node->right != NULL) {
+            node = node->right;
+        }
+    }
+    return node;
+}
+
+rb_node_t *
+rb_next(rb_node_t *node) {
+    if (node->right != NULL) {
+        node = node->right;
+        while (node->left != NULL) {
+            node = node->left;
+        }
+        return node;
+    }
+    while (node->parent != NULL && node == node->parent->right) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+rb_node_t *
+rb_prev(rb_node_t *node) {
+    if (node->left != NULL) {
+        node = node->left;
+        while (node->right != NULL) {
+            node = node->right;
+        }
+        return node;
+    }
+    while (node->parent != NULL && node == node->parent->left) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+// rb_subtree_check - the black height of the subtree at node, -1 if it is broken
+static int
+rb_subtree_check(rb_node_t *node, rb_compare_f compare) {
+    if (node == NULL) {
+        return 1;
+    }
+    if (node->left != NULL && (node->left->parent != node || compare(node->left, node) > 0)) {
+        return -1;
+    }
+    if (node->right != NULL && (node->right->parent != node || compare(node, node->right) > 0)) {
+        return -1;
+    }
+    if (node->red && (rb_is_red(node->left) || rb_is_red(node->right))) {
+        return -1;
+    }
+    int lh = rb_subtree_check(node->left, compare), rh = rb_subtree_check(node->right, compare);
+    if (lh < 0 || lh != rh) {
+        return -1;
+    }
+    return lh + (node->red ? 0 : 1);
+}
+
+// rb_tree_check - the black height of the tree, -1 if a red-black property is broken
+int
+rb_tree_check(rb_tree_t *tree, rb_compare_f compare) {
+    if (rb_is_red(tree->root) || (tree->root != NULL && tree->root->parent != NULL)) {
+        return -1;
+    }
+    return rb_subtree_check(tree->root, compare);
+}
+
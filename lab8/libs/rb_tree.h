@@ -0,0 +1,52 @@
+#ifndef __LIBS_RB_TREE_H__
+#define __LIBS_RB_TREE_H__
+
+#include <defs.h>
+
+/* *
+ * Red-black tree whose nodes are embedded in the objects they index, like
+ * list_entry_t. The tree does not allocate anything; the caller searches it
+ * by walking from the root with its own key, see find_vma in kern/mm/vmm.c.
+ * Leaves are NULL pointers.
+ * */
+
+struct rb_node {
+    struct rb_node *parent, *left, *right;
+    bool red;
+};
+
+typedef struct rb_node rb_node_t;
+
+typedef struct {
+    rb_node_t *root;
+} rb_tree_t;
+
+// compare two nodes, <0 if a goes before b, nodes that compare equal keep insertion order
+typedef int (*rb_compare_f)(rb_node_t *a, rb_node_t *b);
+
+// convert rb_node to the struct which contains it
+#define rbn2struct(node, type, member)      \
+    to_struct((node), type, member)
+
+static inline void
+rb_tree_init(rb_tree_t *tree) {
+    tree->root = NULL;
+}
+
+static inline bool
+rb_tree_empty(rb_tree_t *tree) {
+    return tree->root == NULL;
+}
+
+void rb_insert(rb_tree_t *tree, rb_node_t *node, rb_compare_f compare);
+void rb_delete(rb_tree_t *tree, rb_node_t *node);
+
+rb_node_t *rb_first(rb_tree_t *tree);
+rb_node_t *rb_last(rb_tree_t *tree);
+rb_node_t *rb_next(rb_node_t *node);
+rb_node_t *rb_prev(rb_node_t *node);
+
+int rb_tree_check(rb_tree_t *tree, rb_compare_f compare);
+
+#endif /* !__LIBS_RB_TREE_H__ */
+
@@ -0,0 +1,17 @@
+#ifndef __LIBS_RECLAIMSTAT_H__
+#define __LIBS_RECLAIMSTAT_H__
+
+#include <defs.h>
+
+// page reclaim counters of the whole system, read by sys_reclaimstat
+struct reclaimstat {
+    uint32_t kswapd;                    // 1 if kswapd runs, 0 if the kernel was built with KSWAPD=0
+    uint32_t nr_free;                   // free pages now
+    uint32_t nr_wakeup;                 // times kswapd was woken up
+    uint32_t nr_kswapd;                 // pages freed by kswapd
+    uint32_t nr_direct;                 // pages freed by allocations which found no free page
+    uint32_t nr_stall;                  // such allocations
+    uint64_t stall_cycles;              // time they spent swapping out
+};
+
+#endif /* !__LIBS_RECLAIMSTAT_H__ */
@@ -14,11 +14,16 @@
 #define SYS_kill            12
 #define SYS_gettime         17
 #define SYS_getpid          18
+#define SYS_brk             19
 #define SYS_mmap            20
 #define SYS_munmap          21
 #define SYS_shmem           22
+#define SYS_msync           23
+#define SYS_faultaround     24
+#define SYS_reclaimstat     25
 #define SYS_putc            30
 #define SYS_pgdir           31
+#define SYS_kmstat          32
 #define SYS_open            100
 #define SYS_close           101
 #define SYS_read            102
@@ -37,6 +42,13 @@
 #define CLONE_THREAD        0x00000200  // thread group
 #define CLONE_FS            0x00000800  // set if shared between processes
 
+/* SYS_mmap flags */
+#define MMAP_WRITE          0x00000100  // the mapping is writable
+#define MMAP_STACK          0x00000200  // the mapping is a stack
+#define MMAP_SHARED         0x00000400  // file mapping, writes go to the file and to everyone mapping it
+#define MMAP_PRIVATE        0x00000800  // file mapping, writes stay in the process
+#define MMAP_HUGE           0x00001000  // anonymous memory in 4MB pages where possible, 4MB aligned
+
 /* VFS flags */
 // flags for open: choose one of these
 #define O_RDONLY            0           // open for reading only
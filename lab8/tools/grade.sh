@@ -338,14 +338,13 @@ default_check() {
 
     pts=3
     quick_check 'check output'                                  \
-    'memory management: default_pmm_manager'                      \
+    'memory management: order_pmm_manager'                        \
     'check_alloc_page() succeeded!'                             \
     'check_pgdir() succeeded!'                                  \
     'check_boot_pgdir() succeeded!'				\
-    'PDE(0e0) c0000000-f8000000 38000000 urw'                   \
-    '  |-- PTE(38000) c0000000-f8000000 38000000 -rw'           \
+    'PDE(0e0) c0000000-f8000000 38000000 -rw 4M'                \
     'PDE(001) fac00000-fb000000 00400000 -rw'                   \
-    '  |-- PTE(000e0) faf00000-fafe0000 000e0000 urw'           \
+    '  |-- PTE(000e0) faf00000-fafe0000 000e0000 -rw'           \
     '  |-- PTE(00001) fafeb000-fafec000 00001000 -rw'		\
     'check_vma_struct() succeeded!'                             \
     'page fault at 0x00000100: K/W [no page found].'            \
@@ -439,12 +438,10 @@ run_test -prog 'pgdir' -check default_check
       - 'kernel_execve: pid = ., name = "pgdir".*'               \
       - 'I am .*'                                  \
         'PDE(001) 00800000-00c00000 00400000 urw'               \
-        '  |-- PTE(00002) 00800000-00802000 00002000 ur-'       \
-        '  |-- PTE(00001) 00802000-00803000 00001000 urw'       \
+      - '  \|-- PTE\(0000[1-4]\) 0080[0-3]000-0080[1-4]000 0000[1-4]000 ur-' \
         'PDE(001) afc00000-b0000000 00400000 urw'               \
-        '  |-- PTE(00004) afffc000-b0000000 00004000 urw'       \
-        'PDE(0e0) c0000000-f8000000 38000000 urw'               \
-        '  |-- PTE(38000) c0000000-f8000000 38000000 -rw'       \
+        '  |-- PTE(00001) affff000-b0000000 00001000 urw'       \
+        'PDE(0e0) c0000000-f8000000 38000000 -rw 4M'            \
         'pgdir pass.'
 
 run_test -prog 'yield' -check default_check                                          \
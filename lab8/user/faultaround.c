@@ -0,0 +1,60 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <x86.h>
+#include <unistd.h>
+#include <faultstat.h>
+
+#define NR_PAGES        256
+
+// touch - read every page of a fresh anonymous mapping in order, with a window of
+//       - pages, and return the faults taken; only the zero page is mapped around
+//       - a read, a write would need a frame of its own
+static int
+touch(int pages) {
+    struct faultstat before, after;
+    uint64_t start, cycles;
+    int i;
+    assert(faultaround(pages, &before) == 0 && before.fault_around == pages);
+    char *buf = mmap(NULL, NR_PAGES * PGSIZE, MMAP_WRITE, -1, 0);
+    assert(buf != NULL);
+    int sum = 0;
+    start = rdtsc();
+    for (i = 0; i < NR_PAGES; i ++) {
+        sum += buf[i * PGSIZE];
+    }
+    cycles = rdtsc() - start;
+    assert(faultaround(0, &after) == 0);
+    assert(sum == 0);
+    for (i = 0; i < NR_PAGES; i ++) {
+        buf[i * PGSIZE] = (char)i;
+    }
+    for (i = 0; i < NR_PAGES; i ++) {
+        assert(buf[i * PGSIZE] == (char)i && buf[i * PGSIZE + 1] == 0);
+    }
+    assert(munmap(buf, NR_PAGES * PGSIZE) == 0);
+
+    int nr_fault = after.nr_fault - before.nr_fault, nr_around = after.nr_around - before.nr_around;
+    assert(nr_fault + nr_around == NR_PAGES);
+    cprintf("window %2d: %3d faults, %3d pages mapped around, %d cycles per page\n",
+            pages, nr_fault, nr_around, per_op(cycles, NR_PAGES));
+    return nr_fault;
+}
+
+int
+main(void) {
+    struct faultstat st;
+    assert(faultaround(0, &st) == 0);
+    int saved = st.fault_around;
+    assert(faultaround(3, NULL) != 0 && faultaround(-1, NULL) != 0);
+
+    // the mapping need not be aligned to the window, the first and last windows may be cut
+    assert(touch(1) == NR_PAGES);
+    assert(touch(4) <= NR_PAGES / 4 + 1);
+    assert(touch(16) <= NR_PAGES / 16 + 1);
+    assert(touch(64) <= NR_PAGES / 64 + 1);
+
+    assert(faultaround(saved, NULL) == 0);
+    cprintf("faultaround pass.\n");
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <x86.h>
+#include <unistd.h>
+#include <faultstat.h>
+
+#define HUGE_SIZE       (4 * 1024 * 1024)
+#define NR_HUGE         2
+#define MAP_SIZE        (NR_HUGE * HUGE_SIZE)
+
+// touch - write every 4KB page of a fresh anonymous mapping of MAP_SIZE bytes with
+//       - mmap_flags, and return the faults taken
+static int
+touch(uint32_t mmap_flags, char **buf_store) {
+    struct faultstat before, after;
+    uint64_t start, cycles;
+    int i;
+    char *buf = mmap(NULL, MAP_SIZE, MMAP_WRITE | mmap_flags, -1, 0);
+    assert(buf != NULL);
+    assert(faultaround(0, &before) == 0);
+    start = rdtsc();
+    for (i = 0; i < MAP_SIZE / PGSIZE; i ++) {
+        buf[i * PGSIZE] = (char)i;
+    }
+    cycles = rdtsc() - start;
+    assert(faultaround(0, &after) == 0);
+    int nr_fault = after.nr_fault - before.nr_fault;
+    cprintf("%s pages: %4d faults, %d cycles per 4KB\n", (mmap_flags & MMAP_HUGE) ? "4MB" : "4KB",
+            nr_fault, per_op(cycles, MAP_SIZE / PGSIZE));
+    *buf_store = buf;
+    return nr_fault;
+}
+
+int
+main(void) {
+    char *buf;
+    int i, pid, exit_code;
+
+    assert(mmap(NULL, HUGE_SIZE, MMAP_HUGE, 0, 0) == NULL);
+    assert(mmap((void *)(HUGE_SIZE + PGSIZE), HUGE_SIZE, MMAP_HUGE, -1, 0) == NULL);
+
+    touch(0, &buf);
+    assert(munmap(buf, MAP_SIZE) == 0);
+
+    // without a free 4MB block the faults fall back to 4KB pages, so only the
+    // content is checked, not the number of faults
+    int nr_fault = touch(MMAP_HUGE, &buf);
+    assert((uintptr_t)buf % HUGE_SIZE == 0);
+    if (nr_fault == NR_HUGE) {
+        cprintf("every 4MB got a 4MB page.\n");
+    }
+
+    // a 4MB page is shared copy-on-write by fork like the others
+    if ((pid = fork()) == 0) {
+        for (i = 0; i < MAP_SIZE / PGSIZE; i ++) {
+            assert(buf[i * PGSIZE] == (char)i);
+            buf[i * PGSIZE] = (char)(i + 1);
+        }
+        exit(0);
+    }
+    assert(pid > 0 && waitpid(pid, &exit_code) == 0 && exit_code == 0);
+    for (i = 0; i < MAP_SIZE / PGSIZE; i ++) {
+        assert(buf[i * PGSIZE] == (char)i);
+    }
+
+    // cutting a 4MB page from its start is refused, a length ending in one takes it all
+    assert(munmap(buf + PGSIZE, PGSIZE) != 0);
+    assert(munmap(buf, PGSIZE) == 0);
+    assert(buf[HUGE_SIZE] == (char)(HUGE_SIZE / PGSIZE));
+    assert(munmap(buf + HUGE_SIZE, HUGE_SIZE) == 0);
+
+    cprintf("hugepage pass.\n");
+    return 0;
+}
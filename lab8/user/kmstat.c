@@ -0,0 +1,39 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <kmstat.h>
+
+static void
+print_kmstat(struct kmstat *st) {
+    int i;
+    cprintf("kmalloc: %d bytes in use, peak %d bytes, %d kmalloc, %d kfree\n",
+            st->bytes, st->peak_bytes, st->nr_alloc, st->nr_free);
+    for (i = 0; i < KMSTAT_NCLASS; i ++) {
+        struct kmclass_stat *cs = st->classes + i;
+        if (cs->size != 0) {
+            cprintf("  %4d: ", cs->size);
+        }
+        else {
+            cprintf("   big: ");
+        }
+        cprintf("%d objects, %d bytes, peak %d bytes, %d allocs\n",
+                cs->objects, cs->bytes, cs->peak_bytes, cs->nr_alloc);
+    }
+}
+
+int
+main(void) {
+    struct kmstat st;
+    uint32_t bytes = 0;
+    int i;
+    assert(kmstat(&st) == 0);
+    print_kmstat(&st);
+    for (i = 0; i < KMSTAT_NCLASS; i ++) {
+        bytes += st.classes[i].bytes;
+        assert(st.classes[i].bytes <= st.classes[i].peak_bytes);
+    }
+    assert(bytes == st.bytes && st.bytes <= st.peak_bytes);
+    assert(st.nr_alloc >= st.nr_free);
+
+    cprintf("kmstat pass.\n");
+    return 0;
+}
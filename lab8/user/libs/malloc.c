@@ -0,0 +1,218 @@
+#include <defs.h>
+#include <string.h>
+#include <unistd.h>
+#include <ulib.h>
+#include <lock.h>
+#include <malloc.h>
+
+/* *
+ * A size-class allocator on top of sbrk. Every block starts with a header
+ * which tells free where it came from. Blocks up to 4096 bytes (header
+ * included) are rounded up to a power of two; each arena keeps a free list
+ * per class and carves new blocks from a chunk of MALLOC_CHUNK bytes it
+ * took from sbrk, so most malloc and free are a list operation under the
+ * arena lock and no syscall. Bigger blocks get their own mmap.
+ *
+ * A malloc takes the first arena it can lock without waiting, starting at
+ * the one the last malloc used; threads which malloc at the same time thus
+ * spread over the arenas. A free goes back to the arena of the block.
+ * */
+
+#define MALLOC_MAGIC            0x6d61
+#define MALLOC_BIG              MALLOC_NCLASS           // class of the blocks which have their own mmap
+
+struct mhdr {
+    uint16_t magic;
+    uint8_t arena;
+    uint8_t class;
+    uint32_t size;                                      // bytes of the mmap for a big block
+};
+
+struct arena {
+    lock_t lock;
+    void *free_list[MALLOC_NCLASS];                     // free blocks, linked through their first word
+    char *top, *end;                                    // the part of the chunk not carved yet
+    struct malloc_stat stat;
+};
+
+static struct arena arenas[MALLOC_NARENA];
+static volatile int arena_hint;
+
+#define class_size(class)       (1 << ((class) + MALLOC_MIN_SHIFT))
+
+static inline int
+size_class(size_t size) {
+    int class = 0;
+    while (class < MALLOC_NCLASS && class_size(class) < size) {
+        class ++;
+    }
+    return class;
+}
+
+// arena_lock - lock the first arena which is free, waiting for one only if all are busy
+static struct arena *
+arena_lock(void) {
+    int i, hint = arena_hint;
+    for (i = 0; i < MALLOC_NARENA; i ++) {
+        struct arena *a = arenas + (hint + i) % MALLOC_NARENA;
+        if (!try_lock(&(a->lock))) {
+            if (i != 0) {
+                arena_hint = (hint + i) % MALLOC_NARENA;
+                a->stat.nr_contended ++;
+            }
+            return a;
+        }
+    }
+    lock(&(arenas[hint].lock));
+    arenas[hint].stat.nr_contended ++;
+    return arenas + hint;
+}
+
+// arena_refill - take a new chunk from sbrk, the rest of the old one goes to the free
+//              - lists in the biggest blocks it holds
+static bool
+arena_refill(struct arena *a) {
+    int class;
+    for (class = MALLOC_NCLASS - 1; class >= 0; class --) {
+        size_t size = class_size(class);
+        while (a->end - a->top >= size) {
+            *(void **)(a->top) = a->free_list[class];
+            a->free_list[class] = a->top;
+            a->top += size;
+        }
+    }
+    char *chunk;
+    if ((chunk = sbrk(MALLOC_CHUNK)) == (void *)-1) {
+        return 0;
+    }
+    a->top = chunk, a->end = chunk + MALLOC_CHUNK;
+    a->stat.nr_sbrk ++;
+    return 1;
+}
+
+static void *
+malloc_big(size_t size) {
+    size_t len = ROUNDUP(size + sizeof(struct mhdr), PGSIZE);
+    struct mhdr *hdr;
+    if (len < size || (hdr = mmap(NULL, len, MMAP_WRITE, -1, 0)) == NULL) {
+        return NULL;
+    }
+    hdr->magic = MALLOC_MAGIC;
+    hdr->arena = 0;
+    hdr->class = MALLOC_BIG;
+    hdr->size = len;
+    struct arena *a = arena_lock();
+    a->stat.nr_malloc ++, a->stat.nr_big ++;
+    unlock(&(a->lock));
+    return hdr + 1;
+}
+
+void *
+malloc(size_t size) {
+    if (size == 0 || size > SIZE_MAX - sizeof(struct mhdr)) {
+        return NULL;
+    }
+    int class = size_class(size + sizeof(struct mhdr));
+    if (class == MALLOC_BIG) {
+        return malloc_big(size);
+    }
+
+    struct arena *a = arena_lock();
+    struct mhdr *hdr;
+    if ((hdr = a->free_list[class]) != NULL) {
+        a->free_list[class] = *(void **)hdr;
+    }
+    else {
+        if (a->end - a->top < class_size(class) && !arena_refill(a)) {
+            unlock(&(a->lock));
+            return NULL;
+        }
+        hdr = (struct mhdr *)(a->top);
+        a->top += class_size(class);
+    }
+    a->stat.nr_malloc ++;
+    unlock(&(a->lock));
+
+    hdr->magic = MALLOC_MAGIC;
+    hdr->arena = a - arenas;
+    hdr->class = class;
+    hdr->size = 0;
+    return hdr + 1;
+}
+
+void *
+calloc(size_t nmemb, size_t size) {
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        return NULL;
+    }
+    void *ptr;
+    if ((ptr = malloc(nmemb * size)) != NULL) {
+        memset(ptr, 0, nmemb * size);
+    }
+    return ptr;
+}
+
+void *
+realloc(void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return malloc(size);
+    }
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    struct mhdr *hdr = (struct mhdr *)ptr - 1;
+    assert(hdr->magic == MALLOC_MAGIC);
+    size_t old = ((hdr->class == MALLOC_BIG) ? hdr->size : class_size(hdr->class)) - sizeof(struct mhdr);
+    if (size <= old) {
+        return ptr;
+    }
+    void *nptr;
+    if ((nptr = malloc(size)) != NULL) {
+        memcpy(nptr, ptr, old);
+        free(ptr);
+    }
+    return nptr;
+}
+
+void
+free(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    struct mhdr *hdr = (struct mhdr *)ptr - 1;
+    assert(hdr->magic == MALLOC_MAGIC && hdr->arena < MALLOC_NARENA && hdr->class <= MALLOC_BIG);
+    struct arena *a = arenas + hdr->arena;
+    if (hdr->class == MALLOC_BIG) {
+        size_t len = hdr->size;
+        hdr->magic = 0;
+        int ret = munmap(hdr, len);
+        assert(ret == 0);
+        lock(&(a->lock));
+    }
+    else {
+        int class = hdr->class;
+        hdr->magic = 0;
+        lock(&(a->lock));
+        *(void **)hdr = a->free_list[class];
+        a->free_list[class] = hdr;
+    }
+    a->stat.nr_free ++;
+    unlock(&(a->lock));
+}
+
+void
+malloc_stat(struct malloc_stat *st) {
+    int i;
+    memset(st, 0, sizeof(struct malloc_stat));
+    for (i = 0; i < MALLOC_NARENA; i ++) {
+        struct arena *a = arenas + i;
+        lock(&(a->lock));
+        st->nr_malloc += a->stat.nr_malloc;
+        st->nr_free += a->stat.nr_free;
+        st->nr_big += a->stat.nr_big;
+        st->nr_sbrk += a->stat.nr_sbrk;
+        st->nr_contended += a->stat.nr_contended;
+        unlock(&(a->lock));
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef __USER_LIBS_MALLOC_H__
+#define __USER_LIBS_MALLOC_H__
+
+#include <defs.h>
+#include <ulib.h>
+
+#define MALLOC_NARENA           4                       // arenas, a thread moves on when one is busy
+#define MALLOC_NCLASS           9                       // blocks of 16, 32, ..., 4096 bytes with the header
+#define MALLOC_MIN_SHIFT        4
+#define MALLOC_CHUNK            (16 * PGSIZE)           // an arena takes so much heap from sbrk at a time
+
+// counters of the allocator, summed over the arenas by malloc_stat
+struct malloc_stat {
+    size_t nr_malloc;                                   // malloc (and calloc, realloc) which returned a block
+    size_t nr_free;                                     // free of a block
+    size_t nr_big;                                      // blocks too big for a class, one mmap each
+    size_t nr_sbrk;                                     // chunks taken from sbrk
+    size_t nr_contended;                                // malloc which found its arena locked
+};
+
+void *malloc(size_t size);
+void *calloc(size_t nmemb, size_t size);
+void *realloc(void *ptr, size_t size);
+void free(void *ptr);
+void malloc_stat(struct malloc_stat *st);
+
+#endif /* !__USER_LIBS_MALLOC_H__ */
+
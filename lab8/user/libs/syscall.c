@@ -63,6 +63,36 @@ sys_getpid(void) {
     return syscall(SYS_getpid);
 }
 
+int
+sys_brk(uintptr_t *brk_store) {
+    return syscall(SYS_brk, brk_store);
+}
+
+int
+sys_mmap(uintptr_t *addr_store, size_t len, uint32_t mmap_flags, int fd, off_t offset) {
+    return syscall(SYS_mmap, addr_store, len, mmap_flags, fd, offset);
+}
+
+int
+sys_munmap(uintptr_t addr, size_t len) {
+    return syscall(SYS_munmap, addr, len);
+}
+
+int
+sys_msync(uintptr_t addr, size_t len) {
+    return syscall(SYS_msync, addr, len);
+}
+
+int
+sys_faultaround(int pages, struct faultstat *st) {
+    return syscall(SYS_faultaround, pages, st);
+}
+
+int
+sys_reclaimstat(struct reclaimstat *st) {
+    return syscall(SYS_reclaimstat, st);
+}
+
 int
 sys_putc(int c) {
     return syscall(SYS_putc, c);
@@ -73,6 +103,11 @@ sys_pgdir(void) {
     return syscall(SYS_pgdir);
 }
 
+int
+sys_kmstat(struct kmstat *st) {
+    return syscall(SYS_kmstat, st);
+}
+
 void
 sys_lab6_set_priority(uint32_t priority)
 {
@@ -8,8 +8,18 @@ int sys_exec(const char *name, int argc, const char **argv);
 int sys_yield(void);
 int sys_kill(int pid);
 int sys_getpid(void);
+int sys_brk(uintptr_t *brk_store);
+int sys_mmap(uintptr_t *addr_store, size_t len, uint32_t mmap_flags, int fd, off_t offset);
+int sys_munmap(uintptr_t addr, size_t len);
+int sys_msync(uintptr_t addr, size_t len);
+struct faultstat;
+int sys_faultaround(int pages, struct faultstat *st);
+struct reclaimstat;
+int sys_reclaimstat(struct reclaimstat *st);
 int sys_putc(int c);
 int sys_pgdir(void);
+struct kmstat;
+int sys_kmstat(struct kmstat *st);
 int sys_sleep(unsigned int time);
 int sys_gettime(void);
 
@@ -5,8 +5,11 @@
 #include <stat.h>
 #include <string.h>
 #include <lock.h>
+#include <x86.h>
 
 static lock_t fork_lock = INIT_LOCK;
+static lock_t heap_lock = INIT_LOCK;
+static uintptr_t heap_end, heap_brk;    // what sbrk has handed out, what the kernel has mapped
 
 void
 lock_fork(void) {
@@ -55,12 +58,80 @@ getpid(void) {
     return sys_getpid();
 }
 
+//sbrk - grow (or shrink) the heap by increment bytes, return its old end, (void *)-1 on failure
+void *
+sbrk(intptr_t increment) {
+    void *ret = (void *)-1;
+    lock(&heap_lock);
+    if (heap_brk == 0) {
+        // a brk below the start of the heap just reads where it ends
+        sys_brk(&heap_brk);
+        heap_end = heap_brk;
+    }
+    uintptr_t end = heap_end + increment, brk = end;
+    if ((increment < 0) ? end > heap_end : end < heap_end) {
+        goto out;
+    }
+    if (ROUNDUP(end, PGSIZE) != heap_brk) {
+        sys_brk(&brk);
+        if (brk != ROUNDUP(end, PGSIZE)) {
+            goto out;
+        }
+        heap_brk = brk;
+    }
+    ret = (void *)heap_end;
+    heap_end = end;
+out:
+    unlock(&heap_lock);
+    return ret;
+}
+
+//mmap - map len bytes at addr, or anywhere if addr is NULL: anonymous memory if fd < 0,
+//       otherwise the file fd from offset, MMAP_SHARED or MMAP_PRIVATE
+void *
+mmap(void *addr, size_t len, uint32_t mmap_flags, int fd, off_t offset) {
+    uintptr_t addr_store = (uintptr_t)addr;
+    if (sys_mmap(&addr_store, len, mmap_flags, fd, offset) != 0) {
+        return NULL;
+    }
+    return (void *)addr_store;
+}
+
+int
+munmap(void *addr, size_t len) {
+    return sys_munmap((uintptr_t)addr, len);
+}
+
+//msync - write what was written to the shared file mappings in [addr, addr + len) to the files
+int
+msync(void *addr, size_t len) {
+    return sys_msync((uintptr_t)addr, len);
+}
+
+//faultaround - set the fault-around window to pages (0 keeps it), read the fault counters into st
+int
+faultaround(int pages, struct faultstat *st) {
+    return sys_faultaround(pages, st);
+}
+
+//reclaimstat - read the page reclaim counters of the system into st
+int
+reclaimstat(struct reclaimstat *st) {
+    return sys_reclaimstat(st);
+}
+
 //print_pgdir - print the PDT&PT
 void
 print_pgdir(void) {
     sys_pgdir();
 }
 
+//kmstat - read the kmalloc accounting of the kernel
+int
+kmstat(struct kmstat *st) {
+    return sys_kmstat(st);
+}
+
 void
 lab6_set_priority(uint32_t priority)
 {
@@ -77,6 +148,15 @@ gettime_msec(void) {
     return (unsigned int)sys_gettime();
 }
 
+// per_op - the cycles of each of n operations which took cycles together, for benchmarks
+unsigned int
+per_op(uint64_t cycles, int n) {
+    if (n != 0) {
+        do_div(cycles, n);
+    }
+    return (unsigned int)cycles;
+}
+
 int
 __exec(const char *name, const char **argv) {
     int argc = 0;
@@ -23,6 +23,8 @@ void __noreturn __panic(const char *file, int line, const char *fmt, ...);
 #define static_assert(x)                                \
     switch (x) { case 0: case (x): ; }
 
+#define PGSIZE                                  4096    // bytes of a page, the unit of sbrk and mmap
+
 int fprintf(int fd, const char *fmt, ...);
 
 void __noreturn exit(int error_code);
@@ -32,9 +34,20 @@ int waitpid(int pid, int *store);
 void yield(void);
 int kill(int pid);
 int getpid(void);
+void *sbrk(intptr_t increment);
+void *mmap(void *addr, size_t len, uint32_t mmap_flags, int fd, off_t offset);
+int munmap(void *addr, size_t len);
+int msync(void *addr, size_t len);
+struct faultstat;
+int faultaround(int pages, struct faultstat *st);
+struct reclaimstat;
+int reclaimstat(struct reclaimstat *st);
 void print_pgdir(void);
+struct kmstat;
+int kmstat(struct kmstat *st);
 int sleep(unsigned int time);
 unsigned int gettime_msec(void);
+unsigned int per_op(uint64_t cycles, int n);
 int __exec(const char *name, const char **argv);
 
 #define __exec0(name, path, ...)                \
@@ -0,0 +1,95 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <x86.h>
+#include <unistd.h>
+#include <malloc.h>
+
+#define NR_ROUNDS       20000
+#define NR_SLOTS        256
+#define MAX_SMALL       2048
+#define NR_MMAP         1000
+
+static void *slots[NR_SLOTS];
+static size_t sizes[NR_SLOTS];
+
+// check_malloc - blocks of every class and some big ones keep their content
+static void
+check_malloc(void) {
+    int i;
+    for (i = 0; i < NR_SLOTS; i ++) {
+        sizes[i] = (i % 8 == 7) ? (i * 97) % (4 * PGSIZE) + 1 : (i * 13) % MAX_SMALL + 1;
+        assert((slots[i] = malloc(sizes[i])) != NULL);
+        memset(slots[i], i, sizes[i]);
+    }
+    for (i = 0; i < NR_SLOTS; i ++) {
+        unsigned char *p = slots[i];
+        assert(p[0] == (unsigned char)i && p[sizes[i] - 1] == (unsigned char)i);
+        assert((slots[i] = realloc(p, sizes[i] * 2)) != NULL);
+        p = slots[i];
+        assert(p[0] == (unsigned char)i && p[sizes[i] - 1] == (unsigned char)i);
+    }
+    for (i = 0; i < NR_SLOTS; i ++) {
+        free(slots[i]);
+        slots[i] = NULL;
+    }
+    int *zero = calloc(64, sizeof(int));
+    assert(zero != NULL);
+    for (i = 0; i < 64; i ++) {
+        assert(zero[i] == 0);
+    }
+    free(zero);
+    cprintf("check_malloc() succeeded!\n");
+}
+
+int
+main(void) {
+    uint64_t start, cycles;
+    int i;
+
+    check_malloc();
+
+    // a malloc right followed by its free, the block never leaves the free list
+    srand(1);
+    start = rdtsc();
+    for (i = 0; i < NR_ROUNDS; i ++) {
+        void *p = malloc(rand() % MAX_SMALL + 1);
+        *(char *)p = 0;
+        free(p);
+    }
+    cycles = rdtsc() - start;
+    cprintf("mallocbench: malloc+free pair: %u cycles\n", per_op(cycles, NR_ROUNDS));
+
+    // a working set of NR_SLOTS blocks, a random one is replaced each round
+    start = rdtsc();
+    for (i = 0; i < NR_ROUNDS; i ++) {
+        int slot = rand() % NR_SLOTS;
+        free(slots[slot]);
+        slots[slot] = malloc(rand() % MAX_SMALL + 1);
+        *(char *)slots[slot] = 0;
+    }
+    cycles = rdtsc() - start;
+    cprintf("mallocbench: working set of %d: %u cycles per free+malloc\n", NR_SLOTS, per_op(cycles, NR_ROUNDS));
+    for (i = 0; i < NR_SLOTS; i ++) {
+        free(slots[i]);
+    }
+
+    // what every allocation costs when it is a syscall
+    start = rdtsc();
+    for (i = 0; i < NR_MMAP; i ++) {
+        void *p = mmap(NULL, PGSIZE, MMAP_WRITE, -1, 0);
+        *(char *)p = 0;
+        munmap(p, PGSIZE);
+    }
+    cycles = rdtsc() - start;
+    cprintf("mallocbench: mmap+munmap pair: %u cycles\n", per_op(cycles, NR_MMAP));
+
+    struct malloc_stat st;
+    malloc_stat(&st);
+    assert(st.nr_malloc == st.nr_free);
+    cprintf("mallocbench: %d malloc, %d big, %d sbrk, %d contended\n",
+            st.nr_malloc, st.nr_big, st.nr_sbrk, st.nr_contended);
+    cprintf("mallocbench pass.\n");
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stat.h>
+#include <file.h>
+#include <unistd.h>
+#include <x86.h>
+#include <malloc.h>
+
+// a scratch file on the disk image, the test writes it from scratch (sfs cannot create
+// files, the image has an empty one); SIZE ends inside a page on purpose
+#define FILENAME            "mmapdata"
+#define SIZE                (5 * PGSIZE + 123)
+
+static char
+file_byte(int fd, off_t pos) {
+    char c;
+    assert(seek(fd, pos, LSEEK_SET) == 0 && read(fd, &c, 1) == 1);
+    return c;
+}
+
+int
+main(void) {
+    struct stat __stat, *stat = &__stat;
+    uint64_t start, cycles;
+    int fd, pid, exit_code;
+    size_t i, size = SIZE;
+    uint32_t sum1 = 0, sum2 = 0;
+
+    char *buf = malloc(size);
+    assert(buf != NULL);
+    for (i = 0; i < size; i ++) {
+        buf[i] = (char)(i * 7 + i / PGSIZE);
+    }
+    assert((fd = open(FILENAME, O_RDWR | O_TRUNC)) >= 0);
+    assert(write(fd, buf, size) == size);
+    assert(fstat(fd, stat) == 0 && stat->st_size == size);
+
+    memset(buf, 0, size);
+    start = rdtsc();
+    assert(seek(fd, 0, LSEEK_SET) == 0 && read(fd, buf, size) == size);
+    for (i = 0; i < size; i ++) {
+        sum1 += (unsigned char)buf[i];
+    }
+    cycles = rdtsc() - start;
+    assert(buf[size - 1] == (char)((size - 1) * 7 + (size - 1) / PGSIZE));
+    cprintf("mmaptest: read %d bytes: %u cycles per page\n", size, per_op(cycles, ROUNDUP(size, PGSIZE) / PGSIZE));
+
+    char *shared = mmap(NULL, size, MMAP_SHARED | MMAP_WRITE, fd, 0);
+    assert(shared != NULL);
+    start = rdtsc();
+    for (i = 0; i < size; i ++) {
+        sum2 += (unsigned char)shared[i];
+    }
+    cycles = rdtsc() - start;
+    cprintf("mmaptest: mmap %d bytes: %u cycles per page\n", size, per_op(cycles, ROUNDUP(size, PGSIZE) / PGSIZE));
+    assert(sum1 == sum2 && memcmp(shared, buf, size) == 0);
+
+    // a private mapping sees the file, its writes stay in it
+    char *private = mmap(NULL, size, MMAP_PRIVATE | MMAP_WRITE, fd, 0);
+    assert(private != NULL && memcmp(private, buf, size) == 0);
+    private[size - 1] ^= 0xff;
+    assert(shared[size - 1] == buf[size - 1]);
+    assert(msync(shared, size) == 0 && file_byte(fd, size - 1) == buf[size - 1]);
+
+    // the child maps the same frames, what it writes is in the file after its exit
+    if ((pid = fork()) == 0) {
+        shared[size - 1] ^= 0xff;
+        exit(0);
+    }
+    assert(pid > 0 && waitpid(pid, &exit_code) == 0 && exit_code == 0);
+    assert(shared[size - 1] == (char)(buf[size - 1] ^ 0xff));
+    assert(file_byte(fd, size - 1) == (char)(buf[size - 1] ^ 0xff));
+    assert(private[size - 1] == (char)(buf[size - 1] ^ 0xff));
+
+    shared[size - 1] = buf[size - 1];
+    assert(msync(shared, size) == 0 && file_byte(fd, size - 1) == buf[size - 1]);
+
+    assert(munmap(private, size) == 0 && munmap(shared, size) == 0);
+    assert(mmap(NULL, size, MMAP_SHARED | MMAP_PRIVATE, fd, 0) == NULL);
+    close(fd);
+    free(buf);
+
+    cprintf("mmaptest pass.\n");
+    return 0;
+}
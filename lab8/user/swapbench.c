@@ -0,0 +1,49 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <x86.h>
+#include <unistd.h>
+#include <reclaimstat.h>
+
+#define NR_EXTRA        1024            // pages written beyond the free memory, they have to be swapped
+
+// pattern - what page i holds, differs from page to page
+static uint32_t
+pattern(int i) {
+    return (uint32_t)i * 2654435761u;
+}
+
+// write every page of a mapping bigger than the free memory, then read them all back,
+// and report how long the allocations stalled for page reclaim. Compare with a kernel
+// built with KSWAPD=0.
+int
+main(void) {
+    struct reclaimstat st0, st1;
+    int i;
+
+    assert(reclaimstat(&st0) == 0);
+    int npages = st0.nr_free + NR_EXTRA;
+    uint32_t *buf = mmap(NULL, npages * PGSIZE, MMAP_WRITE, -1, 0);
+    assert(buf != NULL);
+
+    unsigned int start = gettime_msec();
+    for (i = 0; i < npages; i ++) {
+        buf[i * (PGSIZE / sizeof(uint32_t))] = pattern(i);
+    }
+    unsigned int msec = gettime_msec() - start;
+    for (i = 0; i < npages; i ++) {
+        assert(buf[i * (PGSIZE / sizeof(uint32_t))] == pattern(i));
+    }
+    assert(reclaimstat(&st1) == 0);
+    assert(munmap(buf, npages * PGSIZE) == 0);
+
+    int nr_stall = st1.nr_stall - st0.nr_stall;
+    cprintf("swapbench: %d pages written in %d msecs, kswapd %s\n",
+            npages, msec, st1.kswapd ? "on" : "off");
+    cprintf("  %d pages freed by kswapd, %d by direct reclaim\n",
+            st1.nr_kswapd - st0.nr_kswapd, st1.nr_direct - st0.nr_direct);
+    cprintf("  %d allocation stalls, %u cycles each on average\n",
+            nr_stall, per_op(st1.stall_cycles - st0.stall_cycles, nr_stall));
+    cprintf("swapbench pass.\n");
+    return 0;
+}
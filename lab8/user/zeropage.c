@@ -0,0 +1,50 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <faultstat.h>
+
+#define NR_PAGES        64
+
+static char bss[NR_PAGES * PGSIZE];
+
+// read_pages - read every page of buf, which was never written, and check it is zero
+static void
+read_pages(const char *buf, int n) {
+    int i;
+    for (i = 0; i < n; i ++) {
+        assert(buf[i * PGSIZE] == 0 && buf[i * PGSIZE + PGSIZE - 1] == 0);
+    }
+}
+
+int
+main(void) {
+    struct faultstat st0, st1, st2;
+    int i;
+
+    assert(faultaround(0, &st0) == 0);
+    char *heap = sbrk((NR_PAGES + 1) * PGSIZE);
+    assert(heap != (void *)-1);
+    heap = (char *)ROUNDUP((uintptr_t)heap, PGSIZE);
+    read_pages(heap, NR_PAGES);
+    read_pages(bss, NR_PAGES);
+    assert(faultaround(0, &st1) == 0);
+    // the first and the last page of bss may be shared with the data of the program
+    int nr_zero = st1.nr_zero - st0.nr_zero;
+    assert(nr_zero >= NR_PAGES + NR_PAGES - 2);
+
+    // only the written pages get a frame of their own, the others still read as zero
+    for (i = 0; i < NR_PAGES; i += 2) {
+        heap[i * PGSIZE] = (char)i;
+    }
+    assert(faultaround(0, &st2) == 0);
+    assert(st2.nr_zero_cow - st1.nr_zero_cow == NR_PAGES / 2);
+    for (i = 0; i < NR_PAGES; i ++) {
+        assert(heap[i * PGSIZE] == ((i % 2 == 0) ? (char)i : 0));
+    }
+
+    int saved = st2.nr_zero - st2.nr_zero_cow;
+    cprintf("%d pages read as zero, %d written later, %d pages (%d KB) of rss saved.\n",
+            st2.nr_zero, st2.nr_zero_cow, saved, saved * (PGSIZE / 1024));
+    cprintf("zeropage pass.\n");
+    return 0;
+}